@@ -0,0 +1,22 @@
+#  Defines the follwing variables:
+#  LibUring_FOUND - system has LibUring
+#  LibUring_INCLUDE_DIRS - the LibUring include directories
+#  LibUring_LIBRARIES - link these to use LibUring
+
+include(LibFindMacros)
+
+# Include dir
+find_path(LibUring_INCLUDE_DIR
+        NAMES liburing.h
+        )
+
+# Finally the library itself
+find_library(LibUring_LIBRARY
+        NAMES uring liburing.a liburing.so
+        )
+
+# Set the include dir variables and the libraries and let libfind_process do the rest.
+# NOTE: Singular variables for this library, plural for libraries this this lib depends on.
+set(LibUring_PROCESS_INCLUDES LibUring_INCLUDE_DIR)
+set(LibUring_PROCESS_LIBS LibUring_LIBRARY)
+libfind_process(LibUring)
@@ -0,0 +1,22 @@
+#  Defines the follwing variables:
+#  NGHTTP2_FOUND - system has nghttp2
+#  NGHTTP2_INCLUDE_DIRS - the nghttp2 include directories
+#  NGHTTP2_LIBRARIES - link these to use nghttp2
+
+include(LibFindMacros)
+
+# Include dir
+find_path(NGHTTP2_INCLUDE_DIR
+        NAMES nghttp2/nghttp2.h
+        )
+
+# Finally the library itself
+find_library(NGHTTP2_LIBRARY
+        NAMES nghttp2 libnghttp2.a libnghttp2.so libnghttp2.dylib libnghttp2.lib libnghttp2.dll
+        )
+
+# Set the include dir variables and the libraries and let libfind_process do the rest.
+# NOTE: Singular variables for this library, plural for libraries this this lib depends on.
+set(NGHTTP2_PROCESS_INCLUDES NGHTTP2_INCLUDE_DIR)
+set(NGHTTP2_PROCESS_LIBS NGHTTP2_LIBRARY)
+libfind_process(NGHTTP2)
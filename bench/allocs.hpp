@@ -0,0 +1,21 @@
+#pragma once
+#include <benchmark/benchmark.h>
+#include "alloc_counter.hpp"
+
+/**
+ * \internal
+ * Reports the mean number of heap allocations (outside of libvirt's, which go through `malloc`)
+ * per iteration of the enclosing benchmark loop, as the `allocs` counter; construct it right before the loop
+ **/
+class AllocsPerIteration {
+    benchmark::State& state;
+    std::size_t start = alloc_counter::thread_allocs();
+
+  public:
+    explicit AllocsPerIteration(benchmark::State& state) noexcept : state(state) {}
+    AllocsPerIteration(const AllocsPerIteration&) = delete;
+    AllocsPerIteration& operator=(const AllocsPerIteration&) = delete;
+    ~AllocsPerIteration() {
+        state.counters["allocs"] = benchmark::Counter(static_cast<double>(alloc_counter::thread_allocs() - start), benchmark::Counter::kAvgIterations);
+    }
+};
@@ -0,0 +1,61 @@
+#include <array>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <benchmark/benchmark.h>
+#include "wrapper/handlers/async/async_handler.hpp"
+#include "wrapper/domain_actions_table.hpp"
+#include "wrapper/network_actions_table.hpp"
+#include "virt_wrap.hpp"
+
+using namespace std::literals;
+
+static void BM_HexEncodeId(benchmark::State& state) {
+    std::uint32_t id = 0;
+    for (auto _ : state)
+        benchmark::DoNotOptimize(hex_encode_id(id++));
+}
+BENCHMARK(BM_HexEncodeId);
+
+static void BM_HexDecodeId(benchmark::State& state) {
+    constexpr std::array ids = {"0"sv, "1f"sv, "deadbeef"sv, "DEADBEEF"sv};
+    const auto id = ids[state.range(0)];
+    for (auto _ : state)
+        benchmark::DoNotOptimize(hex_decode_id(id));
+    state.SetLabel(std::string{id});
+}
+BENCHMARK(BM_HexDecodeId)->DenseRange(0, 3);
+
+// First value, last value, and a miss
+static void BM_EnumHelperFromString(benchmark::State& state) {
+    constexpr std::array values = {"No State"sv, "Power Management Suspended"sv, "Nope"sv};
+    const auto value = values[state.range(0)];
+    for (auto _ : state)
+        benchmark::DoNotOptimize(virt::enums::domain::State::from_string(value));
+    state.SetLabel(std::string{value});
+}
+BENCHMARK(BM_EnumHelperFromString)->DenseRange(0, 2);
+
+static void BM_EnumSetHelperFromString(benchmark::State& state) {
+    constexpr std::array values = {"acpi_power_btn"sv, "paravirt"sv, "nope"sv};
+    const auto value = values[state.range(0)];
+    for (auto _ : state)
+        benchmark::DoNotOptimize(virt::enums::domain::ShutdownFlag::from_string(value));
+    state.SetLabel(std::string{value});
+}
+BENCHMARK(BM_EnumSetHelperFromString)->DenseRange(0, 2);
+
+static void BM_DomainActionsTable(benchmark::State& state) {
+    constexpr std::array keys = {"power_mgt"sv, "send_keys"sv, "unknown"sv};
+    const auto key = keys[state.range(0)];
+    for (auto _ : state)
+        benchmark::DoNotOptimize(domain_actions_table[key]);
+    state.SetLabel(std::string{key});
+}
+BENCHMARK(BM_DomainActionsTable)->DenseRange(0, 2);
+
+static void BM_NetworkActionsTable(benchmark::State& state) {
+    for (auto _ : state)
+        benchmark::DoNotOptimize(network_actions_table["autostart"sv]);
+}
+BENCHMARK(BM_NetworkActionsTable);
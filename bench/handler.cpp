@@ -0,0 +1,82 @@
+#include <array>
+#include <string>
+#include <string_view>
+#include <boost/beast/http.hpp>
+#include <benchmark/benchmark.h>
+#include "wrapper/actions_table.hpp"
+#include "wrapper/config.hpp"
+#include "wrapper/general_store.hpp"
+#include "wrapper/handler.hpp"
+#include "allocs.hpp"
+
+using namespace std::literals;
+
+/**
+ * \internal
+ * A store against libvirt's in-process test driver
+ **/
+static GeneralStore& bench_store() {
+    static GeneralStore gstore{[] {
+        IniConfig config{};
+        config.connURI = "test:///default";
+        config.http_auth_key_required = false;
+        return config;
+    }()};
+    return gstore;
+}
+
+/**
+ * \internal
+ * Whole JSON API pipeline (minus HTTP), from the request target to the serialized response.
+ * With the dispatch allocation-free, the single-object routes should only count the response body.
+ **/
+static void BM_HandleJsonGet(benchmark::State& state) {
+    constexpr std::array targets = {"/libvirt/domains/by-name/test"sv, "/libvirt/networks/by-name/default"sv, "/libvirt/domains"sv,
+                                    "/libvirt/domains/by-name/test/hostname"sv};
+    const auto target = targets[state.range(0)];
+    auto& gstore = bench_store();
+    http::request<http::string_body> req{http::verb::get, target, 11};
+    const AllocsPerIteration allocs{state};
+    for (auto _ : state) {
+        req.body().clear();
+        benchmark::DoNotOptimize(handle_json(gstore, req, TargetParser{req.target()}));
+    }
+    state.SetLabel(std::string{target});
+}
+BENCHMARK(BM_HandleJsonGet)->DenseRange(0, 3);
+
+static void BM_HandleJsonPatch(benchmark::State& state) {
+    constexpr auto body = R"({"power_mgt": "suspend"})"sv;
+    auto& gstore = bench_store();
+    http::request<http::string_body> req{http::verb::patch, "/libvirt/domains/by-name/test", 11};
+    const AllocsPerIteration allocs{state};
+    for (auto _ : state) {
+        req.body().assign(body.data(), body.size()); // clobbered by the in situ parse
+        benchmark::DoNotOptimize(handle_json(gstore, req, TargetParser{req.target()}));
+        req.body().assign(R"({"power_mgt": "resume"})");
+        benchmark::DoNotOptimize(handle_json(gstore, req, TargetParser{req.target()}));
+    }
+}
+BENCHMARK(BM_HandleJsonPatch);
+
+static void BM_ActionScope(benchmark::State& state) {
+    const AllocsPerIteration allocs{state};
+    for (auto _ : state) {
+        int hit = static_cast<int>(state.iterations() % 8);
+        const auto skip_unless = [&](int i) { return [&, i] { return i == hit ? DependsOutcome::SUCCESS : DependsOutcome::SKIPPED; }; };
+        benchmark::DoNotOptimize(action_scope(skip_unless(0), skip_unless(1), skip_unless(2), skip_unless(3), skip_unless(4), skip_unless(5),
+                                              skip_unless(6), skip_unless(7)));
+    }
+}
+BENCHMARK(BM_ActionScope);
+
+static void BM_HandleDepends(benchmark::State& state) {
+    std::string body = R"([{"a": 1}, {"b": 2, "depends": 0}, {"c": 3, "depends": [0, 1]}, {"d": 4, "depends": [2]}])";
+    rapidjson::Document json_req{};
+    json_req.Parse(body.data());
+    JsonRes json_res{};
+    const AllocsPerIteration allocs{state};
+    for (auto _ : state)
+        handle_depends(json_req, json_res, [](const rapidjson::Value&) { return DependsOutcome::SUCCESS; });
+}
+BENCHMARK(BM_HandleDepends);
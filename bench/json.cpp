@@ -0,0 +1,107 @@
+#include <string>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include <benchmark/benchmark.h>
+#include "json_arena.hpp"
+#include "json_utils.hpp"
+
+static void BM_JsonResConstruct(benchmark::State& state) {
+    for (auto _ : state) {
+        JsonRes json_res{};
+        benchmark::DoNotOptimize(&json_res);
+    }
+}
+BENCHMARK(BM_JsonResConstruct);
+
+// 1: message lookup only; 123: also queries libvirt's last error; -999: unknown code
+static void BM_JsonResError(benchmark::State& state) {
+    const auto code = static_cast<int>(state.range(0));
+    for (auto _ : state) {
+        JsonRes json_res{};
+        json_res.error(code);
+        benchmark::DoNotOptimize(&json_res);
+    }
+}
+BENCHMARK(BM_JsonResError)->Arg(1)->Arg(123)->Arg(-999);
+
+/**
+ * \internal
+ * Appends `n` domain-like results to `json_res`
+ **/
+static void fill_results(JsonRes& json_res, std::size_t n) {
+    auto& jalloc = json_res.GetAllocator();
+    for (std::size_t i = 0; i < n; ++i) {
+        rapidjson::Value res_val;
+        res_val.SetObject();
+        res_val.AddMember("name", rapidjson::Value("vm1", jalloc), jalloc);
+        res_val.AddMember("uuid", rapidjson::Value("f6ah2js8-dfgv-3f3f-fgs1-d2s09dhjej83", jalloc), jalloc);
+        res_val.AddMember("id", -1, jalloc);
+        res_val.AddMember("status", rapidjson::StringRef("Shutoff"), jalloc);
+        res_val.AddMember("ram", 4194304, jalloc);
+        res_val.AddMember("cpu", 4, jalloc);
+        json_res.result(std::move(res_val));
+    }
+}
+
+static void BM_JsonResResults(benchmark::State& state) {
+    for (auto _ : state) {
+        JsonRes json_res{};
+        fill_results(json_res, state.range(0));
+        benchmark::DoNotOptimize(&json_res);
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_JsonResResults)->RangeMultiplier(8)->Range(1, 512);
+
+static void BM_JsonResSerialize(benchmark::State& state) {
+    JsonRes json_res{};
+    fill_results(json_res, state.range(0));
+    for (auto _ : state) {
+        rapidjson::StringBuffer buffer;
+        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        json_res.Accept(writer);
+        benchmark::DoNotOptimize(buffer.GetString());
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_JsonResSerialize)->RangeMultiplier(8)->Range(1, 512);
+
+// Full response cycle on the thread's arena, as done by handle_json: build, serialize, reset
+static void BM_JsonResArena(benchmark::State& state) {
+    auto& arena = JsonArena::local();
+    for (auto _ : state) {
+        {
+            JsonRes json_res{&arena.allocator()};
+            fill_results(json_res, state.range(0));
+            rapidjson::Writer<rapidjson::StringBuffer> writer(arena.output());
+            json_res.Accept(writer);
+            benchmark::DoNotOptimize(arena.output().GetString());
+        }
+        arena.reset();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_JsonResArena)->RangeMultiplier(8)->Range(1, 512);
+
+static void BM_JsonReqParse(benchmark::State& state) {
+    const std::string body = R"({"action": {"power_mgt": "shutdown"}, "depends": [{"vcpus": 4}, {"memory": 4194304}]})";
+    for (auto _ : state) {
+        rapidjson::Document json_req{};
+        json_req.Parse(body.data());
+        benchmark::DoNotOptimize(&json_req);
+    }
+}
+BENCHMARK(BM_JsonReqParse);
+
+static void BM_JsonReqParseInsituArena(benchmark::State& state) {
+    const std::string body = R"({"action": {"power_mgt": "shutdown"}, "depends": [{"vcpus": 4}, {"memory": 4194304}]})";
+    auto& arena = JsonArena::local();
+    std::string scratch;
+    for (auto _ : state) {
+        scratch = body;
+        arena.request().ParseInsitu(scratch.data());
+        benchmark::DoNotOptimize(&arena.request());
+        arena.reset();
+    }
+}
+BENCHMARK(BM_JsonReqParseInsituArena);
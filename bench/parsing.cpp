@@ -0,0 +1,113 @@
+#include <array>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <benchmark/benchmark.h>
+#include "allocs.hpp"
+#include "cexpr_algs.hpp"
+#include "flatmap.hpp"
+#include "urlparser.hpp"
+
+using namespace std::literals;
+
+/**
+ * \internal
+ * Request targets representative of the API, from the shortest to the most query-heavy
+ **/
+constexpr std::array bench_targets = {
+    "/libvirt/domains"sv,
+    "/libvirt/domains/by-name/vm1"sv,
+    "/libvirt/domains/by-uuid/f6ah2js8-dfgv-3f3f-fgs1-d2s09dhjej83/xml_desc?options=secure,inactive"sv,
+    "/libvirt/domains?active=true&persistent=1&autostart=no&state=running,paused,shutoff&async"sv,
+};
+
+/**
+ * \internal
+ * Full URLs, with and without explicit ports
+ **/
+constexpr std::array bench_urls = {
+    "http://localhost/libvirt/domains"sv,
+    "http://localhost:8081/libvirt/domains?active=true"sv,
+    "https://hv01.example.org:8443/libvirt/networks/by-name/default/dhcp-leases?mac=52:54:00:12:34:56"sv,
+};
+
+/**
+ * \internal
+ * Comma-separated flag lists, as found in query strings
+ **/
+constexpr std::array bench_csvs = {
+    "running"sv,
+    "running,paused,shutoff"sv,
+    "acpi_power_btn,guest_agent,initctl,signal,paravirt,acpi_power_btn,guest_agent,initctl,signal,paravirt"sv,
+};
+
+static void BM_TargetParser(benchmark::State& state) {
+    const auto target = bench_targets[state.range(0)];
+    const AllocsPerIteration allocs{state};
+    for (auto _ : state) {
+        TargetParser parser{target};
+        benchmark::DoNotOptimize(parser.getPathParts().data());
+    }
+    state.SetLabel(std::string{target});
+}
+BENCHMARK(BM_TargetParser)->DenseRange(0, bench_targets.size() - 1);
+
+static void BM_URLParser(benchmark::State& state) {
+    const auto url = bench_urls[state.range(0)];
+    for (auto _ : state) {
+        URLParser parser{url};
+        benchmark::DoNotOptimize(parser.getPort());
+    }
+    state.SetLabel(std::string{url});
+}
+BENCHMARK(BM_URLParser)->DenseRange(0, bench_urls.size() - 1);
+
+static void BM_CSVIterator(benchmark::State& state) {
+    const auto csv = bench_csvs[state.range(0)];
+    std::size_t count = 0;
+    for (auto _ : state) {
+        for (CSVIterator it{csv}; it != it.end(); ++it, ++count)
+            benchmark::DoNotOptimize(*it);
+    }
+    state.SetItemsProcessed(count);
+    state.SetLabel(std::string{csv});
+}
+BENCHMARK(BM_CSVIterator)->DenseRange(0, bench_csvs.size() - 1);
+
+/**
+ * \internal
+ * Generates `n` distinct query-like keys
+ **/
+static std::vector<std::string> make_keys(std::size_t n) {
+    std::vector<std::string> ret;
+    ret.reserve(n);
+    for (std::size_t i = 0; i < n; ++i)
+        ret.push_back("key" + std::to_string(i));
+    return ret;
+}
+
+static void BM_FlatmapFindHit(benchmark::State& state) {
+    const auto keys = make_keys(state.range(0));
+    flatmap<std::string_view, std::string_view> map;
+    for (const auto& key : keys)
+        map.emplace(key, key);
+
+    std::size_t i = 0;
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(map.find(std::string_view{keys[i]}));
+        i = i + 1 == keys.size() ? 0 : i + 1;
+    }
+}
+BENCHMARK(BM_FlatmapFindHit)->RangeMultiplier(4)->Range(1, 64);
+
+static void BM_FlatmapFindMiss(benchmark::State& state) {
+    const auto keys = make_keys(state.range(0));
+    flatmap<std::string_view, std::string_view> map;
+    for (const auto& key : keys)
+        map.emplace(key, key);
+
+    for (auto _ : state)
+        benchmark::DoNotOptimize(map.find("not-a-key"sv));
+}
+BENCHMARK(BM_FlatmapFindMiss)->RangeMultiplier(4)->Range(1, 64);
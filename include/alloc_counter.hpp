@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+
+/**
+ * \internal
+ * \file
+ * Allocation counting hook, compiled in when building with `VIRTHTTP_COUNT_ALLOCS`
+ *
+ * Counts are kept per-thread, so that they can be attributed to the request currently being handled on that thread.
+ * When the hook is disabled, everything here folds into constants.
+ **/
+
+namespace alloc_counter {
+#ifdef VIRTHTTP_COUNT_ALLOCS
+constexpr bool enabled = true;
+
+/**
+ * \internal
+ * Number of heap allocations performed so far by the calling thread
+ **/
+std::size_t thread_allocs() noexcept;
+
+/**
+ * \internal
+ * Records an allocation that did not go through the global `operator new` (e.g. a `malloc` from a custom allocator)
+ **/
+void note() noexcept;
+#else
+constexpr bool enabled = false;
+constexpr std::size_t thread_allocs() noexcept { return 0; }
+constexpr void note() noexcept {}
+#endif
+
+/**
+ * \internal
+ * Name of the response header carrying the number of allocations it took to produce the response
+ **/
+constexpr const char* header_name = "X-Alloc-Count";
+} // namespace alloc_counter
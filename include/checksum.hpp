@@ -0,0 +1,257 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+/**
+ * \internal
+ * \file
+ * Checksums computed over data as it goes through, CRC32C and SHA-256
+ *
+ * Builds targeting any x86-64, the instructions speeding them up are looked for at run time: CRC32C then goes through the `crc32`
+ * instruction of SSE4.2, a word at a time, and SHA-256 through the SHA extensions, four rounds at a time; both fall back to portable
+ * code (slicing-by-8 tables for CRC32C) elsewhere.
+ **/
+
+namespace checksum {
+
+namespace detail {
+
+#if defined(__x86_64__)
+[[nodiscard]] inline bool has_crc32() noexcept {
+    static const bool ret = [] {
+        unsigned a, b, c, d;
+        return __get_cpuid(1, &a, &b, &c, &d) && (c & (1u << 20)) != 0;
+    }();
+    return ret;
+}
+
+[[nodiscard]] inline bool has_sha() noexcept {
+    static const bool ret = [] {
+        unsigned a, b, c, d;
+        // SSSE3 and SSE4.1 for the shuffles around the SHA instructions
+        if (!__get_cpuid(1, &a, &b, &c, &d) || (c & (1u << 9)) == 0 || (c & (1u << 19)) == 0)
+            return false;
+        return __get_cpuid_count(7, 0, &a, &b, &c, &d) && (b & (1u << 29)) != 0;
+    }();
+    return ret;
+}
+#endif
+
+constexpr auto crc32c_tables = [] {
+    std::array<std::array<std::uint32_t, 256>, 8> ret{};
+    for (std::uint32_t i = 0; i < 256; ++i) {
+        auto crc = i;
+        for (int k = 0; k < 8; ++k)
+            crc = (crc >> 1) ^ (0x82F63B78u & (0u - (crc & 1u)));
+        ret[0][i] = crc;
+    }
+    for (std::size_t t = 1; t < 8; ++t)
+        for (std::size_t i = 0; i < 256; ++i)
+            ret[t][i] = (ret[t - 1][i] >> 8) ^ ret[0][ret[t - 1][i] & 0xFF];
+    return ret;
+}();
+
+[[nodiscard]] inline std::uint32_t crc32c_portable(std::uint32_t crc, const unsigned char* data, std::size_t size) noexcept {
+    const auto& t = crc32c_tables;
+    for (; size >= 8; data += 8, size -= 8) {
+        const auto lo = crc ^ (std::uint32_t{data[0]} | std::uint32_t{data[1]} << 8 | std::uint32_t{data[2]} << 16 |
+                               std::uint32_t{data[3]} << 24);
+        crc = t[7][lo & 0xFF] ^ t[6][(lo >> 8) & 0xFF] ^ t[5][(lo >> 16) & 0xFF] ^ t[4][lo >> 24] ^ t[3][data[4]] ^ t[2][data[5]] ^
+              t[1][data[6]] ^ t[0][data[7]];
+    }
+    for (; size != 0; ++data, --size)
+        crc = (crc >> 8) ^ t[0][(crc ^ *data) & 0xFF];
+    return crc;
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sse4.2"))) inline std::uint32_t crc32c_hw(std::uint32_t crc, const unsigned char* data, std::size_t size) noexcept {
+    std::uint64_t crc64 = crc;
+    for (; size >= 8; data += 8, size -= 8) {
+        std::uint64_t word;
+        std::memcpy(&word, data, sizeof(word));
+        crc64 = _mm_crc32_u64(crc64, word);
+    }
+    crc = static_cast<std::uint32_t>(crc64);
+    for (; size != 0; ++data, --size)
+        crc = _mm_crc32_u8(crc, *data);
+    return crc;
+}
+#endif
+
+constexpr std::array<std::uint32_t, 64> sha256_k{
+    0x428A2F98, 0x71374491, 0xB5C0FBCF, 0xE9B5DBA5, 0x3956C25B, 0x59F111F1, 0x923F82A4, 0xAB1C5ED5, 0xD807AA98, 0x12835B01, 0x243185BE,
+    0x550C7DC3, 0x72BE5D74, 0x80DEB1FE, 0x9BDC06A7, 0xC19BF174, 0xE49B69C1, 0xEFBE4786, 0x0FC19DC6, 0x240CA1CC, 0x2DE92C6F, 0x4A7484AA,
+    0x5CB0A9DC, 0x76F988DA, 0x983E5152, 0xA831C66D, 0xB00327C8, 0xBF597FC7, 0xC6E00BF3, 0xD5A79147, 0x06CA6351, 0x14292967, 0x27B70A85,
+    0x2E1B2138, 0x4D2C6DFC, 0x53380D13, 0x650A7354, 0x766A0ABB, 0x81C2C92E, 0x92722C85, 0xA2BFE8A1, 0xA81A664B, 0xC24B8B70, 0xC76C51A3,
+    0xD192E819, 0xD6990624, 0xF40E3585, 0x106AA070, 0x19A4C116, 0x1E376C08, 0x2748774C, 0x34B0BCB5, 0x391C0CB3, 0x4ED8AA4A, 0x5B9CCA4F,
+    0x682E6FF3, 0x748F82EE, 0x78A5636F, 0x84C87814, 0x8CC70208, 0x90BEFFFA, 0xA4506CEB, 0xBEF9A3F7, 0xC67178F2};
+
+inline void sha256_portable(std::uint32_t* state, const unsigned char* data, std::size_t blocks) noexcept {
+    const auto rotr = [](std::uint32_t x, int n) noexcept { return (x >> n) | (x << (32 - n)); };
+    for (; blocks != 0; data += 64, --blocks) {
+        std::array<std::uint32_t, 64> w;
+        for (std::size_t i = 0; i < 16; ++i)
+            w[i] = std::uint32_t{data[4 * i]} << 24 | std::uint32_t{data[4 * i + 1]} << 16 | std::uint32_t{data[4 * i + 2]} << 8 |
+                   std::uint32_t{data[4 * i + 3]};
+        for (std::size_t i = 16; i < 64; ++i) {
+            const auto s0 = rotr(w[i - 15], 7) ^ rotr(w[i - 15], 18) ^ (w[i - 15] >> 3);
+            const auto s1 = rotr(w[i - 2], 17) ^ rotr(w[i - 2], 19) ^ (w[i - 2] >> 10);
+            w[i] = w[i - 16] + s0 + w[i - 7] + s1;
+        }
+        auto a = state[0], b = state[1], c = state[2], d = state[3], e = state[4], f = state[5], g = state[6], h = state[7];
+        for (std::size_t i = 0; i < 64; ++i) {
+            const auto t1 = h + (rotr(e, 6) ^ rotr(e, 11) ^ rotr(e, 25)) + ((e & f) ^ (~e & g)) + sha256_k[i] + w[i];
+            const auto t2 = (rotr(a, 2) ^ rotr(a, 13) ^ rotr(a, 22)) + ((a & b) ^ (a & c) ^ (b & c));
+            h = g;
+            g = f;
+            f = e;
+            e = d + t1;
+            d = c;
+            c = b;
+            b = a;
+            a = t1 + t2;
+        }
+        state[0] += a;
+        state[1] += b;
+        state[2] += c;
+        state[3] += d;
+        state[4] += e;
+        state[5] += f;
+        state[6] += g;
+        state[7] += h;
+    }
+}
+
+#if defined(__x86_64__)
+__attribute__((target("sha,sse4.1,ssse3"))) inline void sha256_hw(std::uint32_t* state, const unsigned char* data, std::size_t blocks) noexcept {
+    const auto mask = _mm_set_epi64x(0x0C0D0E0F08090A0BLL, 0x0405060700010203LL);
+
+    // The state is kept as ABEF and CDGH, as the instructions take it
+    auto tmp = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state)), 0xB1);
+    auto state1 = _mm_shuffle_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(state + 4)), 0x1B);
+    auto state0 = _mm_alignr_epi8(tmp, state1, 8);
+    state1 = _mm_blend_epi16(state1, tmp, 0xF0);
+
+    for (; blocks != 0; data += 64, --blocks) {
+        const auto abef = state0;
+        const auto cdgh = state1;
+        __m128i w[4];
+        for (int i = 0; i < 16; ++i) {
+            auto& cur = w[i & 3];
+            if (i < 4)
+                cur = _mm_shuffle_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(data + 16 * i)), mask);
+            auto msg = _mm_add_epi32(cur, _mm_loadu_si128(reinterpret_cast<const __m128i*>(sha256_k.data() + 4 * i)));
+            state1 = _mm_sha256rnds2_epu32(state1, state0, msg);
+            // Message schedule, a group of four words ahead
+            if (i >= 3 && i <= 14) {
+                auto& next = w[(i + 1) & 3];
+                next = _mm_sha256msg2_epu32(_mm_add_epi32(next, _mm_alignr_epi8(cur, w[(i - 1) & 3], 4)), cur);
+            }
+            msg = _mm_shuffle_epi32(msg, 0x0E);
+            state0 = _mm_sha256rnds2_epu32(state0, state1, msg);
+            if (i >= 1 && i <= 12)
+                w[(i - 1) & 3] = _mm_sha256msg1_epu32(w[(i - 1) & 3], cur);
+        }
+        state0 = _mm_add_epi32(state0, abef);
+        state1 = _mm_add_epi32(state1, cdgh);
+    }
+
+    tmp = _mm_shuffle_epi32(state0, 0x1B);
+    state1 = _mm_shuffle_epi32(state1, 0xB1);
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state), _mm_blend_epi16(tmp, state1, 0xF0));
+    _mm_storeu_si128(reinterpret_cast<__m128i*>(state + 4), _mm_alignr_epi8(state1, tmp, 8));
+}
+#endif
+
+} // namespace detail
+
+/**
+ * \internal
+ * CRC32C (Castagnoli) of the `size` bytes at `data`, following on `crc`, that of the bytes before them (0 for none)
+ **/
+[[nodiscard]] inline std::uint32_t crc32c(std::uint32_t crc, const char* data, std::size_t size) noexcept {
+    const auto* const bytes = reinterpret_cast<const unsigned char*>(data);
+#if defined(__x86_64__)
+    if (detail::has_crc32())
+        return ~detail::crc32c_hw(~crc, bytes, size);
+#endif
+    return ~detail::crc32c_portable(~crc, bytes, size);
+}
+
+/**
+ * \internal
+ * SHA-256 of data fed a piece at a time
+ **/
+class Sha256 {
+  public:
+    constexpr static std::size_t digest_size = 32;
+
+    void update(const char* data, std::size_t size) noexcept {
+        const auto* bytes = reinterpret_cast<const unsigned char*>(data);
+        length += size;
+        if (buffered != 0) {
+            const auto n = std::min(size, block.size() - buffered);
+            std::memcpy(block.data() + buffered, bytes, n);
+            buffered += n;
+            bytes += n;
+            size -= n;
+            if (buffered != block.size())
+                return;
+            compress(block.data(), 1);
+            buffered = 0;
+        }
+        compress(bytes, size / block.size());
+        bytes += size / block.size() * block.size();
+        size %= block.size();
+        std::memcpy(block.data(), bytes, size);
+        buffered = size;
+    }
+
+    /**
+     * \internal
+     * Digest of the data fed so far; more may be fed after
+     **/
+    [[nodiscard]] std::array<unsigned char, digest_size> digest() const noexcept {
+        auto last = *this;
+        // Padding: a set bit, zeroes up to 8 bytes short of the end of a block, and the length in bits
+        const unsigned char pad[64]{0x80};
+        const auto bits = length * 8;
+        last.update(reinterpret_cast<const char*>(pad), 1 + (119 - length % 64) % 64);
+        unsigned char size[8];
+        for (std::size_t i = 0; i < 8; ++i)
+            size[i] = static_cast<unsigned char>(bits >> (56 - 8 * i));
+        last.update(reinterpret_cast<const char*>(size), sizeof(size));
+
+        std::array<unsigned char, digest_size> ret;
+        for (std::size_t i = 0; i < 8; ++i)
+            for (std::size_t k = 0; k < 4; ++k)
+                ret[4 * i + k] = static_cast<unsigned char>(last.state[i] >> (24 - 8 * k));
+        return ret;
+    }
+
+  private:
+    void compress(const unsigned char* data, std::size_t blocks) noexcept {
+        if (blocks == 0)
+            return;
+#if defined(__x86_64__)
+        if (detail::has_sha())
+            return detail::sha256_hw(state.data(), data, blocks);
+#endif
+        detail::sha256_portable(state.data(), data, blocks);
+    }
+
+    std::array<std::uint32_t, 8> state{0x6A09E667, 0xBB67AE85, 0x3C6EF372, 0xA54FF53A, 0x510E527F, 0x9B05688C, 0x1F83D9AB, 0x5BE0CD19};
+    std::array<unsigned char, 64> block{};
+    std::size_t buffered = 0; ///< bytes of `block` filled
+    std::uint64_t length = 0; ///< bytes fed in all
+};
+
+} // namespace checksum
@@ -0,0 +1,63 @@
+#pragma once
+#include <algorithm>
+#include <memory>
+#include <rapidjson/allocators.h>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include "alloc_counter.hpp"
+
+/**
+ * \internal
+ * Per-thread memory for the JSON documents of a request
+ *
+ * Both the parsed request body and the JsonRes of a request allocate from the same pool, which starts on a preallocated buffer
+ * and is reset once the response is serialized, so that a typical request never reaches `malloc`.
+ * The parse stack and the output buffer are kept across requests, growing to the largest size seen so far.
+ **/
+class JsonArena {
+  public:
+    using Allocator = rapidjson::MemoryPoolAllocator<>;
+    constexpr static std::size_t buffer_size = 64 * 1024; ///< preallocated pool buffer; enough for a few hundred domains
+    constexpr static std::size_t chunk_size = 64 * 1024;  ///< size of the chunks added when the buffer overflows
+
+    /**
+     * \internal
+     * Arena of the calling thread
+     **/
+    [[nodiscard]] static JsonArena& local() {
+        thread_local JsonArena arena{};
+        return arena;
+    }
+
+    JsonArena(const JsonArena&) = delete;
+    JsonArena& operator=(const JsonArena&) = delete;
+
+    [[nodiscard]] Allocator& allocator() noexcept { return pool; }
+    [[nodiscard]] rapidjson::Document& request() noexcept { return req; }
+    [[nodiscard]] rapidjson::StringBuffer& output() noexcept { return out; }
+
+    /**
+     * \internal
+     * Releases everything allocated since the last reset; documents using the pool must be gone or unused by then
+     **/
+    void reset() noexcept {
+        if constexpr (alloc_counter::enabled) {
+            // Overflow chunks come from rapidjson's CrtAllocator, which the operator new hook does not see
+            for (auto cap = pool.Capacity(); cap > buffer_size; cap -= std::min(cap - buffer_size, chunk_size))
+                alloc_counter::note();
+        }
+        req.SetNull();
+        out.Clear();
+        pool.Clear();
+    }
+
+  private:
+    JsonArena() = default;
+
+    std::unique_ptr<char[]> buffer = std::make_unique<char[]>(buffer_size);
+    rapidjson::CrtAllocator base_alloc;
+    Allocator pool{buffer.get(), buffer_size, chunk_size, &base_alloc};
+    rapidjson::CrtAllocator stack_alloc;
+    rapidjson::Document req{&pool, 1024, &stack_alloc};
+    rapidjson::StringBuffer out{&stack_alloc};
+};
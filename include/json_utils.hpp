@@ -24,7 +24,13 @@ struct JsonRes : public rapidjson::Document {
     [[nodiscard]] decltype(auto) json() noexcept { return static_cast<rapidjson::Document&>(*this); };
 
   public:
-    JsonRes() {
+    JsonRes() : JsonRes(nullptr) {}
+
+    /**
+     * \internal
+     * \param[in] allocator pool to allocate from (see JsonArena); the document owns its own pool if null
+     **/
+    explicit JsonRes(AllocatorType* allocator) : rapidjson::Document(allocator) {
         SetObject();
         rapidjson::Value results{}, success{}, errors{}, messages{};
         results.SetArray();
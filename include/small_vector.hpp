@@ -0,0 +1,159 @@
+#pragma once
+
+#include <algorithm>
+#include <cstddef>
+#include <initializer_list>
+#include <iterator>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+/**
+ * \internal
+ * Contiguous sequence container storing up to `N` elements inline, only moving to the heap past that
+ *
+ * Meant for the short-lived per-request sequences (path parts, queries, resolved objects, depends outcomes)
+ * whose common case is small and known, so that it costs no allocation.
+ * Growth moves elements, hence `T` is expected to be nothrow-move-constructible.
+ *
+ * \tparam T element type
+ * \tparam N inline capacity
+ **/
+template <class T, std::size_t N> class SmallVector {
+    static_assert(N > 0, "use std::vector");
+
+  public:
+    using value_type = T;
+    using size_type = std::size_t;
+    using difference_type = std::ptrdiff_t;
+    using reference = T&;
+    using const_reference = const T&;
+    using pointer = T*;
+    using const_pointer = const T*;
+    using iterator = T*;
+    using const_iterator = const T*;
+
+    SmallVector() noexcept = default;
+
+    SmallVector(std::initializer_list<T> il) { assign(il.begin(), il.end()); }
+
+    template <class It, class = typename std::iterator_traits<It>::iterator_category> SmallVector(It first, It last) { assign(first, last); }
+
+    SmallVector(const SmallVector& oth) { assign(oth.begin(), oth.end()); }
+
+    SmallVector(SmallVector&& oth) noexcept(std::is_nothrow_move_constructible_v<T>) { steal(std::move(oth)); }
+
+    SmallVector& operator=(const SmallVector& oth) {
+        if (this != &oth) {
+            clear();
+            assign(oth.begin(), oth.end());
+        }
+        return *this;
+    }
+
+    SmallVector& operator=(SmallVector&& oth) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (this != &oth) {
+            clear();
+            release();
+            steal(std::move(oth));
+        }
+        return *this;
+    }
+
+    ~SmallVector() {
+        clear();
+        release();
+    }
+
+    [[nodiscard]] iterator begin() noexcept { return ptr; }
+    [[nodiscard]] const_iterator begin() const noexcept { return ptr; }
+    [[nodiscard]] iterator end() noexcept { return ptr + len; }
+    [[nodiscard]] const_iterator end() const noexcept { return ptr + len; }
+    [[nodiscard]] const_iterator cbegin() const noexcept { return begin(); }
+    [[nodiscard]] const_iterator cend() const noexcept { return end(); }
+
+    [[nodiscard]] pointer data() noexcept { return ptr; }
+    [[nodiscard]] const_pointer data() const noexcept { return ptr; }
+    [[nodiscard]] size_type size() const noexcept { return len; }
+    [[nodiscard]] size_type capacity() const noexcept { return cap; }
+    [[nodiscard]] bool empty() const noexcept { return len == 0; }
+    [[nodiscard]] bool is_inline() const noexcept { return ptr == inline_ptr(); }
+
+    [[nodiscard]] reference operator[](size_type i) noexcept { return ptr[i]; }
+    [[nodiscard]] const_reference operator[](size_type i) const noexcept { return ptr[i]; }
+    [[nodiscard]] reference front() noexcept { return ptr[0]; }
+    [[nodiscard]] const_reference front() const noexcept { return ptr[0]; }
+    [[nodiscard]] reference back() noexcept { return ptr[len - 1]; }
+    [[nodiscard]] const_reference back() const noexcept { return ptr[len - 1]; }
+
+    void reserve(size_type n) {
+        if (n > cap)
+            reallocate(n);
+    }
+
+    template <class... Args> reference emplace_back(Args&&... args) {
+        if (len == cap)
+            reallocate(cap * 2);
+        ::new (static_cast<void*>(ptr + len)) T(std::forward<Args>(args)...);
+        return ptr[len++];
+    }
+
+    void push_back(const T& v) { emplace_back(v); }
+    void push_back(T&& v) { emplace_back(std::move(v)); }
+
+    void pop_back() noexcept { ptr[--len].~T(); }
+
+    /**
+     * \internal
+     * Destroys the elements; keeps the capacity
+     **/
+    void clear() noexcept {
+        std::destroy(ptr, ptr + len);
+        len = 0;
+    }
+
+  private:
+    template <class It> void assign(It first, It last) {
+        if constexpr (std::is_base_of_v<std::forward_iterator_tag, typename std::iterator_traits<It>::iterator_category>)
+            reserve(static_cast<size_type>(std::distance(first, last)));
+        for (; first != last; ++first)
+            emplace_back(*first);
+    }
+
+    void reallocate(size_type n) {
+        auto* mem = std::allocator<T>{}.allocate(n);
+        std::uninitialized_move(ptr, ptr + len, mem);
+        std::destroy(ptr, ptr + len);
+        release();
+        ptr = mem;
+        cap = n;
+    }
+
+    void release() noexcept {
+        if (!is_inline())
+            std::allocator<T>{}.deallocate(ptr, cap);
+        ptr = inline_ptr();
+        cap = N;
+    }
+
+    void steal(SmallVector&& oth) noexcept(std::is_nothrow_move_constructible_v<T>) {
+        if (oth.is_inline()) {
+            std::uninitialized_move(oth.ptr, oth.ptr + oth.len, ptr);
+            len = oth.len;
+            oth.clear();
+        } else {
+            ptr = std::exchange(oth.ptr, oth.inline_ptr());
+            cap = std::exchange(oth.cap, N);
+            len = std::exchange(oth.len, 0);
+        }
+    }
+
+    [[nodiscard]] T* inline_ptr() noexcept { return reinterpret_cast<T*>(&storage); }
+    [[nodiscard]] const T* inline_ptr() const noexcept { return reinterpret_cast<const T*>(&storage); }
+
+    std::aligned_storage_t<sizeof(T) * N, alignof(T)> storage;
+    T* ptr = inline_ptr();
+    size_type len = 0;
+    size_type cap = N;
+};
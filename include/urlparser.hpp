@@ -7,10 +7,11 @@
 #include <algorithm>
 #include <cstring>
 #include <string_view>
-#include <vector>
+#include <utility>
 #include <ctll.hpp>
 #include <ctre.hpp>
-#include <flatmap.hpp>
+#include "cexpr_algs.hpp"
+#include "small_vector.hpp"
 
 constexpr auto target_pattern = ctll::fixed_string{R"(^($|/[^#?\s]+)?(.*?)?(#[A-Za-z_\-]+)?$)"};
 
@@ -34,12 +35,16 @@ static constexpr auto url_match(std::string_view sv) noexcept { return ctre::mat
 #endif
 
 class TargetParser {
+  public:
+    using PathParts = SmallVector<std::string_view, 8>;                           ///< inline for all the routes of the API
+    using Queries = SmallVector<std::pair<std::string_view, std::string_view>, 8>; ///< in target order; the first of duplicate keys wins
+
   protected:
     std::string_view url{};
     std::string_view path{};
 
-    std::vector<std::string_view> path_parts = {};
-    flatmap<std::string_view, std::string_view> queries = {};
+    PathParts path_parts = {};
+    Queries queries = {};
 
     constexpr std::string_view match() noexcept {
         auto res = target_match(url);
@@ -49,13 +54,14 @@ class TargetParser {
     }
 
     void parse_queries(std::string_view sv_query) noexcept {
+        path_parts.clear();
         queries.clear();
         for (auto [s_match, s_val] : ctre::range<target_path_parts>(path))
             path_parts.emplace_back(s_val);
         if (sv_query.length() > 0)
             sv_query.remove_prefix(1); // strip leading '?'
         for (auto [s_match, s_name, s_value] : ctre::range<target_queries>(sv_query))
-            queries.emplace(s_name, s_value);
+            queries.emplace_back(s_name, s_value);
     }
 
     void parse() noexcept { parse_queries(match()); }
@@ -79,12 +85,13 @@ class TargetParser {
 
     [[nodiscard]] constexpr std::string_view getURL() const noexcept { return url; }
 
-    [[nodiscard]] constexpr const flatmap<std::string_view, std::string_view>& getQueries() const noexcept { return queries; }
-    [[nodiscard]] constexpr const std::vector<std::string_view>& getPathParts() const noexcept { return path_parts; }
+    [[nodiscard]] constexpr const Queries& getQueries() const noexcept { return queries; }
+    [[nodiscard]] constexpr const PathParts& getPathParts() const noexcept { return path_parts; }
 
     [[nodiscard]] constexpr std::string_view operator[](std::string_view key) const noexcept {
-        if (auto it = queries.find(key); it != queries.end())
-            return it->second;
+        for (const auto& [name, value] : queries)
+            if (name == key)
+                return value;
         return {};
     }
 
@@ -3,6 +3,7 @@
 
 #include <cstring>
 #include <exception>
+#include <memory>
 #include <optional>
 #include <vector>
 #include <gsl/gsl>
@@ -11,6 +12,7 @@
 #include "enums/Connection/Decls.hpp"
 #include "enums/Domain/Decls.hpp"
 #include "enums/Domain/SaveRestoreFlag.hpp"
+#include "RpcLimiter.hpp"
 #include "fwd.hpp"
 #include "utility.hpp"
 
@@ -53,6 +55,7 @@ class Connection {
     friend Stream;
 
     virConnectPtr underlying = nullptr;
+    std::shared_ptr<RpcLimiter> rpc_limiter{}; ///< of the endpoint, shared by its connections; absent from connections obtained from an object
 
   private:
     constexpr explicit Connection(virConnectPtr p) : underlying(p) {}
@@ -65,7 +68,7 @@ class Connection {
 
     inline Connection(const Connection& conn) noexcept = default;
 
-    constexpr Connection(Connection&& conn) noexcept;
+    inline Connection(Connection&& conn) noexcept;
 
     inline Connection& operator=(const Connection& conn) noexcept = delete;
 
@@ -75,6 +78,16 @@ class Connection {
 
     inline void ref();
 
+    /**
+     * \internal
+     * Runs `f`, a single call over this connection, once the RpcLimiter of its endpoint grants it a slot
+     *
+     * \throw DeadlineExceeded if the Deadline of the thread passed before `f` could run
+     **/
+    template <class F> decltype(auto) limited(F&& f) const;
+
+    [[nodiscard]] inline RpcLimiter* rpcLimiter() const noexcept { return rpc_limiter.get(); }
+
     template <typename Data> void registerCloseCallback(void (*cb)(Data&), std::unique_ptr<Data> data = nullptr);
 
     inline void registerCloseCallback(void (*cb)());
@@ -85,6 +98,26 @@ class Connection {
 
     inline void setKeepAlive(int interval, unsigned count);
 
+    /**
+     * \internal
+     * Has `cb` called with `data` on the lifecycle events of all the domains, from the thread of the EventLoop
+     *
+     * \return the ID of the callback, or -1 on failure
+     **/
+    template <typename Data> int domainEventRegisterLifecycle(void (*cb)(const Domain&, int event, int detail, Data&), Data& data) const;
+
+    inline bool domainEventDeregisterAny(int callback_id) const noexcept;
+
+    /**
+     * \internal
+     * Has `cb` called with `data` on the lifecycle events of all the networks, from the thread of the EventLoop
+     *
+     * \return the ID of the callback, or -1 on failure
+     **/
+    template <typename Data> int networkEventRegisterLifecycle(void (*cb)(const Network&, int event, int detail, Data&), Data& data) const;
+
+    inline bool networkEventDeregisterAny(int callback_id) const noexcept;
+
     [[nodiscard]] inline gsl::zstring<> findStoragePoolSources(gsl::czstring<> type, gsl::czstring<>) const noexcept;
 #if LIBVIR_VERSION_NUMBER >= 5002000
     [[nodiscard]] inline gsl::zstring<> getStoragePoolCapabilities() const noexcept;
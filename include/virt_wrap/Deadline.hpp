@@ -0,0 +1,57 @@
+#pragma once
+
+#include <chrono>
+#include <stdexcept>
+#include <utility>
+
+namespace virt {
+
+/**
+ * \internal
+ * Thrown in lieu of making a call once the deadline of the calling thread has passed
+ **/
+struct DeadlineExceeded : std::runtime_error {
+    DeadlineExceeded() : std::runtime_error{"deadline exceeded"} {}
+};
+
+/**
+ * \internal
+ * Point in time past which the calling thread must not make any more calls to libvirt
+ *
+ * The deadline is thread-local, and set for the extent of a Deadline::Scope; there is none outside of one.
+ **/
+class Deadline {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    /**
+     * \internal
+     * Sets the deadline of the calling thread until destruction, then restores the previous one
+     **/
+    class Scope {
+        Clock::time_point prev;
+
+      public:
+        explicit Scope(Clock::time_point at) noexcept : prev(std::exchange(slot(), at)) {}
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope() { slot() = prev; }
+    };
+
+    [[nodiscard]] static Clock::time_point current() noexcept { return slot(); }
+    [[nodiscard]] static bool isSet() noexcept { return slot() != Clock::time_point::max(); }
+    [[nodiscard]] static bool expired() noexcept { return Clock::now() >= slot(); }
+
+    static void check() {
+        if (expired())
+            throw DeadlineExceeded{};
+    }
+
+  private:
+    static Clock::time_point& slot() noexcept {
+        thread_local Clock::time_point at = Clock::time_point::max();
+        return at;
+    }
+};
+
+} // namespace virt
@@ -139,6 +139,10 @@ class Domain {
 
     bool abortJob() noexcept;
 
+#if LIBVIR_VERSION_NUMBER >= 5010000
+    bool agentSetResponseTimeout(int timeout) noexcept;
+#endif
+
     bool addIOThread(unsigned int iothread_id, enums::domain::ModificationImpactFlag flags) noexcept;
 
     bool attachDevice(gsl::czstring<> xml) noexcept;
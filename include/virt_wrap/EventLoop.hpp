@@ -0,0 +1,48 @@
+#pragma once
+
+#include <mutex>
+#include <thread>
+#include <libvirt/libvirt.h>
+
+namespace virt {
+
+/**
+ * \internal
+ * Event loop of libvirt, run on a thread of its own
+ *
+ * libvirt only delivers events (e.g. domain lifecycle events) over connections opened once an event loop implementation is registered,
+ * hence the loop is started before any connection is opened. Event callbacks, as well as timeouts, run on the thread of the loop.
+ **/
+class EventLoop {
+  public:
+    /**
+     * \internal
+     * Registers the default implementation of libvirt and runs it; only the first call has any effect
+     *
+     * \return whether the loop runs
+     **/
+    static bool start() {
+        static std::once_flag once;
+        static bool running = false;
+        std::call_once(once, [] {
+            if (virEventRegisterDefaultImpl() != 0)
+                return;
+            std::thread{[] {
+                for (;;)
+                    virEventRunDefaultImpl();
+            }}.detach();
+            running = true;
+        });
+        return running;
+    }
+
+    /**
+     * \internal
+     * Calls `cb` with `opaque` every `ms` milliseconds, on the thread of the loop
+     *
+     * \return the ID of the timeout, or -1 on failure
+     **/
+    static int addTimeout(int ms, virEventTimeoutCallback cb, void* opaque) noexcept { return virEventAddTimeout(ms, cb, opaque, nullptr); }
+};
+
+} // namespace virt
@@ -0,0 +1,242 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include "Deadline.hpp"
+
+namespace virt {
+
+/**
+ * \internal
+ * Client-side bound on the RPCs in flight to a libvirt endpoint
+ *
+ * libvirtd handles at most `max_client_requests` (5 by default) calls of a client at once and queues the others,
+ * so that sending more only makes them wait on the server instead. A limiter is shared by all the connections to the same URI,
+ * and a slot of it is taken for each call, so that the limit bounds the calls of the whole process, each sampled on its own.
+ * The limit adapts to the latency of the calls (AIMD):
+ * it grows by one per window of calls that ran at the baseline latency while the limit was in use,
+ * and is cut by a fraction when a call ran markedly slower than the baseline, i.e. when libvirtd started queueing.
+ **/
+class RpcLimiter {
+  public:
+    using Clock = std::chrono::steady_clock;
+
+    constexpr static double initial_limit = 5.;   ///< libvirtd's default `max_client_requests`
+    constexpr static double min_limit = 1.;
+    constexpr static double max_limit = 64.;
+    constexpr static double backoff = .8;         ///< factor applied to the limit on congestion
+    constexpr static double tolerance = 2.;       ///< latency, relative to the baseline, past which the connection is deemed congested
+    constexpr static double baseline_drift = .01; ///< weight of a sample in the upwards drift of the baseline, to follow a slowing server
+
+    /**
+     * \internal
+     * Figures of all the limiters, for reporting
+     **/
+    struct Totals {
+        std::uint64_t limiters;          ///< endpoints currently limited
+        std::uint64_t limit_sum;         ///< sum of their current limits
+        std::uint64_t in_flight;         ///< calls currently in flight
+        std::uint64_t calls;             ///< calls made
+        std::uint64_t queued_calls;      ///< calls that had to wait for a slot
+        std::uint64_t queue_ns;          ///< time spent waiting for a slot
+        std::uint64_t latency_ns;        ///< time spent in calls
+        std::uint64_t congestion_events; ///< limit cuts
+    };
+
+    /**
+     * \internal
+     * Slot of a call in flight, given back on destruction along with the latency of the call
+     **/
+    class Permit {
+        RpcLimiter* limiter = nullptr;
+        Clock::time_point start{};
+
+      public:
+        Permit() noexcept = default;
+        explicit Permit(RpcLimiter& limiter) noexcept : limiter(&limiter), start(Clock::now()) {}
+        Permit(Permit&& oth) noexcept : limiter(std::exchange(oth.limiter, nullptr)), start(oth.start) {}
+        Permit& operator=(Permit&& oth) noexcept {
+            if (this != &oth) {
+                this->~Permit();
+                limiter = std::exchange(oth.limiter, nullptr);
+                start = oth.start;
+            }
+            return *this;
+        }
+        ~Permit() {
+            if (limiter)
+                limiter->release(Clock::now() - start);
+        }
+    };
+
+    /**
+     * \internal
+     * Makes `limiter` the one of the calls of the calling thread until destruction, then restores the previous one
+     **/
+    class Scope {
+        RpcLimiter* prev;
+
+      public:
+        explicit Scope(RpcLimiter* limiter) noexcept : prev(std::exchange(current(), limiter)) {}
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+        ~Scope() { current() = prev; }
+    };
+
+    RpcLimiter() noexcept {
+        ++counters().limiters;
+        counters().limit_sum += static_cast<std::uint64_t>(initial_limit);
+    }
+    RpcLimiter(const RpcLimiter&) = delete;
+    RpcLimiter& operator=(const RpcLimiter&) = delete;
+    ~RpcLimiter() {
+        --counters().limiters;
+        counters().limit_sum -= static_cast<std::uint64_t>(limit);
+    }
+
+    /**
+     * \internal
+     * Waits for a slot, to be held for the duration of the call
+     *
+     * \throw DeadlineExceeded if the deadline of the thread passed, or passes while waiting
+     **/
+    [[nodiscard]] Permit acquire() {
+        Deadline::check();
+        std::unique_lock lock{mtx};
+        if (in_flight >= static_cast<unsigned>(limit)) {
+            const auto wait_start = Clock::now();
+            const auto has_slot = [&] { return in_flight < static_cast<unsigned>(limit); };
+            bool got_slot = true;
+            if (Deadline::isSet())
+                got_slot = cv.wait_until(lock, Deadline::current(), has_slot);
+            else
+                cv.wait(lock, has_slot);
+            ++counters().queued_calls;
+            counters().queue_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - wait_start).count();
+            if (!got_slot)
+                throw DeadlineExceeded{};
+        }
+        ++in_flight;
+        ++counters().in_flight;
+        return Permit{*this};
+    }
+
+    /**
+     * \internal
+     * Runs `f` in a slot
+     **/
+    template <class F> decltype(auto) run(F&& f) {
+        const auto permit = acquire();
+        return std::forward<F>(f)();
+    }
+
+    /**
+     * \internal
+     * Runs `f`, a single call to libvirt, in a slot of the limiter of the calling thread, if any
+     *
+     * \throw DeadlineExceeded if the deadline of the thread passed before `f` could run
+     **/
+    template <class F> static decltype(auto) call(F&& f) {
+        if (const auto limiter = current())
+            return limiter->run(std::forward<F>(f));
+        Deadline::check();
+        return std::forward<F>(f)();
+    }
+
+    /**
+     * \internal
+     * Limiter of the endpoint at `uri`, shared by all of the connections to it; made on first use, and dropped along with the last of them
+     **/
+    [[nodiscard]] static std::shared_ptr<RpcLimiter> forEndpoint(const std::string& uri) {
+        static std::mutex registry_mtx;
+        static std::unordered_map<std::string, std::weak_ptr<RpcLimiter>> registry;
+
+        const std::lock_guard lock{registry_mtx};
+        auto& slot = registry[uri];
+        auto limiter = slot.lock();
+        if (!limiter)
+            slot = limiter = std::make_shared<RpcLimiter>();
+        return limiter;
+    }
+
+    [[nodiscard]] double currentLimit() const noexcept {
+        std::lock_guard lock{mtx};
+        return limit;
+    }
+
+    /**
+     * \internal
+     * Figures summed over all the limiters of the process
+     **/
+    [[nodiscard]] static Totals totals() noexcept {
+        const auto& c = counters();
+        return {c.limiters.load(), c.limit_sum.load(), c.in_flight.load(), c.calls.load(),
+                c.queued_calls.load(), c.queue_ns.load(), c.latency_ns.load(), c.congestion_events.load()};
+    }
+
+  private:
+    struct Counters {
+        std::atomic<std::uint64_t> limiters{0}, limit_sum{0}, in_flight{0}, calls{0}, queued_calls{0}, queue_ns{0}, latency_ns{0},
+            congestion_events{0};
+    };
+
+    static RpcLimiter*& current() noexcept {
+        thread_local RpcLimiter* limiter = nullptr;
+        return limiter;
+    }
+
+    static Counters& counters() noexcept {
+        static Counters c{};
+        return c;
+    }
+
+    void release(Clock::duration latency) {
+        const auto sample = std::chrono::duration<double>(latency).count();
+        {
+            std::lock_guard lock{mtx};
+            const bool saturated = in_flight >= static_cast<unsigned>(limit);
+            --in_flight;
+
+            const auto old_limit = static_cast<std::uint64_t>(limit);
+            if (baseline == 0. || sample < baseline)
+                baseline = sample;
+            else
+                baseline += (sample - baseline) * baseline_drift;
+
+            const auto now = Clock::now();
+            if (sample > baseline * tolerance) {
+                // Cut at most once per call duration, as the calls in flight at the time of the cut all report the same congestion
+                if (now - last_cut > latency) {
+                    limit = std::max(min_limit, limit * backoff);
+                    last_cut = now;
+                    ++counters().congestion_events;
+                }
+            } else if (saturated)
+                limit = std::min(max_limit, limit + 1. / limit);
+
+            counters().limit_sum += static_cast<std::uint64_t>(limit) - old_limit;
+        }
+        cv.notify_all(); // the limit may have grown by a slot
+
+        --counters().in_flight;
+        ++counters().calls;
+        counters().latency_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(latency).count();
+    }
+
+    mutable std::mutex mtx{};
+    std::condition_variable cv{};
+    double limit = initial_limit;
+    unsigned in_flight = 0;
+    double baseline = 0.; ///< baseline latency of a call, in seconds
+    Clock::time_point last_cut{};
+};
+
+} // namespace virt
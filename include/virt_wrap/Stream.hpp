@@ -48,6 +48,11 @@ class Stream {
     inline int send(const char* buf, size_t buflen) noexcept;
     // template <class T> bool sendAll(SourceFunc<T> handler, T* opaque) noexcept;
     inline bool sendHole(long long) noexcept;
+    inline bool eventAddCallback(int events, virStreamEventCallback cb, void* opaque, virFreeCallback ff) noexcept;
+    inline bool eventUpdateCallback(int events) noexcept;
+    inline bool eventRemoveCallback() noexcept;
+
+    constexpr explicit operator bool() const noexcept { return underlying != nullptr; }
     // template <class T> bool sparseRecvAll(SinkFunc<T> handler, SinkHoleFunc<T> holeHandler, T* opaque) noexcept;
     // template <class T> int sparseSendAll(SourceFunc<T> handler, SourceHoleFunc<T> holeHandler,
     //                           SourceSkipFunc<T> skipHandler, T* opaque) noexcept;
@@ -6,6 +6,8 @@
 
 #include <cstring>
 #include <exception>
+#include <memory>
+#include <utility>
 #include <vector>
 #include <gsl/gsl>
 #include <libvirt/libvirt.h>
@@ -65,20 +67,27 @@ template <typename Callback> ConnectionAuth<Callback>::operator virConnectAuth()
 
 inline Connection::Connection(gsl::czstring<> name, bool rd_only) noexcept {
     underlying = rd_only ? virConnectOpenReadOnly(name) : virConnectOpen(name);
+    if (underlying)
+        rpc_limiter = RpcLimiter::forEndpoint(name ? name : "");
 }
 
 template <typename Callback>
 inline Connection::Connection(gsl::czstring<> name, ConnectionAuth<Callback>& auth, enums::connection::Flags flags) noexcept {
     virConnectAuth c_auth = auth;
     underlying = virConnectOpenAuth(name, &c_auth, to_integral(flags));
+    if (underlying)
+        rpc_limiter = RpcLimiter::forEndpoint(name ? name : "");
 }
 
-constexpr Connection::Connection(Connection&& conn) noexcept : underlying(conn.underlying) { conn.underlying = nullptr; }
+inline Connection::Connection(Connection&& conn) noexcept : underlying(conn.underlying), rpc_limiter(std::move(conn.rpc_limiter)) {
+    conn.underlying = nullptr;
+}
 
 inline Connection& Connection::operator=(Connection&& conn) noexcept {
     this->~Connection();
     underlying = conn.underlying;
     conn.underlying = nullptr;
+    rpc_limiter = std::move(conn.rpc_limiter);
     return *this;
 }
 
@@ -87,6 +96,14 @@ inline Connection::~Connection() {
         virConnectClose(underlying);
 }
 
+template <class F> decltype(auto) Connection::limited(F&& f) const {
+    if (!rpc_limiter) {
+        Deadline::check();
+        return std::forward<F>(f)();
+    }
+    return rpc_limiter->run(std::forward<F>(f));
+}
+
 void Connection::ref() {
     if (virConnectRef(underlying))
         throw std::runtime_error{"virConnectRef"};
@@ -116,6 +133,45 @@ void Connection::setKeepAlive(int interval, unsigned count) {
         throw std::runtime_error{"virConnectSetKeepAlive"};
 }
 
+template <typename Data> int Connection::domainEventRegisterLifecycle(void (*cb)(const Domain&, int, int, Data&), Data& data) const {
+    using Context = std::pair<decltype(cb), Data*>;
+    auto ctx = std::make_unique<Context>(cb, &data);
+    const auto trampoline = [](virConnectPtr, virDomainPtr dom, int event, int detail, void* opaque) -> int {
+        const auto& [f, d] = *static_cast<Context*>(opaque);
+        virDomainRef(dom); // owned by the caller
+        f(Domain{dom}, event, detail, *d);
+        return 0;
+    };
+    const auto id = virConnectDomainEventRegisterAny(underlying, nullptr, VIR_DOMAIN_EVENT_ID_LIFECYCLE, VIR_DOMAIN_EVENT_CALLBACK(+trampoline),
+                                                     ctx.get(), [](void* opaque) { delete static_cast<Context*>(opaque); });
+    if (id >= 0)
+        ctx.release();
+    return id;
+}
+
+inline bool Connection::domainEventDeregisterAny(int callback_id) const noexcept {
+    return virConnectDomainEventDeregisterAny(underlying, callback_id) == 0;
+}
+
+template <typename Data> int Connection::networkEventRegisterLifecycle(void (*cb)(const Network&, int, int, Data&), Data& data) const {
+    using Context = std::pair<decltype(cb), Data*>;
+    auto ctx = std::make_unique<Context>(cb, &data);
+    const auto trampoline = [](virConnectPtr, virNetworkPtr net, int event, int detail, void* opaque) {
+        const auto& [f, d] = *static_cast<Context*>(opaque);
+        virNetworkRef(net); // owned by the caller
+        f(Network{net}, event, detail, *d);
+    };
+    const auto id = virConnectNetworkEventRegisterAny(underlying, nullptr, VIR_NETWORK_EVENT_ID_LIFECYCLE, VIR_NETWORK_EVENT_CALLBACK(+trampoline),
+                                                      ctx.get(), [](void* opaque) { delete static_cast<Context*>(opaque); });
+    if (id >= 0)
+        ctx.release();
+    return id;
+}
+
+inline bool Connection::networkEventDeregisterAny(int callback_id) const noexcept {
+    return virConnectNetworkEventDeregisterAny(underlying, callback_id) == 0;
+}
+
 [[nodiscard]] inline gsl::zstring<> Connection::findStoragePoolSources(gsl::czstring<> type, gsl::czstring<> srcSpec) const noexcept {
     return virConnectFindStoragePoolSources(underlying, type, srcSpec, 0u);
 }
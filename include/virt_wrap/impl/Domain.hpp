@@ -37,6 +37,10 @@ constexpr inline Domain::operator bool() const noexcept { return underlying != n
 
 inline bool Domain::abortJob() noexcept { return virDomainAbortJob(underlying) == 0; }
 
+#if LIBVIR_VERSION_NUMBER >= 5010000
+inline bool Domain::agentSetResponseTimeout(int timeout) noexcept { return virDomainAgentSetResponseTimeout(underlying, timeout, 0) == 0; }
+#endif
+
 inline bool Domain::addIOThread(unsigned int iothread_id, enums::domain::ModificationImpactFlag flags) noexcept {
     return virDomainAddIOThread(underlying, iothread_id, to_integral(flags)) == 0;
 }
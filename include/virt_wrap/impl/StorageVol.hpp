@@ -19,7 +19,7 @@ constexpr inline StorageVol::operator bool() const noexcept { return underlying
 
 inline bool StorageVol::delete_(DeleteFlag flags) noexcept { return virStorageVolDelete(underlying, to_integral(flags)) == 0; }
 inline bool StorageVol::download(Stream& strm, unsigned long long offset, unsigned long long length, DownloadFlag flags) noexcept {
-    return virStorageVolDownload(underlying, strm.underlying, offset, length, to_integral(flags));
+    return virStorageVolDownload(underlying, strm.underlying, offset, length, to_integral(flags)) == 0;
 }
 inline Connection StorageVol::getConnect() const noexcept {
     const auto res = virStorageVolGetConnect(underlying);
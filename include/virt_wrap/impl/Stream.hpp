@@ -41,4 +41,9 @@ inline std::optional<long long> Stream::recvHole() {
 inline int Stream::send(gsl::span<const char> span) noexcept { return send(span.data(), span.size()); }
 inline int Stream::send(const char* buf, size_t buflen) noexcept { return virStreamSend(underlying, buf, buflen); }
 inline bool Stream::sendHole(long long len) noexcept { return virStreamSendHole(underlying, len, 0) >= 0; }
+inline bool Stream::eventAddCallback(int events, virStreamEventCallback cb, void* opaque, virFreeCallback ff) noexcept {
+    return virStreamEventAddCallback(underlying, events, cb, opaque, ff) >= 0;
+}
+inline bool Stream::eventUpdateCallback(int events) noexcept { return virStreamEventUpdateCallback(underlying, events) >= 0; }
+inline bool Stream::eventRemoveCallback() noexcept { return virStreamEventRemoveCallback(underlying) >= 0; }
 }
\ No newline at end of file
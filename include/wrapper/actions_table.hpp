@@ -1,16 +1,16 @@
 #pragma once
 
 #include <array>
-#include <functional>
 #include <string_view>
 #include <gsl/gsl>
+#include "virt_wrap/RpcLimiter.hpp"
 #include "cexpr_algs.hpp"
 #include "depends.hpp"
 #include "json2virt.hpp"
 #include "json_utils.hpp"
 #include "utils.hpp"
 
-#define PM_LIFT(mem_fn) [&](auto... args) { return mem_fn(args...); }
+#define PM_LIFT(mem_fn) [&](auto... args) { return virt::RpcLimiter::call([&] { return mem_fn(args...); }); }
 #define PM_PREREQ(...) [&] { __VA_ARGS__ return DependsOutcome::SUCCESS; }
 
 using namespace std::literals;
@@ -48,13 +48,17 @@ template <class F> auto getCombinedFlags(const rapidjson::Value& json_flag, Json
     return {flagset};
 }
 
+/**
+ * \internal
+ * Invokes actions in order until one does not return `DependsOutcome::SKIPPED`
+ *
+ * \param[in] actions callables of signature DependsOutcome()
+ * \return the outcome of the first action not skipped, or `DependsOutcome::SKIPPED`
+ **/
 constexpr auto action_scope = [](auto&&... actions) {
-    using Arr = std::array<std::function<DependsOutcome()>, sizeof...(actions)>; // pray for SFO ; wait for expansion statements
-    for (auto&& action : Arr{actions...}) {
-        if (const auto ao = action(); ao != DependsOutcome::SKIPPED)
-            return ao;
-    }
-    return DependsOutcome::SKIPPED;
+    auto ao = DependsOutcome::SKIPPED;
+    ((ao = actions()) != DependsOutcome::SKIPPED || ...); // short-circuiting fold; no type erasure
+    return ao;
 };
 
 template <class CRTP, class Hdl> class NamedCallTable {
@@ -0,0 +1,249 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <boost/asio/bind_executor.hpp>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/strand.hpp>
+#include <boost/beast/http/verb.hpp>
+#include "config.hpp"
+#include "urlparser.hpp"
+
+using namespace std::literals;
+
+/**
+ * \internal
+ * Classes of requests, each admitted against its own limits
+ **/
+enum class RequestClass : std::size_t {
+    cheap_read,   ///< reads answered by libvirtd alone
+    agent_read,   ///< reads going through the QEMU guest agent
+    mutation,     ///< anything but a read
+    async_launch, ///< request run in the background (`?async=true`)
+};
+
+constexpr std::array request_class_names = {"cheap_read"sv, "agent_read"sv, "mutation"sv, "async_launch"sv};
+
+/**
+ * \internal
+ * Tells which class a request belongs to
+ **/
+[[nodiscard]] inline RequestClass classify_request(boost::beast::http::verb method, const TargetParser& target) noexcept {
+    constexpr std::array agent_subqueries = {"fs_info"sv, "hostname"sv, "time"sv};
+
+    if (const auto async = target.getBool("async"); async && *async)
+        return RequestClass::async_launch;
+    if (method != boost::beast::http::verb::get)
+        return RequestClass::mutation;
+    const auto& path_parts = target.getPathParts();
+    const auto is_agent_subquery = [&](std::string_view part) {
+        return std::find(agent_subqueries.begin(), agent_subqueries.end(), part) != agent_subqueries.end();
+    };
+    // libvirt/domains/{by-name,by-uuid}/<domain>/<subquery>; the name of the domain may well be that of a subquery
+    if (path_parts.size() > 4 && path_parts[1] == "domains" && is_agent_subquery(path_parts[4]))
+        return RequestClass::agent_read;
+    return RequestClass::cheap_read;
+}
+
+/**
+ * \internal
+ * Bounds the number of requests of each class handled at once, and sheds the excess
+ *
+ * A request past its class's concurrency limit is queued, and resumed on its own executor once a ticket of its class is given back;
+ * it is shed right away when the queue of its class is full, or once it waited for longer than its class allows.
+ * Waiting never blocks a thread, so that the other requests of the thread (e.g. uploads holding the tickets being waited for) go on.
+ * Hence a slow class (e.g. guest agent reads of a hung guest) cannot take all the threads, nor let requests pile up unboundedly.
+ **/
+class AdmissionController {
+  public:
+    class Ticket;
+
+  private:
+    // Request waiting for its turn
+    struct Waiter : std::enable_shared_from_this<Waiter> {
+        virtual ~Waiter() = default;
+        virtual void grant(Ticket ticket) = 0;
+    };
+
+    struct Class {
+        IniConfig::AdmissionLimits limits;
+        mutable std::mutex mtx{};
+        long running = 0;
+        std::deque<std::shared_ptr<Waiter>> waiters{};
+        std::atomic<std::uint64_t> admitted{0};
+        std::atomic<std::uint64_t> shed_queue_full{0};
+        std::atomic<std::uint64_t> shed_timeout{0};
+    };
+
+  public:
+    /**
+     * \internal
+     * Outcome of an admission request
+     **/
+    enum class Verdict {
+        admitted,   ///< go ahead
+        queue_full, ///< too many requests of the class already waiting
+        timed_out,  ///< no turn came up within the class's wait limit
+    };
+
+    /**
+     * \internal
+     * Turn of an admitted request, given back on destruction, to the first request waiting if any; converts to `false` when the request
+     * was shed
+     **/
+    class Ticket {
+        Class* cls = nullptr;
+
+      public:
+        Ticket() noexcept = default;
+        explicit Ticket(Class& cls) noexcept : cls(&cls) {}
+        Ticket(Ticket&& oth) noexcept : cls(std::exchange(oth.cls, nullptr)) {}
+        Ticket& operator=(Ticket&& oth) noexcept {
+            if (this != &oth) {
+                this->~Ticket();
+                cls = std::exchange(oth.cls, nullptr);
+            }
+            return *this;
+        }
+        ~Ticket() {
+            if (!cls)
+                return;
+            std::shared_ptr<Waiter> next;
+            {
+                const std::lock_guard lock{cls->mtx};
+                if (cls->waiters.empty())
+                    --cls->running;
+                else {
+                    // The turn passes on as is, the count of requests running staying the same
+                    next = std::move(cls->waiters.front());
+                    cls->waiters.pop_front();
+                    ++cls->admitted;
+                }
+            }
+            if (next)
+                next->grant(Ticket{*std::exchange(cls, nullptr)});
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept { return cls != nullptr; }
+    };
+
+    explicit AdmissionController(const IniConfig& config)
+        : classes{{{config.admission_cheap_read}, {config.admission_agent_read}, {config.admission_mutation}, {config.admission_async_launch}}},
+          retry_after(std::max(config.admission_retry_after, 0L)) {}
+
+    AdmissionController(const AdmissionController&) = delete;
+    AdmissionController& operator=(const AdmissionController&) = delete;
+
+    /**
+     * \internal
+     * Gets a turn for a request of class `rc`, then calls `handler` with the verdict and the ticket to hold for as long as the request
+     * is being handled
+     *
+     * `handler` is called right away when the request is admitted or shed without waiting; otherwise, it is posted to `ex` once a turn
+     * came up or the wait limit passed.
+     * \param[in] rc the class of the request
+     * \param[in] ex the executor to resume the request on
+     * \param[in] handler callable of signature void(Verdict, Ticket)
+     **/
+    template <class Executor, class Handler> void admit(RequestClass rc, const Executor& ex, Handler&& handler) {
+        auto& cls = classes[static_cast<std::size_t>(rc)];
+        std::unique_lock lock{cls.mtx};
+        if (cls.running < cls.limits.concurrency) {
+            ++cls.running;
+            ++cls.admitted;
+            lock.unlock();
+            return handler(Verdict::admitted, Ticket{cls});
+        }
+        if (static_cast<long>(cls.waiters.size()) >= cls.limits.queue || cls.limits.wait_ms <= 0) {
+            ++cls.shed_queue_full;
+            lock.unlock();
+            return handler(Verdict::queue_full, Ticket{});
+        }
+
+        // Whichever of the turn and the timer comes first takes the waiter out of the queue, and resumes the request
+        auto waiter = std::make_shared<BasicWaiter<Executor, std::decay_t<Handler>>>(ex, std::forward<Handler>(handler));
+        cls.waiters.push_back(waiter);
+        waiter->timer.expires_after(std::chrono::milliseconds{cls.limits.wait_ms});
+        waiter->timer.async_wait(boost::asio::bind_executor(waiter->strand, [waiter, &cls](boost::system::error_code ec) {
+            if (ec)
+                return;
+            {
+                const std::lock_guard lock{cls.mtx};
+                const auto it = std::find(cls.waiters.begin(), cls.waiters.end(), waiter);
+                if (it == cls.waiters.end())
+                    return; // granted meanwhile
+                cls.waiters.erase(it);
+                ++cls.shed_timeout;
+            }
+            waiter->handler(Verdict::timed_out, Ticket{});
+        }));
+    }
+
+    /**
+     * \internal
+     * Seconds a shed client is told to wait before retrying
+     **/
+    [[nodiscard]] long retry_after_seconds() const noexcept { return retry_after; }
+
+    /**
+     * \internal
+     * Appends the limits and the state of each class to `out`, in the Prometheus text exposition format
+     **/
+    void write_metrics(std::string& out) const {
+        const auto family = [&](std::string_view name, std::string_view type, std::string_view help, auto value) {
+            out.append("# HELP virthttp_admission_").append(name).append(" ").append(help).append("\n");
+            out.append("# TYPE virthttp_admission_").append(name).append(" ").append(type).append("\n");
+            for (std::size_t i = 0; i < classes.size(); ++i) {
+                out.append("virthttp_admission_").append(name).append("{class=\"").append(request_class_names[i]).append("\"} ");
+                out.append(std::to_string(value(classes[i]))).append("\n");
+            }
+        };
+
+        family("concurrency_limit", "gauge", "Requests of the class handled at once", [](const Class& c) { return c.limits.concurrency; });
+        family("queue_limit", "gauge", "Requests of the class allowed to wait for their turn", [](const Class& c) { return c.limits.queue; });
+        family("wait_limit_seconds", "gauge", "Longest wait for a turn", [](const Class& c) { return c.limits.wait_ms / 1000.; });
+        family("in_flight", "gauge", "Requests of the class being handled", [](const Class& c) {
+            const std::lock_guard lock{c.mtx};
+            return c.running;
+        });
+        family("queued", "gauge", "Requests of the class waiting for their turn", [](const Class& c) {
+            const std::lock_guard lock{c.mtx};
+            return c.waiters.size();
+        });
+        family("admitted_total", "counter", "Requests of the class admitted", [](const Class& c) { return c.admitted.load(); });
+        family("shed_queue_full_total", "counter", "Requests of the class shed for want of room in the queue",
+               [](const Class& c) { return c.shed_queue_full.load(); });
+        family("shed_timeout_total", "counter", "Requests of the class shed after waiting too long",
+               [](const Class& c) { return c.shed_timeout.load(); });
+    }
+
+  private:
+    template <class Executor, class Handler> struct BasicWaiter final : Waiter {
+        boost::asio::strand<Executor> strand;
+        boost::asio::steady_timer timer;
+        Handler handler;
+
+        BasicWaiter(const Executor& ex, Handler&& handler) : strand(ex), timer(strand), handler(std::move(handler)) {}
+
+        // Called with the lock of the class released, from the thread which gave the ticket back
+        void grant(Ticket ticket) override {
+            auto self = std::static_pointer_cast<BasicWaiter>(shared_from_this());
+            boost::asio::post(strand, [self = std::move(self), ticket = std::move(ticket)]() mutable {
+                self->timer.cancel();
+                self->handler(Verdict::admitted, std::move(ticket));
+            });
+        }
+    };
+
+    std::array<Class, 4> classes;
+    long retry_after;
+};
@@ -4,7 +4,12 @@
 
 #pragma once
 
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <optional>
 #include <string_view>
+#include <vector>
 #include <INIReader.h>
 #include "logger.hpp"
 
@@ -16,11 +21,43 @@ class IniConfig {
   private:
     std::string default_http_auth_key = "123456789abcdefgh";
 
+    // Reads `str` as a whole as an unsigned integer in `base`, surrounding spaces aside; null if it is not one, or out of range
+    template <class T> [[nodiscard]] static std::optional<T> parse_unsigned(std::string_view str, int base) noexcept {
+        const auto first = str.find_first_not_of(' ');
+        if (first == std::string_view::npos)
+            return std::nullopt;
+        str = str.substr(first, str.find_last_not_of(' ') - first + 1);
+        T ret{};
+        const auto [end, ec] = std::from_chars(str.data(), str.data() + str.size(), ret, base);
+        if (ec != std::errc{} || end != str.data() + str.size())
+            return std::nullopt;
+        return ret;
+    }
+
   public:
+    /**
+     * \internal
+     * Admission limits of a class of requests
+     **/
+    struct AdmissionLimits {
+        long concurrency; ///< requests of the class handled at once
+        long queue;       ///< requests of the class allowed to wait for their turn
+        long wait_ms;     ///< longest wait for a turn before the request is shed
+    };
+
     std::string connDRIV, connTRANS, connUNAME, connHOST, connPORT, connPATH, connEXTP, connURI, http_address, http_doc_root, http_auth_key, httpURI,
-        config_file;
-    long http_port{}, http_threads{};
-    bool http_auth_key_required{};
+        http_unix_socket, config_file;
+    long http_port{}, http_threads{}, http2_max_streams{100}, http_pipeline_depth{8}, http_body_limit{1024 * 1024}, http_header_limit{8 * 1024},
+        http_idle_buffer_limit{4096}, http_header_timeout{10}, http_body_timeout{30}, http_idle_timeout{60}, http_write_timeout{30},
+        http_max_sessions{10000};
+    unsigned long http_unix_socket_mode{0660};
+    std::vector<unsigned long> http_unix_trusted_uids;
+    bool http_auth_key_required{}, http2{}, http_thread_per_core{}, http_pin_threads{};
+    AdmissionLimits admission_cheap_read{64, 256, 1000}, admission_agent_read{4, 16, 2000}, admission_mutation{8, 32, 5000},
+        admission_async_launch{16, 0, 0};
+    long admission_retry_after{1};
+    long deadline_cheap_read_ms{0}, deadline_agent_read_ms{10000}, deadline_mutation_ms{0}, deadline_max_ms{300000}, quarantine_threads{4};
+    long events_history{1024}, events_subscriber_queue{256}, events_heartbeat{15};
 
     IniConfig() = default;
     IniConfig(std::string_view config_file_loc) { init(config_file_loc); }
@@ -45,10 +82,65 @@ class IniConfig {
         http_port = reader.GetInteger("http_server", "port", 8081);
         http_doc_root = reader.Get("http_server", "doc_root", ".");
         http_threads = reader.GetInteger("http_server", "threads", 1);
+        http_thread_per_core = reader.GetBoolean("http_server", "thread-per-core", false);
+        http_pin_threads = reader.GetBoolean("http_server", "pin-threads", false);
         http_auth_key_required = reader.GetBoolean("http_server", "auth-key-required", true);
         http_auth_key = reader.Get("http_server", "auth-key", default_http_auth_key);
         if (http_auth_key_required && (http_auth_key == default_http_auth_key))
             logger.warning("Using default HTTP Auth Key: ", default_http_auth_key);
+        http_unix_socket = reader.Get("http_server", "unix-socket", "");
+        const auto unix_socket_mode = reader.Get("http_server", "unix-socket-mode", "0660");
+        if (const auto mode = parse_unsigned<unsigned long>(unix_socket_mode, 8); mode && *mode <= 07777)
+            http_unix_socket_mode = *mode;
+        else {
+            logger.error("Ignoring invalid unix-socket-mode ", unix_socket_mode, "; using 0660");
+            http_unix_socket_mode = 0660;
+        }
+        http_unix_trusted_uids.clear();
+        const auto trusted_uids = reader.Get("http_server", "unix-trusted-uids", "");
+        for (std::string_view uids = trusted_uids; !uids.empty();) {
+            const auto end = uids.find(',');
+            if (const auto uid = uids.substr(0, end); uid.find_first_not_of(' ') != std::string_view::npos) {
+                // (uid_t)-1 stands for no user at all
+                if (const auto parsed = parse_unsigned<std::uint32_t>(uid, 10); parsed && *parsed != UINT32_MAX)
+                    http_unix_trusted_uids.push_back(*parsed);
+                else
+                    logger.error("Ignoring invalid UID ", uid, " in unix-trusted-uids");
+            }
+            uids = end == std::string_view::npos ? std::string_view{} : uids.substr(end + 1);
+        }
+        http_pipeline_depth = reader.GetInteger("http_server", "pipeline-depth", 8);
+        http_body_limit = std::max(0L, reader.GetInteger("http_server", "body-limit", 1024 * 1024));
+        http_header_limit = std::clamp(reader.GetInteger("http_server", "header-limit", 8 * 1024), 0L, 0xFFFFFFFFL);
+        http_idle_buffer_limit = std::max(0L, reader.GetInteger("http_server", "idle-buffer-limit", 4096));
+        http_header_timeout = reader.GetInteger("http_server", "header-timeout", 10);
+        http_body_timeout = reader.GetInteger("http_server", "body-timeout", 30);
+        http_idle_timeout = reader.GetInteger("http_server", "idle-timeout", 60);
+        http_write_timeout = reader.GetInteger("http_server", "write-timeout", 30);
+        http_max_sessions = reader.GetInteger("http_server", "max-sessions", 10000);
+        http2 = reader.GetBoolean("http_server", "http2", true);
+        http2_max_streams = reader.GetInteger("http_server", "http2-max-streams", 100);
+
+        const auto admission_limits = [&](const std::string& cls, AdmissionLimits def) {
+            return AdmissionLimits{reader.GetInteger("admission", cls + "-concurrency", def.concurrency),
+                                   reader.GetInteger("admission", cls + "-queue", def.queue),
+                                   reader.GetInteger("admission", cls + "-wait-ms", def.wait_ms)};
+        };
+        admission_cheap_read = admission_limits("cheap-read", {64, 256, 1000});
+        admission_agent_read = admission_limits("agent-read", {4, 16, 2000});
+        admission_mutation = admission_limits("mutation", {8, 32, 5000});
+        admission_async_launch = admission_limits("async-launch", {16, 0, 0});
+        admission_retry_after = reader.GetInteger("admission", "retry-after", 1);
+
+        deadline_cheap_read_ms = reader.GetInteger("deadlines", "cheap-read-ms", 0);
+        deadline_agent_read_ms = reader.GetInteger("deadlines", "agent-read-ms", 10000);
+        deadline_mutation_ms = reader.GetInteger("deadlines", "mutation-ms", 0);
+        deadline_max_ms = reader.GetInteger("deadlines", "max-ms", 300000);
+        quarantine_threads = reader.GetInteger("deadlines", "quarantine-threads", 4);
+
+        events_history = std::max(1L, reader.GetInteger("events", "history", 1024));
+        events_subscriber_queue = std::max(1L, reader.GetInteger("events", "subscriber-queue", 256));
+        events_heartbeat = std::max(1L, reader.GetInteger("events", "heartbeat", 15));
 
         connDRIV = reader.Get("libvirtd", "driver", "qemu");
         connTRANS = reader.Get("libvirtd", "transport", "");
@@ -0,0 +1,81 @@
+#pragma once
+#include <string>
+#include <utility>
+#include <vector>
+#include "virt_wrap.hpp"
+
+/**
+ * \internal
+ * Per-thread pool of libvirt connections
+ *
+ * Every thread only ever touches its own shard, so that leasing a connection takes no lock;
+ * in thread-per-core mode, a shard thus belongs to a single core, along with the sessions it serves.
+ * Connections found dead (e.g. after libvirtd restarted) are dropped instead of being handed out again.
+ **/
+class ConnectionPool {
+  public:
+    constexpr static std::size_t max_idle = 4; ///< connections kept open per thread once released
+
+    /**
+     * \internal
+     * Connection borrowed from the pool, given back on destruction
+     **/
+    class Lease {
+        ConnectionPool& pool;
+        virt::Connection conn;
+
+      public:
+        Lease(ConnectionPool& pool, virt::Connection&& conn) noexcept : pool(pool), conn(std::move(conn)) {}
+        Lease(const Lease&) = delete;
+        Lease& operator=(const Lease&) = delete;
+        ~Lease() { pool.release(std::move(conn)); }
+
+        [[nodiscard]] virt::Connection& operator*() noexcept { return conn; }
+        [[nodiscard]] virt::Connection* operator->() noexcept { return &conn; }
+        [[nodiscard]] explicit operator bool() const noexcept { return static_cast<bool>(conn); }
+    };
+
+    /**
+     * \internal
+     * Shard of the calling thread
+     **/
+    [[nodiscard]] static ConnectionPool& local() {
+        thread_local ConnectionPool pool{};
+        return pool;
+    }
+
+    ConnectionPool(const ConnectionPool&) = delete;
+    ConnectionPool& operator=(const ConnectionPool&) = delete;
+
+    /**
+     * \internal
+     * Leases an idle connection to `uri`, or opens a new one
+     *
+     * \param[in] uri the libvirt URI to connect to
+     * \return the lease, which converts to `false` if the connection could not be opened
+     **/
+    [[nodiscard]] Lease acquire(const std::string& uri) {
+        if (uri != idle_uri) {
+            idle.clear();
+            idle_uri = uri;
+        }
+        while (!idle.empty()) {
+            virt::Connection conn{std::move(idle.back())};
+            idle.pop_back();
+            if (conn.isAlive())
+                return {*this, std::move(conn)};
+        }
+        return {*this, virt::Connection{uri.c_str()}};
+    }
+
+  private:
+    ConnectionPool() { idle.reserve(max_idle); }
+
+    void release(virt::Connection&& conn) noexcept {
+        if (conn && idle.size() < max_idle && conn.isAlive())
+            idle.push_back(std::move(conn));
+    }
+
+    std::string idle_uri;
+    std::vector<virt::Connection> idle;
+};
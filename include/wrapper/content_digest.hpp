@@ -0,0 +1,162 @@
+#pragma once
+#include <algorithm>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include "checksum.hpp"
+
+/**
+ * \internal
+ * Digests of the content of a message, computed as it goes through, in the terms of the `Content-Digest` and `Want-Content-Digest`
+ * headers (RFC 9530)
+ *
+ * Only the algorithms asked for are computed: `crc32c`, cheap enough to check every transfer, and `sha-256`, for integrity against
+ * more than transmission errors. Digests the other side sent along may be set as expected, to be checked once all was fed.
+ **/
+class ContentDigest {
+  public:
+    ContentDigest() noexcept = default;
+
+    /**
+     * \internal
+     * Digests asked for by a `Want-Content-Digest` header, and expected by a `Content-Digest` one, either possibly empty;
+     * algorithms not supported are left out
+     **/
+    ContentDigest(std::string_view wanted, std::string_view expected) {
+        for_each_member(wanted, [&](std::string_view key, std::string_view value) {
+            // A preference of 0 means "not acceptable"
+            if (const auto alg = algorithm(key); alg != none && value.find_first_not_of("0 ") != std::string_view::npos)
+                algorithms |= alg;
+        });
+        for_each_member(expected, [&](std::string_view key, std::string_view value) {
+            const auto alg = algorithm(key);
+            if (alg == none || value.size() < 2 || value.front() != ':' || value.back() != ':')
+                return;
+            algorithms |= alg;
+            checked |= alg;
+            if (auto bytes = decode_base64(value.substr(1, value.size() - 2)); bytes)
+                (alg == crc32c ? expected_crc32c : expected_sha256) = std::move(*bytes);
+        });
+    }
+
+    /**
+     * \internal
+     * Whether any digest is computed at all
+     **/
+    [[nodiscard]] explicit operator bool() const noexcept { return algorithms != none; }
+
+    void update(const char* data, std::size_t size) noexcept {
+        if (algorithms & crc32c)
+            crc = checksum::crc32c(crc, data, size);
+        if (algorithms & sha256)
+            sha.update(data, size);
+    }
+
+    /**
+     * \internal
+     * Whether every digest expected matches that of the content fed so far
+     **/
+    [[nodiscard]] bool matches() const {
+        if ((checked & crc32c) && expected_crc32c != crc_bytes())
+            return false;
+        if (checked & sha256) {
+            const auto digest = sha.digest();
+            return expected_sha256 == std::string(digest.begin(), digest.end());
+        }
+        return true;
+    }
+
+    /**
+     * \internal
+     * Value of a `Content-Digest` header for the content fed so far
+     **/
+    [[nodiscard]] std::string value() const {
+        std::string ret;
+        if (algorithms & crc32c)
+            ret += "crc32c=:" + encode_base64(crc_bytes()) + ':';
+        if (algorithms & sha256) {
+            const auto digest = sha.digest();
+            if (!ret.empty())
+                ret += ", ";
+            ret += "sha-256=:" + encode_base64({reinterpret_cast<const char*>(digest.data()), digest.size()}) + ':';
+        }
+        return ret;
+    }
+
+  private:
+    enum Algorithm : unsigned { none = 0, crc32c = 1, sha256 = 2 };
+
+    [[nodiscard]] static Algorithm algorithm(std::string_view key) noexcept {
+        if (key == "crc32c")
+            return crc32c;
+        if (key == "sha-256")
+            return sha256;
+        return none;
+    }
+
+    // Calls `f` with the key and value of every member of a dictionary of structured fields
+    template <class F> static void for_each_member(std::string_view dict, F f) {
+        const auto trim = [](std::string_view str) {
+            const auto first = str.find_first_not_of(" \t");
+            return first == std::string_view::npos ? std::string_view{} : str.substr(first, str.find_last_not_of(" \t") - first + 1);
+        };
+        while (!dict.empty()) {
+            const auto comma = dict.find(',');
+            const auto member = trim(dict.substr(0, comma));
+            dict = comma == std::string_view::npos ? std::string_view{} : dict.substr(comma + 1);
+            // Parameters are of no use here
+            const auto item = member.substr(0, member.find(';'));
+            const auto eq = item.find('=');
+            f(trim(item.substr(0, eq)), eq == std::string_view::npos ? std::string_view{"1"} : trim(item.substr(eq + 1)));
+        }
+    }
+
+    // Big-endian, as the digest of RFC 9530 has it
+    [[nodiscard]] std::string crc_bytes() const {
+        return {static_cast<char>(crc >> 24), static_cast<char>(crc >> 16), static_cast<char>(crc >> 8), static_cast<char>(crc)};
+    }
+
+    constexpr static std::string_view alphabet = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+    [[nodiscard]] static std::string encode_base64(std::string_view bytes) {
+        std::string ret;
+        ret.reserve((bytes.size() + 2) / 3 * 4);
+        for (std::size_t i = 0; i < bytes.size(); i += 3) {
+            const auto n = std::min<std::size_t>(3, bytes.size() - i);
+            std::uint32_t group = 0;
+            for (std::size_t k = 0; k < 3; ++k)
+                group = group << 8 | (k < n ? static_cast<unsigned char>(bytes[i + k]) : 0u);
+            for (std::size_t k = 0; k < 4; ++k)
+                ret += k <= n ? alphabet[(group >> (18 - 6 * k)) & 0x3F] : '=';
+        }
+        return ret;
+    }
+
+    [[nodiscard]] static std::optional<std::string> decode_base64(std::string_view text) {
+        while (!text.empty() && text.back() == '=')
+            text.remove_suffix(1);
+        std::string ret;
+        std::uint32_t group = 0;
+        int bits = 0;
+        for (const auto c : text) {
+            const auto sextet = alphabet.find(c);
+            if (sextet == std::string_view::npos)
+                return std::nullopt;
+            group = group << 6 | static_cast<std::uint32_t>(sextet);
+            if ((bits += 6) >= 8) {
+                bits -= 8;
+                ret += static_cast<char>((group >> bits) & 0xFF);
+            }
+        }
+        return ret;
+    }
+
+    unsigned algorithms = none;
+    unsigned checked = none; ///< algorithms of the digests expected
+    std::uint32_t crc = 0;
+    checksum::Sha256 sha{};
+    std::string expected_crc32c{};
+    std::string expected_sha256{};
+};
@@ -7,6 +7,8 @@
 #include <flatmap.hpp>
 #include "libdeflate.hpp"
 
+using namespace std::literals;
+
 /**
  * \internal
  * Available compression algorithms
@@ -2,6 +2,7 @@
 #include <memory>
 #include <string>
 #include <libdeflate.h>
+#include "virt_wrap/utility.hpp"
 
 namespace libdeflate {
 
@@ -9,24 +10,47 @@ constexpr auto compression_level = 11;
 
 enum class Mode { raw_deflate, zlib, gzip };
 
-bool compress(std::string& body, Mode mode) noexcept {
-    std::unique_ptr<struct libdeflate_compressor, void (*)(struct libdeflate_compressor*)> c = {libdeflate_alloc_compressor(compression_level),
-                                                                                                &libdeflate_free_compressor};
+/**
+ * \internal
+ * Compressor of the calling thread, allocated on first use
+ *
+ * Compressors hold several hundred kilobytes of match-finder state, so each thread (or core, in thread-per-core mode) keeps its own
+ * rather than setting one up for every response.
+ **/
+inline struct libdeflate_compressor* local_compressor() noexcept {
+    thread_local std::unique_ptr<struct libdeflate_compressor, void (*)(struct libdeflate_compressor*)> c = {
+        libdeflate_alloc_compressor(compression_level), &libdeflate_free_compressor};
+    return c.get();
+}
+
+inline bool compress(std::string& body, Mode mode) noexcept {
+    auto* const c = local_compressor();
     if (!c)
         return false;
 
+    const auto bound = [&]() {
+        switch (mode) {
+        case Mode::raw_deflate:
+            return libdeflate_deflate_compress_bound(c, body.size());
+        case Mode::zlib:
+            return libdeflate_zlib_compress_bound(c, body.size());
+        case Mode::gzip:
+            return libdeflate_gzip_compress_bound(c, body.size());
+        }
+        UNREACHABLE;
+    }();
+
     std::string out;
-    out.resize(body.size());
+    out.resize(bound);
 
     const auto actual_compressed_size = [&]() {
         switch (mode) {
         case Mode::raw_deflate:
-            return libdeflate_deflate_compress(c.get(), body.data(), body.size(), out.data(),
-                                               libdeflate_deflate_compress_bound(c.get(), body.size()));
+            return libdeflate_deflate_compress(c, body.data(), body.size(), out.data(), out.size());
         case Mode::zlib:
-            return libdeflate_zlib_compress(c.get(), body.data(), body.size(), out.data(), libdeflate_zlib_compress_bound(c.get(), body.size()));
+            return libdeflate_zlib_compress(c, body.data(), body.size(), out.data(), out.size());
         case Mode::gzip:
-            return libdeflate_gzip_compress(c.get(), body.data(), body.size(), out.data(), libdeflate_gzip_compress_bound(c.get(), body.size()));
+            return libdeflate_gzip_compress(c, body.data(), body.size(), out.data(), out.size());
         }
         UNREACHABLE;
     }();
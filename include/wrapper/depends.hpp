@@ -1,7 +1,7 @@
 #pragma once
-#include <vector>
 #include <rapidjson/document.h>
 #include "json_utils.hpp"
+#include "small_vector.hpp"
 #include "utils.hpp"
 
 /**
@@ -10,6 +10,12 @@
  **/
 enum class DependsOutcome { SUCCESS, FAILURE, SKIPPED };
 
+/**
+ * \internal
+ * Outcomes of the actions of a request, in order; inline for typical action lists
+ **/
+using DependsOutcomes = SmallVector<DependsOutcome, 16>;
+
 /**
  * \internal
  * Checks the dependency status of an action
@@ -19,7 +25,7 @@ enum class DependsOutcome { SUCCESS, FAILURE, SKIPPED };
  * \param[in] json_res the response body, as JSON
  * \return `true` if the dependency chain is holding, `false` if broken
  **/
-bool check_depends(const rapidjson::Value& depends_json, std::vector<DependsOutcome>& outcomes, JsonRes& json_res) noexcept;
+bool check_depends(const rapidjson::Value& depends_json, DependsOutcomes& outcomes, JsonRes& json_res) noexcept;
 
 /**
  * \internal
@@ -36,7 +42,7 @@ template <typename Hdl> void handle_depends(const rapidjson::Value& json_req, Js
     if (!json_req.IsArray())
         return error(298);
 
-    std::vector<DependsOutcome> outcomes{};
+    DependsOutcomes outcomes{};
     outcomes.reserve(json_req.Size());
 
     for (const auto& action : json_req.GetArray()) {
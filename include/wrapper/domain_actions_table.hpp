@@ -45,7 +45,9 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
                 return error(300);
             }
 
-            const auto dom_state = virt::enums::domain::State{EHTag{}, dom.getInfo().state}; // Verified use of EHTag
+            const auto dom_info = virt::RpcLimiter::call([&] { return dom.getInfo(); });
+            const auto dom_state = virt::enums::domain::State{EHTag{}, dom_info.state}; // Verified use of EHTag
+            const auto is_active = [&] { return virt::RpcLimiter::call([&] { return dom.isActive(); }); };
 
             const auto pm_hdl = [&](gsl::czstring<> req_tag, auto flag_ti, auto mem_fcn, int errc, gsl::czstring<> pm_msg, auto prereqs) {
                 using Flag = typename decltype(flag_ti)::type;
@@ -86,12 +88,12 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
                 pm_hdl("shutdown", ti<virt::enums::domain::ShutdownFlag>, PM_LIFT(dom.shutdown), 200, "Domain is being shutdown",
                        PM_PREREQ(if (dom_state != virt::enums::domain::State::RUNNING) return error(201);)),
                 pm_hdl("destroy", ti<virt::enums::domain::DestroyFlag>, PM_LIFT(dom.destroy), 209, "Domain destroyed",
-                       PM_PREREQ(if (!dom.isActive()) return error(210);)),
+                       PM_PREREQ(if (!is_active()) return error(210);)),
                 pm_hdl("start", ti<virt::enums::domain::CreateFlag>, PM_LIFT(dom.create), 202, "Domain started",
-                       PM_PREREQ(if (dom.isActive()) return error(203);)),
+                       PM_PREREQ(if (is_active()) return error(203);)),
                 pm_hdl("reboot", ti<virt::enums::domain::ShutdownFlag>, PM_LIFT(dom.reboot), 213, "Domain is being rebooted",
                        PM_PREREQ(if (dom_state != virt::enums::domain::State::RUNNING) return error(201);)),
-                pm_hdl("reset", no_flags, PM_LIFT(dom.reset), 214, "Domain was reset", PM_PREREQ(if (!dom.isActive()) return error(210);)),
+                pm_hdl("reset", no_flags, PM_LIFT(dom.reset), 214, "Domain was reset", PM_PREREQ(if (!is_active()) return error(210);)),
                 pm_hdl("suspend", no_flags, PM_LIFT(dom.suspend), 215, "Domain suspended",
                        PM_PREREQ(if (dom_state != virt::enums::domain::State::RUNNING) return error(201);)),
                 pm_hdl("resume", no_flags, PM_LIFT(dom.resume), 212, "Domain resumed",
@@ -102,7 +104,7 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
             auto error = [&](auto... args) { return json_res.error(args...), DependsOutcome::FAILURE; };
             if (!val.IsString())
                 return error(0);
-            if (!dom.rename(val.GetString()))
+            if (!virt::RpcLimiter::call([&] { return dom.rename(val.GetString()); }))
                 return error(205);
             return DependsOutcome::SUCCESS;
         },
@@ -110,7 +112,7 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
             auto error = [&](auto... args) { return json_res.error(args...), DependsOutcome::FAILURE; };
             if (!val.IsInt())
                 return error(0);
-            if (!dom.setMemory(val.GetInt()))
+            if (!virt::RpcLimiter::call([&] { return dom.setMemory(val.GetInt()); }))
                 return error(206);
             return DependsOutcome::SUCCESS;
         },
@@ -118,7 +120,7 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
             auto error = [&](auto... args) { return json_res.error(args...), DependsOutcome::FAILURE; };
             if (!val.IsInt())
                 return error(0);
-            if (!dom.setMaxMemory(val.GetInt()))
+            if (!virt::RpcLimiter::call([&] { return dom.setMaxMemory(val.GetInt()); }))
                 return error(207);
             return DependsOutcome::SUCCESS;
         },
@@ -126,14 +128,14 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
             auto error = [&](auto... args) { return json_res.error(args...), DependsOutcome::FAILURE; };
             if (!val.IsBool())
                 return error(0);
-            if (!dom.setAutoStart(val.GetBool()))
+            if (!virt::RpcLimiter::call([&] { return dom.setAutoStart(val.GetBool()); }))
                 return error(208);
             return DependsOutcome::SUCCESS;
         },
         +[](const rapidjson::Value& val, JsonRes& json_res, virt::Domain& dom) -> DependsOutcome {
             const auto res = wrap_fcn(
-                val, json_res, [&](auto... args) { return dom.sendProcessSignal(args...); }, WArg<JTag::Int64>{"pid"},
-                WArg<JTag::Enum, JTag::None, virt::enums::domain::ProcessSignal>{"signal"});
+                val, json_res, [&](auto... args) { return virt::RpcLimiter::call([&] { return dom.sendProcessSignal(args...); }); },
+                WArg<JTag::Int64>{"pid"}, WArg<JTag::Enum, JTag::None, virt::enums::domain::ProcessSignal>{"signal"});
             return res ? DependsOutcome::SUCCESS : DependsOutcome::FAILURE;
         },
         +[](const rapidjson::Value& val, JsonRes& json_res, virt::Domain& dom) -> DependsOutcome {
@@ -156,7 +158,8 @@ class DomainActionsTable : public NamedCallTable<DomainActionsTable, DomainActio
                 return error(0);
             const auto keys = *keys_opt;
 
-            return dom.sendKey(keycodeset, holdtime, gsl::span(keys.data(), keys.size())) ? DependsOutcome::SUCCESS : DependsOutcome::FAILURE;
+            const auto sent = virt::RpcLimiter::call([&] { return dom.sendKey(keycodeset, holdtime, gsl::span(keys.data(), keys.size())); });
+            return sent ? DependsOutcome::SUCCESS : DependsOutcome::FAILURE;
         }};
     static_assert(keys.size() == fcns.size());
 } constexpr static const domain_actions_table{};
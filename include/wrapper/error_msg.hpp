@@ -53,6 +53,10 @@ class ErrorMessages {
         P{301, "Invalid flag"sv},
         P{500, "Error occurred while getting network status"sv},
         P{503, "Error occurred while getting network autostart"sv},
+        P{600, "Error occurred while getting storage pool information"sv},
+        P{601, "Could not list the volumes of the storage pool"sv},
+        P{602, "Could not refresh the storage pool"sv},
+        P{603, "Could not delete the storage pool"sv},
     };
 
   public:
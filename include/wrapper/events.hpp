@@ -0,0 +1,375 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+#include <boost/beast/http/message.hpp>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include "virt_wrap.hpp"
+#include "virt_wrap/EventLoop.hpp"
+#include "config.hpp"
+#include "logger.hpp"
+#include "urlparser.hpp"
+
+using namespace std::literals;
+
+/**
+ * \internal
+ * Names of the lifecycle events, by `virDomainEventType` and `virNetworkEventLifecycleType`
+ **/
+constexpr std::array domain_event_names = {"defined"sv, "undefined"sv, "started"sv,     "suspended"sv, "resumed"sv,
+                                           "stopped"sv, "shutdown"sv,  "pmsuspended"sv, "crashed"sv};
+constexpr std::array network_event_names = {"defined"sv, "undefined"sv, "started"sv, "stopped"sv};
+
+/**
+ * \internal
+ * Fans the lifecycle events of the domains and networks out to the subscribers of `GET /libvirt/events`
+ *
+ * The hub keeps a connection of its own to libvirt, registered for events, and reconnects it whenever it is lost.
+ * Each event is serialized once into a Server-Sent Events frame, which all its subscribers share; they only get a reference to it.
+ * The last `history` events are kept in a ring, for subscribers resuming with a `Last-Event-ID` to catch up on what they missed.
+ * A subscriber falling behind by more than `subscriber-queue` events is dropped, rather than letting its backlog grow unboundedly;
+ * it may come back with its Last-Event-ID.
+ **/
+class EventHub {
+  public:
+    using Frame = std::shared_ptr<const std::string>; ///< an event, serialized as a Server-Sent Events frame
+
+    /**
+     * \internal
+     * Event of a libvirt object, or of the hub itself
+     **/
+    struct Event {
+        std::uint64_t seq;     ///< sequence number, also the `id` of the frame
+        std::string_view kind; ///< "domain", "network", or "server" for the events of the hub
+        std::string name;
+        std::string uuid;
+        std::string_view type; ///< e.g. "started"
+        Frame frame;
+    };
+
+    /**
+     * \internal
+     * Events a subscriber asked for; an empty list lets everything through, and the events of the hub always go through
+     **/
+    struct Filter {
+        std::vector<std::string> names;
+        std::vector<std::string> uuids;
+        std::vector<std::string> types;
+
+        Filter() = default;
+
+        /**
+         * \internal
+         * Reads the comma-separated lists of the `name`, `uuid` and `type` queries of `target`
+         **/
+        explicit Filter(const TargetParser& target) : names(split(target["name"])), uuids(split(target["uuid"])), types(split(target["type"])) {}
+
+        [[nodiscard]] bool matches(const Event& ev) const noexcept {
+            const auto allows = [](const std::vector<std::string>& list, std::string_view value) {
+                return list.empty() || std::find(list.begin(), list.end(), value) != list.end();
+            };
+            return ev.kind == "server" || (allows(names, ev.name) && allows(uuids, ev.uuid) && allows(types, ev.type));
+        }
+
+      private:
+        static std::vector<std::string> split(std::string_view list) {
+            std::vector<std::string> ret;
+            while (!list.empty()) {
+                const auto comma = list.find(',');
+                if (const auto item = list.substr(0, comma); !item.empty())
+                    ret.emplace_back(item);
+                list.remove_prefix(comma == std::string_view::npos ? list.size() : comma + 1);
+            }
+            return ret;
+        }
+    };
+
+    /**
+     * \internal
+     * Queue of the frames bound for a subscriber
+     **/
+    class Subscription {
+        friend EventHub;
+
+        EventHub& hub;
+        Filter filter;
+        std::mutex mtx{};
+        std::vector<Frame> pending{};
+        std::function<void()> waker{};
+        bool dropped = false;
+
+        // Queues a frame, or drops the subscriber if it lags too far behind; returns the waker to call, if the subscriber was waiting
+        std::function<void()> push(const Frame& frame) {
+            const std::lock_guard lock{mtx};
+            if (dropped)
+                return {};
+            if (pending.size() >= hub.max_pending) {
+                pending.clear();
+                pending.push_back(hub.overflow_frame);
+                dropped = true;
+                ++hub.dropped_total;
+            } else
+                pending.push_back(frame);
+            return std::exchange(waker, nullptr);
+        }
+
+      public:
+        Subscription(EventHub& hub, Filter filter) : hub(hub), filter(std::move(filter)) { ++hub.subscriber_count; }
+        Subscription(const Subscription&) = delete;
+        Subscription& operator=(const Subscription&) = delete;
+        ~Subscription() { --hub.subscriber_count; }
+
+        /**
+         * \internal
+         * Moves the pending frames to `out`; if there are none, `wake` is called once there are, from the thread publishing them
+         *
+         * \return `false` once the subscription is over, as it lagged too far behind; its last frame tells the subscriber so
+         **/
+        bool take(std::vector<Frame>& out, std::function<void()> wake) {
+            const std::lock_guard lock{mtx};
+            if (pending.empty()) {
+                if (dropped)
+                    return false;
+                waker = std::move(wake);
+                return true;
+            }
+            out.insert(out.end(), std::make_move_iterator(pending.begin()), std::make_move_iterator(pending.end()));
+            pending.clear();
+            return true;
+        }
+    };
+
+    explicit EventHub(const IniConfig& config)
+        : history(static_cast<std::size_t>(config.events_history)), max_pending(static_cast<std::size_t>(config.events_subscriber_queue)) {}
+
+    EventHub(const EventHub&) = delete;
+    EventHub& operator=(const EventHub&) = delete;
+
+    /**
+     * \internal
+     * Starts the event loop of libvirt and connects to `uri`; to be called before any other connection to libvirt is opened
+     **/
+    void start(std::string conn_uri) {
+        if (!virt::EventLoop::start()) {
+            logger.error("Unable to start the libvirt event loop; GET /libvirt/events will stay silent");
+            return;
+        }
+        uri = std::move(conn_uri);
+        connect();
+        // Reconnect whenever the connection is lost, e.g. as libvirtd restarts
+        virt::EventLoop::addTimeout(reconnect_interval_ms, &EventHub::on_tick, this);
+    }
+
+    /**
+     * \internal
+     * Subscribes to the events matching `filter`
+     *
+     * \param[in] filter the events to subscribe to
+     * \param[in] last_id the `Last-Event-ID` of a resuming subscriber; the events after it which are still in the history are replayed
+     **/
+    [[nodiscard]] std::shared_ptr<Subscription> subscribe(Filter filter, std::optional<std::uint64_t> last_id) {
+        auto sub = std::make_shared<Subscription>(*this, std::move(filter));
+        const std::lock_guard lock{mtx};
+        if (last_id) {
+            // A Last-Event-ID from ahead of us comes from before a restart of the server, whose events are all gone
+            const auto from = *last_id > last_seq ? 0 : *last_id;
+            const auto oldest = ring.empty() ? last_seq + 1 : ring.front().seq;
+            if (from + 1 < oldest || from != *last_id)
+                sub->pending.push_back(gap_frame);
+            for (const auto& ev : ring)
+                if (ev.seq > from && sub->filter.matches(ev))
+                    sub->pending.push_back(ev.frame);
+        }
+        subscribers.push_back(sub);
+        return sub;
+    }
+
+    /**
+     * \internal
+     * Frame to send on an event stream without events for a while, to keep it from being deemed idle
+     **/
+    [[nodiscard]] const Frame& keep_alive_frame() const noexcept { return heartbeat_frame; }
+
+    /**
+     * \internal
+     * JSON data of a frame, for transports other than Server-Sent Events; empty for a keep-alive
+     **/
+    [[nodiscard]] static std::string_view frame_data(const Frame& frame) noexcept {
+        std::string_view text{*frame};
+        const auto at = text.find("\ndata: ");
+        if (at == std::string_view::npos)
+            return {};
+        text.remove_prefix(at + 7);
+        return text.substr(0, text.find('\n'));
+    }
+
+    /**
+     * \internal
+     * Appends the state of the hub to `out`, in the Prometheus text exposition format
+     **/
+    void write_metrics(std::string& out) const {
+        out.append("# HELP virthttp_events_connected Whether the connection receiving the events of libvirt is up\n");
+        out.append("# TYPE virthttp_events_connected gauge\n");
+        out.append("virthttp_events_connected ").append(connected.load() ? "1" : "0").append("\n");
+        out.append("# HELP virthttp_events_subscribers Subscribers to the event stream\n# TYPE virthttp_events_subscribers gauge\n");
+        out.append("virthttp_events_subscribers ").append(std::to_string(subscriber_count.load())).append("\n");
+        out.append("# HELP virthttp_events_published_total Events published\n# TYPE virthttp_events_published_total counter\n");
+        out.append("virthttp_events_published_total ").append(std::to_string(published_total.load())).append("\n");
+        out.append("# HELP virthttp_events_dropped_subscribers_total Subscribers dropped for lagging behind\n");
+        out.append("# TYPE virthttp_events_dropped_subscribers_total counter\n");
+        out.append("virthttp_events_dropped_subscribers_total ").append(std::to_string(dropped_total.load())).append("\n");
+    }
+
+  private:
+    constexpr static int reconnect_interval_ms = 5000;
+
+    static Frame static_frame(std::string_view type) {
+        return std::make_shared<const std::string>("event: server\ndata: {\"kind\":\"server\",\"type\":\""s.append(type).append("\"}\n\n"));
+    }
+
+    // Opens the connection and registers for events; on failure, the next tick tries again
+    void connect() {
+        if (conn) {
+            if (domain_callback >= 0)
+                conn->domainEventDeregisterAny(domain_callback);
+            if (network_callback >= 0)
+                conn->networkEventDeregisterAny(network_callback);
+            conn.reset();
+        }
+        connected = false;
+
+        virt::Connection c{uri.c_str()};
+        if (!c)
+            return;
+        try {
+            c.setKeepAlive(5, 3); // notice a dead libvirtd within seconds
+        } catch (const std::runtime_error&) {
+            // Not supported by every driver
+        }
+        domain_callback = c.domainEventRegisterLifecycle(&EventHub::on_domain_event, *this);
+        network_callback = c.networkEventRegisterLifecycle(&EventHub::on_network_event, *this);
+        if (domain_callback < 0)
+            logger.warning("Unable to register for the domain events of ", uri);
+        conn.emplace(std::move(c));
+        connected = true;
+
+        // Events may have been missed while disconnected
+        publish("server", {}, {}, "connected", 0);
+    }
+
+    static void on_tick(int, void* opaque) {
+        auto& self = *static_cast<EventHub*>(opaque);
+        if (!self.conn || !self.conn->isAlive())
+            self.connect();
+    }
+
+    static void on_domain_event(const virt::Domain& dom, int event, int detail, EventHub& self) {
+        const auto type = event >= 0 && static_cast<std::size_t>(event) < domain_event_names.size() ? domain_event_names[event] : "unknown"sv;
+        const auto* const name = dom.getName();
+        self.publish("domain", name ? name : "", dom.extractUUIDString(), type, detail);
+    }
+
+    static void on_network_event(const virt::Network& net, int event, int detail, EventHub& self) {
+        const auto type = event >= 0 && static_cast<std::size_t>(event) < network_event_names.size() ? network_event_names[event] : "unknown"sv;
+        self.publish("network", net.extractName(), net.extractUUIDString(), type, detail);
+    }
+
+    // Records an event, serializes it, and hands the frame to the subscribers it matches
+    void publish(std::string_view kind, std::string name, std::string uuid, std::string_view type, int detail) {
+        std::vector<std::function<void()>> wakers;
+        {
+            const std::lock_guard lock{mtx};
+            Event ev{++last_seq, kind, std::move(name), std::move(uuid), type, nullptr};
+
+            rapidjson::StringBuffer json;
+            rapidjson::Writer<rapidjson::StringBuffer> writer{json};
+            writer.StartObject();
+            writer.Key("seq");
+            writer.Uint64(ev.seq);
+            writer.Key("kind");
+            writer.String(ev.kind.data(), static_cast<rapidjson::SizeType>(ev.kind.size()));
+            if (ev.kind != "server") {
+                writer.Key("name");
+                writer.String(ev.name.data(), static_cast<rapidjson::SizeType>(ev.name.size()));
+                writer.Key("uuid");
+                writer.String(ev.uuid.data(), static_cast<rapidjson::SizeType>(ev.uuid.size()));
+            }
+            writer.Key("type");
+            writer.String(ev.type.data(), static_cast<rapidjson::SizeType>(ev.type.size()));
+            writer.Key("detail");
+            writer.Int(detail);
+            writer.EndObject();
+
+            std::string frame;
+            frame.reserve(json.GetSize() + 64);
+            frame.append("id: ").append(std::to_string(ev.seq)).append("\nevent: ").append(ev.kind);
+            frame.append("\ndata: ").append(json.GetString(), json.GetSize()).append("\n\n");
+            ev.frame = std::make_shared<const std::string>(std::move(frame));
+
+            if (ring.size() == history)
+                ring.pop_front();
+            const auto& recorded = ring.emplace_back(std::move(ev));
+            ++published_total;
+
+            // Fan out, forgetting the subscribers gone meanwhile
+            for (std::size_t i = 0; i < subscribers.size();) {
+                const auto sub = subscribers[i].lock();
+                if (!sub) {
+                    subscribers[i] = std::move(subscribers.back());
+                    subscribers.pop_back();
+                    continue;
+                }
+                if (sub->filter.matches(recorded))
+                    if (auto wake = sub->push(recorded.frame))
+                        wakers.push_back(std::move(wake));
+                ++i;
+            }
+        }
+        for (const auto& wake : wakers)
+            wake();
+    }
+
+    const std::size_t history;
+    const std::size_t max_pending;
+    const Frame gap_frame = static_frame("gap");           ///< tells a resuming subscriber that some events it missed are gone
+    const Frame overflow_frame = static_frame("overflow"); ///< last frame of a dropped subscriber
+    const Frame heartbeat_frame = std::make_shared<const std::string>(": keep-alive\n\n");
+
+    std::string uri;
+    std::optional<virt::Connection> conn; ///< only touched from the thread of the event loop, once started
+    int domain_callback = -1;
+    int network_callback = -1;
+
+    mutable std::mutex mtx{};
+    std::deque<Event> ring{};
+    std::uint64_t last_seq = 0;
+    std::vector<std::weak_ptr<Subscription>> subscribers{};
+
+    std::atomic<bool> connected{false};
+    std::atomic<std::int64_t> subscriber_count{0};
+    std::atomic<std::uint64_t> published_total{0};
+    std::atomic<std::uint64_t> dropped_total{0};
+};
+
+/**
+ * \internal
+ * Body of a `text/event-stream` response, made of the frames of a subscription for as long as it lasts
+ *
+ * Responses with this body are not written at once: the sessions recognise them and stream the frames as they come.
+ **/
+struct EventStreamBody {
+    using value_type = std::shared_ptr<EventHub::Subscription>;
+};
+
+using EventStreamResponse = boost::beast::http::response<EventStreamBody>;
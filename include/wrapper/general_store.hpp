@@ -1,6 +1,10 @@
 #pragma once
 #include "handlers/async/async_store.hpp"
+#include "admission.hpp"
 #include "config.hpp"
+#include "events.hpp"
+#include "quarantine.hpp"
+#include "session_cap.hpp"
 
 class GeneralStore {
     IniConfig m_config;
@@ -8,9 +12,15 @@ class GeneralStore {
 
   public:
     AsyncStore async_store;
+    AdmissionController admission;
+    QuarantinePool quarantine;
+    SessionCap sessions;
+    EventHub events;
 
     GeneralStore() = delete;
-    inline GeneralStore(IniConfig conf) : m_config(std::move(conf)), m_doc_root(m_config.http_doc_root) {}
+    inline GeneralStore(IniConfig conf)
+        : m_config(std::move(conf)), m_doc_root(m_config.http_doc_root), admission(m_config), quarantine(m_config.quarantine_threads),
+          sessions(m_config.http_max_sessions), events(m_config) {}
     GeneralStore(const GeneralStore&) = delete;
     GeneralStore(GeneralStore&&) = delete;
     GeneralStore& operator=(const GeneralStore&) = delete;
@@ -4,14 +4,20 @@
 
 #pragma once
 
+#include <string>
+#include <type_traits>
 #include <utility>
 #include <boost/beast/http/message.hpp>
+#include <gsl/gsl>
 #include <rapidjson/document.h>
 #include "handlers/domain.hpp"
 #include "wrapper/handlers/network.hpp"
+#include "wrapper/handlers/storage_pool.hpp"
 #include "actions_table.hpp"
+#include "connection_pool.hpp"
 #include "dispatch.hpp"
 #include "general_store.hpp"
+#include "json_arena.hpp"
 #include "json_utils.hpp"
 #include "logger.hpp"
 #include "solver.hpp"
@@ -21,12 +27,23 @@
 namespace beast = boost::beast;
 namespace http = beast::http;
 
+/**
+ * \internal
+ * Runs the JSON API request and serializes its response
+ *
+ * The request body is parsed in situ when it is held in a string, and thus clobbered.
+ * All the JSON documents live in the thread's JsonArena, which is reset before returning.
+ * A `trusted` request skips the auth key check, its peer having been authenticated by the transport (e.g. by UID on a UNIX socket).
+ **/
 template <class Body, class Allocator>
-rapidjson::StringBuffer handle_json(GeneralStore& gstore, const http::request<Body, http::basic_fields<Allocator>>& req, const TargetParser& target) {
-    JsonRes json_res{};
+std::string handle_json(GeneralStore& gstore, http::request<Body, http::basic_fields<Allocator>>& req, const TargetParser& target,
+                        bool trusted = false) {
+    auto& arena = JsonArena::local();
+    const auto arena_reset = gsl::finally([&] { arena.reset(); });
+    JsonRes json_res{&arena.allocator()};
     auto error = [&](auto... args) { return json_res.error(args...); };
 
-    auto object = [&](virt::Connection&& conn, auto resolver, auto jdispatchers, auto t_hdls) -> void {
+    auto object = [&](virt::Connection& conn, auto resolver, auto jdispatchers, auto t_hdls) -> void {
         using Object = typename decltype(resolver)::O;
         using Handlers = typename decltype(t_hdls)::Type;
         HandlerContext hdl_ctx{conn, json_res, target};
@@ -34,13 +51,19 @@ rapidjson::StringBuffer handle_json(GeneralStore& gstore, const http::request<Bo
         Handlers hdls{hdl_ctx, obj};
 
         auto skip_resolve = req.method() == http::verb::post;
-        auto objs = !skip_resolve ? resolver(hdl_ctx) : std::vector<Object>{};
+        // Each call runs in a slot of the RpcLimiter of the endpoint, so that libvirtd never gets more calls than it can take;
+        // the resolver makes a single one, and the handlers take theirs through the limiter of the thread
+        const virt::RpcLimiter::Scope rpc_scope{conn.rpcLimiter()};
+        auto objs = !skip_resolve ? conn.limited([&] { return resolver(hdl_ctx); }) : typename decltype(resolver)::Objects{};
         const auto idx = HandlerMethods::verb_to_idx(req.method());
         if (idx < 0)
             return error(3);
         const auto mth = HandlerMethods::methods[idx];
-        rapidjson::Document json_req{};
-        json_req.Parse(req.body().data());
+        auto& json_req = arena.request();
+        if constexpr (std::is_same_v<typename Body::value_type, std::string>)
+            json_req.ParseInsitu(req.body().data());
+        else
+            json_req.Parse(req.body().data());
 
         auto exec = jdispatchers[idx](json_req, [&](const auto& jval) { return (hdls.*mth)(jval); });
         if (skip_resolve)
@@ -68,15 +91,26 @@ rapidjson::StringBuffer handle_json(GeneralStore& gstore, const http::request<Bo
                                                    }},
                                         [](HandlerContext& hc, auto flags) { return hc.conn.extractAllNetworks(flags); }};
 
-    constexpr static std::array keys = {"domains"sv, "networks"sv};
-    std::tuple fcns = {std::bind(object, std::placeholders::_1, domain_resolver, domain_jdispatchers, t_<DomainHandlers>),
-                       std::bind(object, std::placeholders::_1, network_resolver, network_jdispatchers, t_<NetworkHandlers>)};
+    constexpr Resolver storage_pool_resolver{tp<virt::StoragePool, StoragePoolUnawareHandlers>, "storage_pools", std::array{"by-name"sv, "by-uuid"sv},
+                                             std::array{+[](const HandlerContext& hc, std::string_view sv) {
+                                                            return hc.conn.storagePoolLookupByName(std::string{sv}.c_str());
+                                                        },
+                                                        +[](const HandlerContext& hc, std::string_view sv) {
+                                                            return hc.conn.storagePoolLookupByUUIDString(std::string{sv}.c_str());
+                                                        }},
+                                             [](HandlerContext& hc, auto flags) { return hc.conn.extractAllStoragePools(flags); }};
+
+    constexpr static std::array keys = {"domains"sv, "networks"sv, "storage_pools"sv};
+    std::tuple fcns = {
+        [&](virt::Connection& conn) { object(conn, domain_resolver, domain_jdispatchers, t_<DomainHandlers>); },
+        [&](virt::Connection& conn) { object(conn, network_resolver, network_jdispatchers, t_<NetworkHandlers>); },
+        [&](virt::Connection& conn) { object(conn, storage_pool_resolver, storage_pool_jdispatchers, t_<StoragePoolHandlers>); }};
 
     [&] {
         auto& config = gstore.config();
-        if (config.isHTTPAuthRequired() && req["X-Auth-Key"] != config.http_auth_key)
+        if (!trusted && config.isHTTPAuthRequired() && req["X-Auth-Key"] != config.http_auth_key)
             return error(1);
-        auto path_parts = target.getPathParts();
+        const auto& path_parts = target.getPathParts();
         if (path_parts.empty())
             return error(4); // Empty request (/)
         if (path_parts.front() != "libvirt")
@@ -84,8 +118,8 @@ rapidjson::StringBuffer handle_json(GeneralStore& gstore, const http::request<Bo
         if (path_parts.size() <= 1)
             return error(6); // Path is only /libvirt
 
-        logger.debug("Opening connection to ", config.getConnURI());
-        virt::Connection conn{config.connURI.c_str()};
+        logger.debug("Leasing connection to ", config.getConnURI());
+        auto conn = ConnectionPool::local().acquire(config.connURI);
 
         if (!conn) {
             logger.error("Failed to open connection to ", config.getConnURI());
@@ -99,14 +133,14 @@ rapidjson::StringBuffer handle_json(GeneralStore& gstore, const http::request<Bo
         int i = std::distance(keys.begin(), it);
         return visit(fcns, [&](const auto& e) {
             if (i-- == 0)
-                e(std::move(conn));
+                e(*conn);
         });
     }();
 
-    rapidjson::StringBuffer buffer;
+    auto& buffer = arena.output();
     using UTF8_Writer = rapidjson::Writer<rapidjson::StringBuffer, rapidjson::Document::EncodingType, rapidjson::UTF8<>>;
     UTF8_Writer writer(buffer);
     json_res.Accept(writer);
 
-    return buffer;
+    return std::string{buffer.GetString(), buffer.GetLength()};
 }
\ No newline at end of file
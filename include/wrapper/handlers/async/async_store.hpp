@@ -58,7 +58,7 @@ struct AsyncStore {
         const auto id = last_id = get_free_id();
         auto [it, sucess] = elems.emplace(id, std::move(Element{std::chrono::time_point<ClockType>{init_expire}, {}}));
 
-        it->second.fut = std::async(std::launch::async, [&, expire_opt, id, fcn = std::forward<Fcn>(fcn)]() -> std::string {
+        it->second.fut = std::async(std::launch::async, [&, expire_opt, id, fcn = std::forward<Fcn>(fcn)]() mutable -> std::string {
             std::string ret = fcn(); // Not const for NRVO
 
             /* Housekeeping */
@@ -82,7 +82,7 @@ class DomainHandlers : public HandlerMethods {
 
     DependsOutcome create(const rapidjson::Value& obj) override {
         if (obj.IsString()) {
-            dom = virt::Domain::createXML(conn, obj.GetString());
+            dom = conn.limited([&] { return virt::Domain::createXML(conn, obj.GetString()); });
             if (!dom)
                 return error(105), DependsOutcome::FAILURE;
             rapidjson::Value res_val;
@@ -102,10 +102,11 @@ class DomainHandlers : public HandlerMethods {
         const auto& path_parts = target.getPathParts();
         if (path_parts.size() < 5) {
             res_val.SetObject();
-            const auto [state, max_mem, memory, nvirt_cpu, cpu_time] = dom.getInfo();
-            const auto os_type = dom.getOSType();
+            const auto [state, max_mem, memory, nvirt_cpu, cpu_time] = conn.limited([&] { return dom.getInfo(); });
+            const auto os_type = conn.limited([&] { return dom.getOSType(); });
             res_val.AddMember("name", rapidjson::Value(dom.getName(), jalloc), jalloc);
-            res_val.AddMember("uuid", dom.extractUUIDString(), jalloc);
+            const auto uuid = dom.getUUIDString().value_or(std::array<char, VIR_UUID_STRING_BUFLEN>{});
+            res_val.AddMember("uuid", rapidjson::Value(uuid.data(), jalloc), jalloc);
             res_val.AddMember("id", static_cast<int>(dom.getID()), jalloc);
             res_val.AddMember("status", rapidjson::StringRef(virt::enums::domain::State(EHTag{}, state).to_string().data()), jalloc);
             res_val.AddMember("os", rapidjson::Value(os_type.get(), jalloc), jalloc);
@@ -116,8 +117,8 @@ class DomainHandlers : public HandlerMethods {
             return DependsOutcome::SUCCESS;
         }
 
-
-
+        // Guest agent calls are not cut short at the deadline, the quarantine pool answering 504 in their stead; setting the timeout of the
+        // agent instead would change it for the whole domain, and for good
         const auto outcome = parameterized_depends_scope(
             subquery("xml_desc", "options", ti<virt::enums::domain::XMLFlags>, SUBQ_LIFT(dom.getXMLDesc), fwd_as_if_err(-2)),
             subquery("fs_info", SUBQ_LIFT(dom.getFSInfo), fwd_as_if_err(201), // getting filesystem information failed
@@ -180,6 +181,6 @@ class DomainHandlers : public HandlerMethods {
         const auto opt_flags = target_get_composable_flag<virt::enums::domain::UndefineFlag>(target, "options");
         if (!opt_flags)
             return error(301), DependsOutcome::FAILURE;
-        return dom.undefine(*opt_flags) ? success() : failure();
+        return conn.limited([&] { return dom.undefine(*opt_flags); }) ? success() : failure();
     }
 };
\ No newline at end of file
@@ -2,6 +2,7 @@
 #include <optional>
 #include <string_view>
 #include "../../detect.hpp"
+#include "virt_wrap/RpcLimiter.hpp"
 #include "urlparser.hpp"
 
 /**
@@ -10,12 +11,11 @@
  */
 
 /**
- * @param mem_fn a reference to the function to be lifted
+ * @param mem_fn a reference to the function to be lifted, called in a slot of the thread's virt::RpcLimiter
  **/
 #define SUBQ_LIFT(mem_fn)                                                                                                                            \
-    [&](auto&&... args) noexcept(noexcept(mem_fn(std::forward<decltype(args)>(args)...))) -> decltype(                                               \
-                                                                                              mem_fn(std::forward<decltype(args)>(args)...)) {       \
-        return mem_fn(std::forward<decltype(args)>(args)...);                                                                                        \
+    [&](auto&&... args) -> decltype(mem_fn(std::forward<decltype(args)>(args)...)) {                                                                 \
+        return virt::RpcLimiter::call([&]() -> decltype(auto) { return mem_fn(std::forward<decltype(args)>(args)...); });                            \
     }
 
 /**
@@ -79,7 +79,7 @@ class NetworkHandlers : public HandlerMethods {
 
     auto create(const rapidjson::Value& obj) -> DependsOutcome override {
         const auto create_nw = [&](std::string_view xml) {
-            nw = virt::Network::createXML(conn, xml.data());
+            nw = conn.limited([&] { return virt::Network::createXML(conn, xml.data()); });
             if (!nw)
                 return error(-999), DependsOutcome::FAILURE;
             rapidjson::Value res_val;
@@ -110,7 +110,7 @@ class NetworkHandlers : public HandlerMethods {
         if (path_parts.size() < 5) {
             rapidjson::Value json_active;
             {
-                const TFE tfe = nw.isActive();
+                const TFE tfe = conn.limited([&] { return nw.isActive(); });
                 if (tfe.err()) {
                     logger.error("Error occurred while getting network status");
                     return error(500), DependsOutcome::FAILURE;
@@ -119,7 +119,7 @@ class NetworkHandlers : public HandlerMethods {
             }
             rapidjson::Value json_AS;
             {
-                const TFE tfe = nw.getAutostart();
+                const TFE tfe = conn.limited([&] { return nw.getAutostart(); });
                 if (tfe.err()) {
                     logger.error("Error occurred while getting network autostart policy");
                     return error(500), DependsOutcome::FAILURE;
@@ -128,7 +128,7 @@ class NetworkHandlers : public HandlerMethods {
             }
             rapidjson::Value json_is_persistent;
             {
-                const TFE tfe = nw.isPersistent();
+                const TFE tfe = conn.limited([&] { return nw.isPersistent(); });
                 if (tfe.err()) {
                     logger.error("Error occurred while getting network persistence");
                     return error(500), DependsOutcome::FAILURE;
@@ -138,12 +138,13 @@ class NetworkHandlers : public HandlerMethods {
 
             res_val.SetObject();
             res_val.AddMember("name", rapidjson::Value(nw.getName(), jalloc), jalloc);
-            res_val.AddMember("uuid", nw.extractUUIDString(), jalloc);
+            const auto uuid = nw.getUUIDString().value_or(std::array<char, VIR_UUID_STRING_BUFLEN>{});
+            res_val.AddMember("uuid", rapidjson::Value(uuid.data(), jalloc), jalloc);
             res_val.AddMember("active", json_active, jalloc);
             res_val.AddMember("autostart", json_AS, jalloc);
             res_val.AddMember("persistent", json_is_persistent, jalloc);
             if (path_parts.size() == 4)
-                res_val.AddMember("bridge", to_json(nw.getBridgeName(), jalloc), jalloc);
+                res_val.AddMember("bridge", to_json(conn.limited([&] { return nw.getBridgeName(); }), jalloc), jalloc);
             json_res.result(std::move(res_val));
             return DependsOutcome::SUCCESS;
         }
@@ -181,6 +182,6 @@ class NetworkHandlers : public HandlerMethods {
             json_res.message(std::move(msg_val));
             return error(-999), DependsOutcome::FAILURE;
         };
-        return nw.undefine() ? success() : failure();
+        return conn.limited([&] { return nw.undefine(); }) ? success() : failure();
     }
 };
\ No newline at end of file
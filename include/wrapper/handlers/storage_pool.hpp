@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <tuple>
+#include <rapidjson/rapidjson.h>
+#include "wrapper/depends.hpp"
+#include "wrapper/dispatch.hpp"
+#include "wrapper/storage_pool_actions_table.hpp"
+#include "wrapper/volume_catalog.hpp"
+#include "base.hpp"
+#include "flagwork.hpp"
+#include "hdl_ctx.hpp"
+#include "logger.hpp"
+#include "urlparser.hpp"
+#include "virt_wrap.hpp"
+
+/**
+ * \internal
+ * jdispatcher values for storage pool handlers as a type list
+ **/
+using StoragePoolJDispatcherVals = std::tuple<JDispatchVals<JAll>, JDispatchVals<JAll>, JDispatchVals<JAll>, JDispatchVals<JAll>>;
+/**
+ * \internal
+ * jdispatcher values for storage pool handlers as a tuple
+ **/
+constexpr StoragePoolJDispatcherVals storage_pool_jdispatcher_vals{};
+
+/**
+ * \internal jdispatchers for storage pool handlers as an array
+ **/
+constexpr auto storage_pool_jdispatchers = gen_jdispatchers(storage_pool_jdispatcher_vals);
+
+/**
+ * \internal
+ * Storage pools-specific handler utilities
+ **/
+class StoragePoolUnawareHandlers : public HandlerContext {
+  public:
+    explicit StoragePoolUnawareHandlers(HandlerContext& ctx) : HandlerContext(ctx) {}
+
+    /**
+     * \internal
+     * Extractor of virt::Connection::List::StoragePool::Flag from a URI's target
+     *
+     * \param[in] target the target to extract the flag from
+     * \return the flag, or `std::nullopt` on error
+     * */
+    [[nodiscard]] static constexpr auto search_all_flags(const TargetParser& target) noexcept
+        -> std::optional<virt::enums::connection::list::storage_pool::Flag> {
+        using namespace virt::enums::connection::list::storage_pool;
+        auto flags = Flag::DEFAULT;
+        if (auto activity = target.getBool("active"); activity)
+            flags |= *activity ? Flag::ACTIVE : Flag::INACTIVE;
+        if (auto persistence = target.getBool("persistent"); persistence)
+            flags |= *persistence ? Flag::PERSISTENT : Flag::TRANSIENT;
+        if (auto autostart = target.getBool("autostart"); autostart)
+            flags |= *autostart ? Flag::AUTOSTART : Flag::NO_AUTOSTART;
+        return {flags};
+    }
+};
+
+/**
+ * \internal
+ * Storage pool-specific handlers
+ *
+ * The volumes of a pool are listed through the VolumeCatalog, which describes them concurrently and keeps the listing
+ * until the pool is refreshed, one of its volumes is uploaded to, or it is VolumeCatalog::ttl old.
+ **/
+class StoragePoolHandlers : public HandlerMethods {
+    template <class... Args> auto error(Args... args) const noexcept { return json_res.error(args...); };
+    virt::StoragePool& pool; ///< Current libvirt storage pool
+
+  public:
+    /**
+     * \internal
+     **/
+    explicit StoragePoolHandlers(HandlerContext& ctx, virt::StoragePool& pool) : HandlerMethods(ctx), pool(pool) {}
+
+    auto create(const rapidjson::Value& obj) -> DependsOutcome override { return error(-1), DependsOutcome::FAILURE; }
+
+    auto query(const rapidjson::Value& action) -> DependsOutcome override {
+        auto& jalloc = json_res.GetAllocator();
+        const auto& path_parts = target.getPathParts();
+        if (path_parts.size() < 5) {
+            const auto info = conn.limited([&] { return pool.getInfo(); });
+            const TFE active = conn.limited([&] { return pool.isActive(); });
+            const TFE autostart = conn.limited([&] { return pool.getAutostart(); });
+            const TFE persistent = conn.limited([&] { return pool.isPersistent(); });
+            if (!info || active.err() || autostart.err() || persistent.err()) {
+                logger.error("Error occurred while getting storage pool information");
+                return error(600), DependsOutcome::FAILURE;
+            }
+
+            rapidjson::Value res_val;
+            res_val.SetObject();
+            res_val.AddMember("name", rapidjson::Value(pool.getName(), jalloc), jalloc);
+            const auto uuid = pool.getUUIDString().value_or(std::array<char, VIR_UUID_STRING_BUFLEN>{});
+            res_val.AddMember("uuid", rapidjson::Value(uuid.data(), jalloc), jalloc);
+            res_val.AddMember("state", rapidjson::StringRef(info->state().to_string().data()), jalloc);
+            res_val.AddMember("capacity", std::uint64_t{info->capacity()}, jalloc);
+            res_val.AddMember("allocation", std::uint64_t{info->allocation()}, jalloc);
+            res_val.AddMember("available", std::uint64_t{info->available()}, jalloc);
+            res_val.AddMember("active", to_json(active), jalloc);
+            res_val.AddMember("autostart", to_json(autostart), jalloc);
+            res_val.AddMember("persistent", to_json(persistent), jalloc);
+            json_res.result(std::move(res_val));
+            return DependsOutcome::SUCCESS;
+        }
+
+        if (path_parts.size() > 5 || path_parts[4] != "volumes")
+            return error(-1), DependsOutcome::FAILURE;
+        const auto volumes = VolumeCatalog::global().list(conn, pool);
+        if (!volumes) {
+            logger.error("Error occurred while listing the volumes of storage pool ", pool.getName());
+            return error(601), DependsOutcome::FAILURE;
+        }
+        for (const auto& vol : *volumes) {
+            rapidjson::Value res_val;
+            res_val.SetObject();
+            res_val.AddMember("name", rapidjson::Value(vol.name.data(), vol.name.size(), jalloc), jalloc);
+            res_val.AddMember("key", rapidjson::Value(vol.key.data(), vol.key.size(), jalloc), jalloc);
+            res_val.AddMember("path", rapidjson::Value(vol.path.data(), vol.path.size(), jalloc), jalloc);
+            res_val.AddMember("type", rapidjson::StringRef(vol.info->type().to_string().data()), jalloc);
+            res_val.AddMember("capacity", std::uint64_t{vol.info->capacity()}, jalloc);
+            res_val.AddMember("allocation", std::uint64_t{vol.info->allocation()}, jalloc);
+            json_res.result(std::move(res_val));
+        }
+        return DependsOutcome::SUCCESS;
+    }
+
+    auto alter(const rapidjson::Value& action) -> DependsOutcome override {
+        const auto& action_obj = *action.MemberBegin();
+        const auto& [action_name, action_val] = action_obj;
+        const auto hdl = storage_pool_actions_table[std::string_view{action_name.GetString(), action_name.GetStringLength()}];
+        return hdl ? hdl(action_val, json_res, pool) : (error(123), DependsOutcome::FAILURE);
+    }
+
+    auto vacuum(const rapidjson::Value& action) -> DependsOutcome override {
+        auto& jalloc = json_res.GetAllocator();
+        const std::string name = pool.getName();
+        if (!conn.limited([&] { return pool.undefine(); })) {
+            rapidjson::Value msg_val;
+            msg_val.SetObject();
+            msg_val.AddMember("libvirt", rapidjson::Value(virt::extractLastError().message, jalloc), jalloc);
+            json_res.message(std::move(msg_val));
+            return error(603), DependsOutcome::FAILURE;
+        }
+        VolumeCatalog::global().invalidate(name);
+        rapidjson::Value res_val;
+        res_val.SetObject();
+        res_val.AddMember("deleted", true, jalloc);
+        json_res.result(std::move(res_val));
+        return DependsOutcome::SUCCESS;
+    }
+};
@@ -1,4 +1,5 @@
 #pragma once
 
 #include "protocol_support/tcp_listener.hpp"
+#include "protocol_support/unix_listener.hpp"
 //#include "protocol_support/udp_listener.hpp"
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+#include <string>
+#include <string_view>
+#include "general_store.hpp"
+#include "virt_wrap/RpcLimiter.hpp"
+
+/**
+ * \internal
+ * Appends the figures of the RpcLimiter of the libvirt endpoints to `out`
+ **/
+inline void write_rpc_metrics(std::string& out) {
+    const auto totals = virt::RpcLimiter::totals();
+    const auto metric = [&](std::string_view name, std::string_view type, std::string_view help, auto value) {
+        out.append("# HELP virthttp_rpc_").append(name).append(" ").append(help).append("\n");
+        out.append("# TYPE virthttp_rpc_").append(name).append(" ").append(type).append("\n");
+        out.append("virthttp_rpc_").append(name).append(" ").append(std::to_string(value)).append("\n");
+    };
+
+    metric("endpoints", "gauge", "Libvirt endpoints with open connections", totals.limiters);
+    metric("limit", "gauge", "Calls allowed in flight, summed over the endpoints", totals.limit_sum);
+    metric("in_flight", "gauge", "Calls in flight", totals.in_flight);
+    metric("calls_total", "counter", "Calls made", totals.calls);
+    metric("queued_calls_total", "counter", "Calls that waited for a slot", totals.queued_calls);
+    metric("queue_seconds_total", "counter", "Time spent waiting for a slot", totals.queue_ns / 1e9);
+    metric("latency_seconds_total", "counter", "Time spent in calls", totals.latency_ns / 1e9);
+    metric("congestion_events_total", "counter", "Limit cuts following a latency rise", totals.congestion_events);
+}
+
+/**
+ * \internal
+ * Renders the metrics of the server in the Prometheus text exposition format, for `GET /metrics`
+ **/
+[[nodiscard]] inline std::string render_metrics(const GeneralStore& gstore) {
+    std::string out;
+    out.reserve(4096);
+    gstore.admission.write_metrics(out);
+    write_rpc_metrics(out);
+    gstore.quarantine.write_metrics(out);
+    gstore.sessions.write_metrics(out);
+    gstore.events.write_metrics(out);
+    return out;
+}
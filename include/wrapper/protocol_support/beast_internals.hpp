@@ -1,10 +1,20 @@
 #pragma once
+#include <chrono>
 #include <iostream>
 #include <boost/beast/core/error.hpp>
 
 // Report a failure
 void fail(boost::beast::error_code ec, const char* what) { std::cerr << what << ": " << ec.message() << "\n"; }
 
+// Time out the next operation started on a Beast stream `seconds` from now, or never if not positive;
+// as the expiry applies to whichever reads and writes are not in progress, it is set before starting every operation
+template <class Stream> void expire_after(Stream& stream, long seconds) {
+    if (seconds > 0)
+        stream.expires_after(std::chrono::seconds{seconds});
+    else
+        stream.expires_never();
+}
+
 // Return a reasonable mime type based on the extension of a file.
 inline boost::beast::string_view mime_type(boost::beast::string_view path) {
     using boost::beast::iequals;
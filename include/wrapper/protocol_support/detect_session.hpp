@@ -0,0 +1,74 @@
+#pragma once
+
+#include <memory>
+#include <string_view>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include "../general_store.hpp"
+#include "beast_internals.hpp"
+#include "http1/Session.hpp"
+#ifdef VIRTHTTP_WITH_HTTP2
+#include "http2/Session.hpp"
+
+/**
+ * \internal
+ * Tells HTTP/2 "prior knowledge" connections from HTTP/1 ones by their first bytes, then hands the connection to the matching session
+ *
+ * Reading stops as soon as the bytes received stop matching the HTTP/2 preface, so that HTTP/1 clients are never kept waiting.
+ * A client which does not send enough to tell within `idle-timeout` is disconnected.
+ **/
+class DetectSession : public std::enable_shared_from_this<DetectSession> {
+    boost::beast::tcp_stream stream_;
+    boost::beast::flat_buffer buffer_;
+    std::reference_wrapper<GeneralStore> m_gstore;
+    SessionCap::Slot session_slot_;
+
+  public:
+    // Take ownership of the socket
+    explicit DetectSession(boost::asio::ip::tcp::socket socket, GeneralStore& gstore)
+        : stream_(std::move(socket)), m_gstore(gstore), session_slot_(gstore.sessions.open()) {}
+
+    // Start the asynchronous operation
+    void run() {
+        expire_after(stream_, m_gstore.get().config().http_idle_timeout);
+        do_read();
+    }
+
+    void do_read() {
+        stream_.async_read_some(buffer_.prepare(http2_client_preface.size() - buffer_.size()),
+                                std::bind(&DetectSession::on_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        // This means they closed the connection
+        if (ec == boost::asio::error::eof)
+            return;
+
+        if (ec == boost::beast::error::timeout)
+            return m_gstore.get().sessions.timed_out();
+
+        if (ec)
+            return fail(ec, "detect");
+
+        buffer_.commit(bytes_transferred);
+        const std::string_view head{static_cast<const char*>(buffer_.data().data()), buffer_.size()};
+        if (http2_client_preface.compare(0, head.size(), head) != 0)
+            return std::make_shared<Session>(stream_.release_socket(), m_gstore, std::move(buffer_))->run();
+        if (head.size() < http2_client_preface.size())
+            return do_read();
+        std::make_shared<Http2Session>(stream_.release_socket(), m_gstore, std::move(buffer_))->run();
+    }
+};
+#endif
+
+/**
+ * \internal
+ * Creates and runs the right kind of session for a freshly accepted connection
+ **/
+inline void launch_session(boost::asio::ip::tcp::socket socket, GeneralStore& gstore) {
+#ifdef VIRTHTTP_WITH_HTTP2
+    if (gstore.config().http2)
+        return std::make_shared<DetectSession>(std::move(socket), gstore)->run();
+#endif
+    std::make_shared<Session>(std::move(socket), gstore)->run();
+}
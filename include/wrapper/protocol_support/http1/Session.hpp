@@ -1,83 +1,684 @@
 #pragma once
 
+#include <chrono>
+#include <deque>
+#include <limits>
 #include <memory>
+#include <optional>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
 #include <boost/asio.hpp>
 #include <boost/beast.hpp>
+#include "../../events.hpp"
 #include "../../general_store.hpp"
+#include "../../volume_transfer.hpp"
 #include "../beast_internals.hpp"
+#include "../registered_buffers.hpp"
 #include "../request_handler.hpp"
+#include "../websocket/ConsoleSession.hpp"
+#include "../websocket/GraphicsSession.hpp"
+#include "../websocket/Session.hpp"
+#ifdef VIRTHTTP_WITH_HTTP2
+#include "../http2/Session.hpp"
+#endif
 
 // Handles an HTTP1 server connection
-class Session : public std::enable_shared_from_this<Session> {
+//
+// Pipelined requests keep being read while earlier ones are handled, up to the configured pipeline depth.
+// Safe requests (GET, HEAD) are handled concurrently on the io_context; any other request waits for the ones before it
+// and holds back the ones after it, so that a pipelined mutation is never reordered with respect to its neighbours.
+// Responses are queued, then written back in request order, as in Beast's advanced server example.
+//
+// Requests are read through a parser bounded by the configured `body-limit` and `header-limit`; a request past either is refused
+// with 413 or 431, after which the connection is closed, as there is no telling where the next request would start.
+//
+// An idle connection holds no read buffer: the session waits for the socket to become readable before reading into one, and gives
+// back buffers larger than `idle-buffer-limit` when it runs out of requests. The response objects are recycled across requests.
+//
+// The connection is closed once reading the header or the body of a request, writing a response, or waiting for the next request
+// while none is being handled takes longer than the configured timeout. Every session counts against the `max-sessions` cap.
+//
+// An event stream (GET /libvirt/events) is the last response of its connection: its frames are written as the chunks of a body
+// without end, until the subscriber lags too far behind, or goes away; no request after it is read.
+// The content of a volume (GET /libvirt/storage_pools/by-name/<pool>/volumes/<vol>/content, or by-uuid) is written as it is received
+// from libvirt, a buffer at a time, the next buffer only being received once the previous one is written. Conversely, the body of an
+// upload (PUT to the same) is not bounded by the `body-limit`: once its header is read, the upload is started, and its body is read into the volume
+// in turn, the next buffer only being read once libvirt took the previous one; no other request is read meanwhile.
+//
+// A WebSocket upgrade request hands the connection over, once every response before it is written, to a ConsoleSession
+// if it targets the console of a domain, else to a WebSocketSession. Any upgrade request for the graphics of a domain
+// hands it over to a GraphicsSession, and an h2c one to an Http2Session. No request after an upgrade is read.
+//
+// `Socket` is the stream socket of the connection: TCP, or UNIX domain for co-located clients.
+template <class Socket> class BasicSession : public std::enable_shared_from_this<BasicSession<Socket>> {
+    using Stream = boost::beast::basic_stream<typename Socket::protocol_type, typename Socket::executor_type>;
+    using Request = boost::beast::http::request<boost::beast::http::string_body>;
+    using StringResponse = boost::beast::http::response<boost::beast::http::string_body>; ///< type of most responses, hence recycled
+
+    // Type-erased response waiting in the queue
+    struct work {
+        virtual ~work() = default;
+        virtual void operator()() = 0;
+        bool recyclable = false; ///< whether this is a work_impl<StringResponse>
+    };
+
+    // The lifetime of the message has to extend
+    // for the duration of the async operation so
+    // the queue owns it until it has been written.
+    template <class Message> struct work_impl : work {
+        BasicSession& self_;
+        Message msg_;
+
+        work_impl(BasicSession& self, Message&& msg) : self_(self), msg_(std::move(msg)) {
+            this->recyclable = std::is_same_v<Message, StringResponse>;
+        }
+
+        void operator()() override {
+            if constexpr (std::is_same_v<Message, EventStreamResponse>)
+                std::make_shared<EventPump>(self_.shared_from_this(), std::move(msg_))->start();
+            else if constexpr (std::is_same_v<Message, VolumeDownloadResponse>)
+                std::make_shared<DownloadPump>(self_.shared_from_this(), std::move(msg_))->start();
+            else if constexpr (std::is_same_v<Message, VolumeUploadResponse>)
+                std::make_shared<UploadPump>(self_.shared_from_this(), std::move(msg_))->start();
+            else {
+                expire_after(self_.stream_, self_.m_gstore.get().config().http_write_timeout);
+                boost::beast::http::async_write(self_.stream_, msg_,
+                                                boost::asio::bind_executor(self_.strand_, std::bind(&BasicSession::on_write, self_.shared_from_this(),
+                                                                                                    std::placeholders::_1, std::placeholders::_2,
+                                                                                                    msg_.need_eof())));
+            }
+        }
+    };
+
+    // Writes the frames of an event subscription as they come, then ends the response and the connection
+    class EventPump : public std::enable_shared_from_this<EventPump> {
+        std::shared_ptr<BasicSession> self_;
+        boost::beast::http::response<boost::beast::http::empty_body> head_;
+        boost::beast::http::response_serializer<boost::beast::http::empty_body> serializer_{head_};
+        std::shared_ptr<EventHub::Subscription> sub_;
+        std::vector<EventHub::Frame> frames_; ///< being written
+        std::vector<boost::asio::const_buffer> buffers_;
+        boost::asio::steady_timer heartbeat_;
+        bool chunked_;
+        bool writing_ = false;
+
+      public:
+        EventPump(std::shared_ptr<BasicSession> self, EventStreamResponse&& msg)
+            : self_(std::move(self)), head_(std::move(msg.base())), sub_(std::move(msg.body())), heartbeat_(self_->strand_),
+              chunked_(head_.version() >= 11) {
+            head_.chunked(chunked_);
+        }
+
+        void start() {
+            writing_ = true;
+            expire_after(self_->stream_, write_timeout());
+            boost::beast::http::async_write_header(self_->stream_, serializer_,
+                                                   boost::asio::bind_executor(self_->strand_, [pump = this->shared_from_this()](
+                                                                                                  boost::beast::error_code ec, std::size_t) {
+                                                       pump->on_write(ec);
+                                                   }));
+        }
+
+      private:
+        [[nodiscard]] long write_timeout() const { return self_->m_gstore.get().config().http_write_timeout; }
+
+        void pump() {
+            if (writing_)
+                return;
+            frames_.clear();
+            const auto open = sub_->take(frames_, [weak = this->weak_from_this()] {
+                if (auto pump = weak.lock())
+                    boost::asio::post(pump->self_->strand_, [pump] { pump->pump(); });
+            });
+            if (!frames_.empty())
+                return write();
+            if (!open)
+                return finish();
+
+            // Keep the stream from looking idle to the client and the proxies in between, and notice when the client is gone
+            heartbeat_.expires_after(std::chrono::seconds{self_->m_gstore.get().config().events_heartbeat});
+            heartbeat_.async_wait(boost::asio::bind_executor(self_->strand_, [pump = this->shared_from_this()](boost::beast::error_code ec) {
+                if (ec || pump->writing_)
+                    return;
+                pump->frames_.assign(1, pump->self_->m_gstore.get().events.keep_alive_frame());
+                pump->write();
+            }));
+        }
+
+        void write() {
+            writing_ = true;
+            buffers_.clear();
+            for (const auto& frame : frames_)
+                buffers_.push_back(boost::asio::buffer(*frame));
+            expire_after(self_->stream_, write_timeout());
+            const auto handler = boost::asio::bind_executor(
+                self_->strand_, [pump = this->shared_from_this()](boost::beast::error_code ec, std::size_t) { pump->on_write(ec); });
+            if (chunked_)
+                boost::asio::async_write(self_->stream_, boost::beast::http::make_chunk(buffers_), handler);
+            else
+                boost::asio::async_write(self_->stream_, buffers_, handler);
+        }
+
+        void on_write(boost::beast::error_code ec) {
+            writing_ = false;
+            if (ec) {
+                heartbeat_.cancel();
+                return self_->on_write(ec, 0, true);
+            }
+            pump();
+        }
+
+        void finish() {
+            heartbeat_.cancel();
+            if (!chunked_)
+                return self_->on_write({}, 0, true);
+            writing_ = true;
+            expire_after(self_->stream_, write_timeout());
+            boost::asio::async_write(self_->stream_, boost::beast::http::make_chunk_last(),
+                                     boost::asio::bind_executor(self_->strand_, std::bind(&BasicSession::on_write, self_, std::placeholders::_1,
+                                                                                          std::placeholders::_2, true)));
+        }
+    };
+
+    // Writes the content of a volume as it is received, a buffer at a time, then lets the session go on with the next response
+    // Content of unknown length (sparse) is chunked for HTTP/1.1 clients, and delimited by closing the connection for the others;
+    // so is content followed by its digests, which go in the trailer of the last chunk
+    class DownloadPump : public std::enable_shared_from_this<DownloadPump> {
+        constexpr static std::size_t buffer_size = 64 * 1024;
+
+        std::shared_ptr<BasicSession> self_;
+        boost::beast::http::response<boost::beast::http::empty_body> head_;
+        boost::beast::http::response_serializer<boost::beast::http::empty_body> serializer_{head_};
+        std::shared_ptr<VolumeDownload> download_;
+        std::unique_ptr<char[]> buffer_;
+        bool chunked_;
+        boost::beast::http::fields trailer_;
+
+      public:
+        DownloadPump(std::shared_ptr<BasicSession> self, VolumeDownloadResponse&& msg)
+            : self_(std::move(self)), head_(std::move(msg.base())), download_(std::move(msg.body())), buffer_(new char[buffer_size]),
+              chunked_(head_.version() >= 11 && (!head_.has_content_length() || download_->digest)) {
+            // Not unconditionally, as setting it either way drops the Content-Length
+            if (chunked_)
+                head_.chunked(true);
+        }
+
+        void start() {
+            expire_after(self_->stream_, write_timeout());
+            boost::beast::http::async_write_header(self_->stream_, serializer_,
+                                                   boost::asio::bind_executor(self_->strand_, [pump = this->shared_from_this()](
+                                                                                                  boost::beast::error_code ec, std::size_t) {
+                                                       pump->on_write(ec);
+                                                   }));
+        }
+
+      private:
+        [[nodiscard]] long write_timeout() const { return self_->m_gstore.get().config().http_write_timeout; }
+
+        void pump() {
+            // Nothing else holds the pump while it waits for libvirt
+            const auto n = download_->read(buffer_.get(), buffer_size, [pump = this->shared_from_this()] {
+                boost::asio::post(pump->self_->strand_, [pump] { pump->pump(); });
+            });
+            if (n == VolumeDownload::would_block)
+                return;
+            // The header promised more than there will be; only closing the connection tells the client so
+            if (n < 0)
+                return self_->on_write({}, 0, true);
+            if (n == 0)
+                return finish();
+
+            expire_after(self_->stream_, write_timeout());
+            const auto handler = boost::asio::bind_executor(
+                self_->strand_, [pump = this->shared_from_this()](boost::beast::error_code ec, std::size_t) { pump->on_write(ec); });
+            const auto buffer = boost::asio::buffer(buffer_.get(), static_cast<std::size_t>(n));
+            if (chunked_)
+                boost::asio::async_write(self_->stream_, boost::beast::http::make_chunk(buffer), handler);
+            else
+                boost::asio::async_write(self_->stream_, buffer, handler);
+        }
+
+        void finish() {
+            // libvirt confirms that the content was whole over a call, made out of the strand; the content was all written already,
+            // hence only closing the connection (before the last chunk, if chunked) tells the client it was not
+            boost::asio::post(self_->stream_.get_executor(), [pump = this->shared_from_this()] {
+                const auto ok = pump->download_->finish();
+                boost::asio::post(pump->self_->strand_, [pump, ok] {
+                    if (!ok)
+                        return pump->self_->on_write({}, 0, true);
+                    pump->write_last();
+                });
+            });
+        }
+
+        void write_last() {
+            if (!chunked_)
+                return self_->on_write({}, 0, head_.need_eof());
+            if (download_->digest)
+                trailer_.set("Content-Digest", download_->digest.value());
+            expire_after(self_->stream_, write_timeout());
+            // The trailer is written out of the pump, which the write thus holds on to
+            boost::asio::async_write(self_->stream_, boost::beast::http::make_chunk_last(trailer_),
+                                     boost::asio::bind_executor(self_->strand_, [pump = this->shared_from_this()](boost::beast::error_code ec,
+                                                                                                                  std::size_t n) {
+                                         pump->self_->on_write(ec, n, pump->head_.need_eof());
+                                     }));
+        }
+
+        void on_write(boost::beast::error_code ec) {
+            if (ec)
+                return self_->on_write(ec, 0, true);
+            pump();
+        }
+    };
+
+    // Reads the body of an upload into the volume, a buffer at a time, then answers the request
+    // The buffer is filled by as many reads as it takes, so that libvirt gets the body in large messages rather than as it arrives
+    class UploadPump : public std::enable_shared_from_this<UploadPump> {
+        constexpr static std::size_t buffer_size = 256 * 1024;
+
+        std::shared_ptr<BasicSession> self_;
+        StringResponse res_;
+        boost::beast::http::response<boost::beast::http::empty_body> continue_;
+        std::shared_ptr<VolumeUpload> upload_;
+        AdmissionController::Ticket ticket_;
+        std::unique_ptr<char[]> buffer_;
+        std::size_t size_ = 0;  ///< bytes of the buffer filled with the body
+        std::size_t taken_ = 0; ///< bytes of those taken by libvirt
+
+      public:
+        UploadPump(std::shared_ptr<BasicSession> self, VolumeUploadResponse&& msg)
+            : self_(std::move(self)), res_(std::move(msg.base())), continue_(boost::beast::http::status::continue_, res_.version()),
+              upload_(std::move(msg.body().upload)), ticket_(std::move(msg.body().ticket)), buffer_(new char[buffer_size]) {}
+
+        void start() {
+            // The body goes through the read buffer of the session; the largest it may be makes for the fewest reads
+            self_->buffer_.reserve(self_->buffer_.max_size());
+
+            // The client may be waiting to be told to send the body
+            if (!boost::beast::iequals(self_->upload_parser_->get()[boost::beast::http::field::expect], "100-continue"))
+                return read();
+            expire_after(self_->stream_, write_timeout());
+            boost::beast::http::async_write(self_->stream_, continue_,
+                                            boost::asio::bind_executor(self_->strand_, [pump = this->shared_from_this()](
+                                                                                           boost::beast::error_code ec, std::size_t) {
+                                                if (ec)
+                                                    return pump->self_->on_write(ec, 0, true);
+                                                pump->read();
+                                            }));
+        }
+
+      private:
+        [[nodiscard]] long write_timeout() const { return self_->m_gstore.get().config().http_write_timeout; }
+
+        void read() {
+            auto& parser = *self_->upload_parser_;
+            if (parser.is_done() || size_ == buffer_size)
+                return write();
+
+            parser.get().body().data = buffer_.get() + size_;
+            parser.get().body().size = buffer_size - size_;
+            expire_after(self_->stream_, self_->m_gstore.get().config().http_body_timeout);
+            boost::beast::http::async_read_some(
+                self_->stream_, self_->buffer_, parser,
+                boost::asio::bind_executor(self_->strand_,
+                                           [pump = this->shared_from_this()](boost::beast::error_code ec, std::size_t) { pump->on_read(ec); }));
+        }
+
+        void on_read(boost::beast::error_code ec) {
+            // The buffer is full
+            if (ec == boost::beast::http::error::need_buffer)
+                ec = {};
+            if (ec == boost::beast::error::timeout)
+                return self_->m_gstore.get().sessions.timed_out();
+            if (ec)
+                return fail(ec, "read");
+
+            size_ = buffer_size - self_->upload_parser_->get().body().size;
+            read();
+        }
+
+        void write() {
+            while (taken_ < size_) {
+                // Nothing else holds the pump while it waits for libvirt
+                const auto n = upload_->write(buffer_.get() + taken_, size_ - taken_, [pump = this->shared_from_this()] {
+                    boost::asio::post(pump->self_->strand_, [pump] { pump->write(); });
+                });
+                if (n == VolumeUpload::would_block)
+                    return;
+                if (n < 0)
+                    return respond(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to upload the content'");
+                taken_ += static_cast<std::size_t>(n);
+            }
+            if (self_->upload_parser_->is_done())
+                return finish();
+            size_ = taken_ = 0;
+            read();
+        }
+
+        void finish() {
+            // The session may read the next request once this one is answered
+            self_->upload_parser_.reset();
+
+            // The content only turns out not to match the digests it came with once all of it went into the volume; the upload is aborted
+            // (along with the pump) rather than finished, but what libvirt already wrote stays, and the client is told so
+            if (!upload_->digest.matches())
+                return respond(boost::beast::http::status::bad_request,
+                               "The content does not match its Content-Digest; the content of the volume is now undefined");
+
+            // libvirt confirms the upload over a call, made out of the strand
+            boost::asio::post(self_->stream_.get_executor(), [pump = this->shared_from_this()] {
+                const auto ok = pump->upload_->finish();
+                boost::asio::post(pump->self_->strand_, [pump, ok] {
+                    if (!ok)
+                        return pump->respond(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to upload the content'");
+                    // The digests asked for, of the content as received
+                    if (pump->upload_->digest)
+                        pump->res_.set("X-Content-Digest", pump->upload_->digest.value());
+                    pump->respond(boost::beast::http::status::no_content, {});
+                });
+            });
+        }
+
+        // Answers with `status`, and `why` as the body if it failed
+        void respond(boost::beast::http::status status, std::string why) {
+            res_.result(status);
+            if (!why.empty()) {
+                res_.set(boost::beast::http::field::content_type, "text/html");
+                res_.body() = std::move(why);
+                // What is left of the body is still coming
+                if (self_->upload_parser_) {
+                    res_.keep_alive(false);
+                    self_->read_closed_ = true;
+                }
+            }
+            res_.prepare_payload();
+
+            expire_after(self_->stream_, write_timeout());
+            boost::beast::http::async_write(self_->stream_, res_,
+                                            boost::asio::bind_executor(self_->strand_, [pump = this->shared_from_this()](
+                                                                                           boost::beast::error_code ec, std::size_t n) {
+                                                pump->self_->on_write(ec, n, pump->res_.need_eof());
+                                            }));
+        }
+    };
+
     // This is the C++11 equivalent of a generic lambda.
     // The function object is used to send an HTTP message.
     struct SendLambda {
-        Session& self_;
-
-        explicit SendLambda(Session& self) : self_(self) {}
+        std::shared_ptr<BasicSession> self_;
+        std::uint64_t seq_; ///< position of the request in the pipeline
 
         template <bool isRequest, class Body, class Fields> void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg) const {
-            // The lifetime of the message has to extend
-            // for the duration of the async operation so
-            // we use a shared_ptr to manage it.
-            auto sp = std::make_shared<boost::beast::http::message<isRequest, Body, Fields>>(std::move(msg));
-
-            // Store a type-erased version of the shared
-            // pointer in the class to keep it alive.
-            self_.res_ = sp;
-
-            // Write the response
-            boost::beast::http::async_write(
-                self_.socket_, *sp,
-                boost::asio::bind_executor(self_.strand_, std::bind(&Session::on_write, self_.shared_from_this(), std::placeholders::_1,
-                                                                          std::placeholders::_2, sp->need_eof())));
+            // The work is made on the strand, which owns the recycled one
+            boost::asio::post(self_->strand_, [self = self_, seq = seq_, msg = std::move(msg)]() mutable {
+                self->on_handled(seq, self->make_work(std::move(msg)));
+            });
         }
     };
 
-    boost::asio::ip::tcp::socket socket_;
-    boost::asio::strand<boost::asio::ip::tcp::socket::executor_type> strand_;
+    // Reads which do not go through the stream, and hence are not timed by it
+    enum class ReadPhase {
+        none,   ///< no such read in progress
+        idle,   ///< waiting for the next request
+        header, ///< reading the header into the fixed buffer
+        body,   ///< reading the body into the fixed buffer
+    };
+
+    Stream stream_;
+    boost::asio::strand<typename Socket::executor_type> strand_;
+    boost::asio::steady_timer timer_; ///< times the reads which bypass the stream
+    ReadPhase phase_ = ReadPhase::none;
+    SessionCap::Slot session_slot_;
     boost::beast::flat_buffer buffer_;
     std::reference_wrapper<GeneralStore> m_gstore;
-    boost::beast::http::request<boost::beast::http::string_body> req_;
-    std::shared_ptr<void> res_;
-    SendLambda lambda_;
+    Request req_;
+    std::optional<boost::beast::http::request_parser<boost::beast::http::string_body>> parser_; ///< bounded parser of the request being read
+    std::optional<boost::beast::http::request_parser<boost::beast::http::buffer_body>> upload_parser_; ///< of the body of an upload
+    std::deque<std::unique_ptr<work>> queue_;               ///< one slot per request read and not yet answered, null until handled
+    std::uint64_t head_seq_ = 0;                            ///< sequence number of the request at the front of the queue
+    std::size_t in_handler_ = 0;                            ///< requests dispatched and not yet handled
+    // Unsafe request waiting for the ones before it to be handled, along with the length of its body if an upload
+    std::optional<std::tuple<std::uint64_t, Request, std::optional<unsigned long long>>> held_;
+    std::size_t depth_;                                     ///< maximum number of requests in the queue
+    bool reading_ = false;
+    bool writing_ = false;
+    bool barrier_ = false;                                  ///< an unsafe request is pending; stop reading until it has been handled
+    bool read_closed_ = false;                              ///< no further request will be read (end of stream, or Connection: close)
+    bool upgrading_ = false;                                ///< req_ upgrades the connection once the responses before it are written
+    bool trusted_;                                          ///< the peer was authenticated by the transport, and does not need the auth key
+    std::size_t idle_buffer_limit_;                         ///< capacity the buffers may keep while the connection is idle
+    std::unique_ptr<work_impl<StringResponse>> spare_;      ///< written response, kept for the next one
+#ifdef VIRTHTTP_IO_URING
+    // Reads go through this fixed buffer when one was available, and are parsed by hand
+    RegisteredBuffers::Slot slot_;
+#endif
 
   public:
-    // Take ownership of the socket
-    explicit Session(boost::asio::ip::tcp::socket socket, GeneralStore& gstore)
-        : socket_(std::move(socket)), strand_(socket_.get_executor()), m_gstore(gstore), lambda_(*this) {}
+    // Take ownership of the socket, along with whatever has already been read from it
+    explicit BasicSession(Socket socket, GeneralStore& gstore, boost::beast::flat_buffer buffer = {}, bool trusted = false)
+        : stream_(std::move(socket)), strand_(stream_.get_executor()), timer_(strand_), session_slot_(gstore.sessions.open()),
+          buffer_(std::move(buffer)), m_gstore(gstore),
+          depth_(static_cast<std::size_t>(std::max(1L, gstore.config().http_pipeline_depth))), trusted_(trusted),
+          idle_buffer_limit_(static_cast<std::size_t>(gstore.config().http_idle_buffer_limit)) {
+        // Room for a whole header, and then some for the body to go through; more could only be pipelined requests, which can wait
+        buffer_.max_size(std::max(buffer_.size(), static_cast<std::size_t>(gstore.config().http_header_limit) + 16 * 1024));
+#ifdef VIRTHTTP_IO_URING
+        slot_ = RegisteredBuffers::acquire(stream_.get_executor());
+#endif
+    }
 
     // Start the asynchronous operation
-    void run() { do_read(); }
+    void run() { boost::asio::dispatch(strand_, std::bind(&BasicSession::do_read, this->shared_from_this())); }
 
     void do_read() {
         // Make the request empty before reading,
         // otherwise the operation behavior is undefined.
         req_ = {};
+        reading_ = true;
+
+        const auto& config = m_gstore.get().config();
+        parser_.emplace();
+        // The body is bounded once the header tells it is not that of an upload
+        parser_->body_limit(std::numeric_limits<std::uint64_t>::max());
+        parser_->header_limit(static_cast<std::uint32_t>(config.http_header_limit));
+
+#ifdef VIRTHTTP_IO_URING
+        if (slot_)
+            return parse_buffered();
+#endif
+
+        // Until the next request starts arriving, the connection waits without a buffer, and without the header timeout running
+        if (buffer_.size() == 0) {
+            if (queue_.empty() && buffer_.capacity() > idle_buffer_limit_)
+                buffer_.shrink_to_fit();
+            enter(ReadPhase::idle);
+            return stream_.socket().async_wait(Socket::wait_read, boost::asio::bind_executor(strand_, std::bind(&BasicSession::on_readable,
+                                                                                                               this->shared_from_this(),
+                                                                                                               std::placeholders::_1)));
+        }
 
-        // Read a request
-        boost::beast::http::async_read(socket_, buffer_, req_,
-                                       boost::asio::bind_executor(
-                                           strand_, std::bind(&Session::on_read, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
+        do_async_read();
+    }
+
+    void on_readable(boost::beast::error_code ec) {
+        enter(ReadPhase::none);
+        if (ec)
+            return on_read(ec, 0);
+        do_async_read();
+    }
+
+    void do_async_read() {
+        // Read the header of a request, then its body, each within its own time
+        expire_after(stream_, m_gstore.get().config().http_header_timeout);
+        boost::beast::http::async_read_header(stream_, buffer_, *parser_,
+                                              boost::asio::bind_executor(strand_, std::bind(&BasicSession::on_read_header, this->shared_from_this(),
+                                                                                            std::placeholders::_1, std::placeholders::_2)));
+    }
+
+    void on_read_header(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        if (ec)
+            return on_read(ec, bytes_transferred);
+        if (!on_header())
+            return;
+        if (parser_->is_done())
+            return on_read(ec, bytes_transferred);
+
+        expire_after(stream_, m_gstore.get().config().http_body_timeout);
+        boost::beast::http::async_read(stream_, buffer_, *parser_,
+                                       boost::asio::bind_executor(strand_, std::bind(&BasicSession::on_read, this->shared_from_this(),
+                                                                                     std::placeholders::_1, std::placeholders::_2)));
+    }
+
+#ifdef VIRTHTTP_IO_URING
+    // Feeds the parser with what has been buffered already (e.g. pipelined requests), then reads more into the registered slot if needed
+    void parse_buffered() {
+        boost::beast::error_code ec;
+        while (buffer_.size() != 0 && !parser_->is_done()) {
+            const auto had_header = parser_->is_header_done();
+            buffer_.consume(parser_->put(buffer_.data(), ec));
+            if (ec == boost::beast::http::error::need_more) {
+                ec = {};
+                break;
+            }
+            if (ec)
+                return on_read(ec, 0);
+            // The header stops the parser, which then takes the body at once
+            if (!had_header && parser_->is_header_done()) {
+                if (!on_header())
+                    return;
+                parser_->eager(true);
+            }
+        }
+
+        if (parser_->is_done())
+            return on_read(ec, 0);
+
+        // Raw socket reads keep the buffer registered, but escape the timeouts of the stream
+        enter(!parser_->got_some() ? ReadPhase::idle : !parser_->is_header_done() ? ReadPhase::header : ReadPhase::body);
+        stream_.socket().async_read_some(slot_.buffer(),
+                                         boost::asio::bind_executor(strand_, std::bind(&BasicSession::on_read_fixed, this->shared_from_this(),
+                                                                                       std::placeholders::_1, std::placeholders::_2)));
+    }
+
+    void on_read_fixed(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        if (ec == boost::asio::error::eof)
+            ec = parser_->got_some() ? boost::beast::http::error::partial_message : boost::beast::http::error::end_of_stream;
+        if (ec)
+            return on_read(ec, 0);
+
+        const auto in = boost::asio::buffer(slot_.data(), bytes_transferred);
+        buffer_.commit(boost::asio::buffer_copy(buffer_.prepare(bytes_transferred), in));
+        parse_buffered();
+    }
+#endif
+
+    // Once the header of a request is read: hands the body over to an upload if it is the content of a volume, else bounds it
+    // Returns whether the request goes on being read
+    bool on_header() {
+        const auto& header = parser_->get();
+        if (header.method() == boost::beast::http::verb::put && is_volume_content(TargetParser{header.target()})) {
+            start_upload();
+            return false;
+        }
+
+        const auto limit = static_cast<std::uint64_t>(m_gstore.get().config().http_body_limit);
+        if (const auto length = parser_->content_length(); length && *length > limit) {
+            on_read(boost::beast::http::error::body_limit, 0);
+            return false;
+        }
+        parser_->body_limit(limit);
+        return true;
+    }
+
+    // Starts an upload once the requests before it are handled, like any mutation; its body is read once its turn to be answered comes
+    void start_upload() {
+        reading_ = false;
+        enter(ReadPhase::none);
+
+        upload_parser_.emplace(std::move(*parser_));
+        const auto length = upload_parser_->content_length().value_or(0);
+        Request req{upload_parser_->get().base()};
+
+        const auto seq = head_seq_ + queue_.size();
+        queue_.emplace_back();
+        if (!req.keep_alive())
+            read_closed_ = true;
+
+        barrier_ = true;
+        if (in_handler_ == 0)
+            dispatch(seq, std::move(req), length);
+        else
+            held_.emplace(seq, std::move(req), length);
     }
 
     void on_read(boost::beast::error_code ec, std::size_t bytes_transferred) {
         boost::ignore_unused(bytes_transferred);
+        reading_ = false;
+        enter(ReadPhase::none);
+
+        // The stream timed out and closed the socket; or the timer did, and cancelled the read
+        if (ec == boost::beast::error::timeout)
+            return m_gstore.get().sessions.timed_out();
+        if (ec == boost::asio::error::operation_aborted)
+            return;
 
         // This means they closed the connection
-        if (ec == boost::beast::http::error::end_of_stream)
-            return do_close();
+        if (ec == boost::beast::http::error::end_of_stream) {
+            read_closed_ = true;
+            if (queue_.empty())
+                do_close();
+            return;
+        }
+
+        if (ec == boost::beast::http::error::body_limit)
+            return refuse(boost::beast::http::status::payload_too_large);
+        if (ec == boost::beast::http::error::header_limit)
+            return refuse(boost::beast::http::status::request_header_fields_too_large);
 
         if (ec)
             return fail(ec, "read");
 
-        // Send the response
-        handle_request(m_gstore, std::move(req_), lambda_);
+        req_ = parser_->release();
+
+        // An upgrade is a barrier: nothing after it is read, and the connection is handed over once the responses before it are written
+        if (is_upgrade()) {
+            if (queue_.empty())
+                return upgrade();
+            upgrading_ = true;
+            return;
+        }
+
+        const auto seq = head_seq_ + queue_.size();
+        queue_.emplace_back();
+        if (!req_.keep_alive())
+            read_closed_ = true;
+        // Whatever follows an event stream would never be answered, hence is not even read
+        if (req_.method() == boost::beast::http::verb::get && is_event_stream(TargetParser{req_.target()}))
+            read_closed_ = true;
+
+        const auto method = req_.method();
+        if (method == boost::beast::http::verb::get || method == boost::beast::http::verb::head)
+            dispatch(seq, std::move(req_));
+        else {
+            barrier_ = true;
+            if (in_handler_ == 0)
+                dispatch(seq, std::move(req_));
+            else
+                held_.emplace(seq, std::move(req_), std::nullopt);
+        }
+
+        maybe_read();
     }
 
     void on_write(boost::beast::error_code ec, std::size_t bytes_transferred, bool close) {
         boost::ignore_unused(bytes_transferred);
+        writing_ = false;
 
+        if (ec == boost::beast::error::timeout)
+            return m_gstore.get().sessions.timed_out();
         if (ec)
             return fail(ec, "write");
 
@@ -87,18 +688,199 @@ class Session : public std::enable_shared_from_this<Session> {
             return do_close();
         }
 
-        // We're done with the response so delete it
-        res_ = nullptr;
+        // We're done with the response; keep it for the next one if possible, else delete it
+        if (auto& w = queue_.front(); w->recyclable && !spare_) {
+            spare_.reset(static_cast<work_impl<StringResponse>*>(w.release()));
+            spare_->msg_ = {};
+        }
+        queue_.pop_front();
+        ++head_seq_;
+
+        if (queue_.empty() && upgrading_)
+            return upgrade();
+        if (queue_.empty() && read_closed_)
+            return do_close();
+
+        // The client has all its responses; from now on, waiting for it counts as idle
+        if (queue_.empty() && phase_ == ReadPhase::idle)
+            arm_timer();
+
+        // Read another request, and send the next response if it is ready
+        maybe_read();
+        maybe_write();
+    }
+
+    // Whether the request read asks for the connection to be handed over to another protocol
+    [[nodiscard]] bool is_upgrade() const {
+#ifdef VIRTHTTP_WITH_HTTP2
+        if constexpr (std::is_same_v<Socket, boost::asio::ip::tcp::socket>) {
+            if (m_gstore.get().config().http2 && is_h2c_upgrade())
+                return true;
+        }
+#endif
+        if (req_.count(boost::beast::http::field::upgrade) == 0)
+            return false;
+        return BasicGraphicsSession<Socket>::is_graphics(TargetParser{req_.target()}) || boost::beast::websocket::is_upgrade(req_);
+    }
+
+    // Hands the connection over to the session of the protocol the request read upgrades to
+    void upgrade() {
+#ifdef VIRTHTTP_WITH_HTTP2
+        if constexpr (std::is_same_v<Socket, boost::asio::ip::tcp::socket>) {
+            if (m_gstore.get().config().http2 && is_h2c_upgrade())
+                return do_upgrade();
+        }
+#endif
+        const TargetParser target{req_.target()};
+        if (BasicGraphicsSession<Socket>::is_graphics(target))
+            return std::make_shared<BasicGraphicsSession<Socket>>(stream_.release_socket(), m_gstore, std::move(buffer_), trusted_)
+                ->run(std::move(req_));
+        if (BasicConsoleSession<Socket>::is_console(target))
+            return std::make_shared<BasicConsoleSession<Socket>>(stream_.release_socket(), m_gstore, trusted_)->run(std::move(req_));
+        std::make_shared<BasicWebSocketSession<Socket>>(stream_.release_socket(), m_gstore, trusted_)->run(std::move(req_));
+    }
+
+#ifdef VIRTHTTP_WITH_HTTP2
+    // Whether the client asks to switch to HTTP/2 over cleartext (RFC 7540 §3.2)
+    [[nodiscard]] bool is_h2c_upgrade() const {
+        return boost::beast::iequals(req_[boost::beast::http::field::upgrade], "h2c") && req_.count(http2_settings_field) == 1;
+    }
+
+    // Answers 101 Switching Protocols, then hands the connection and the request over to an Http2Session
+    void do_upgrade() {
+        auto sp = std::make_shared<boost::beast::http::response<boost::beast::http::empty_body>>(boost::beast::http::status::switching_protocols,
+                                                                                                 req_.version());
+        sp->set(boost::beast::http::field::connection, "Upgrade");
+        sp->set(boost::beast::http::field::upgrade, "h2c");
 
-        // Read another request
-        do_read();
+        expire_after(stream_, m_gstore.get().config().http_write_timeout);
+        boost::beast::http::async_write(
+            stream_, *sp, boost::asio::bind_executor(strand_, [self = this->shared_from_this(), sp](boost::beast::error_code ec, std::size_t) {
+                if (ec)
+                    return fail(ec, "write");
+                const std::string settings{self->req_[http2_settings_field]};
+                std::make_shared<Http2Session>(self->stream_.release_socket(), self->m_gstore, std::move(self->buffer_))
+                    ->run_upgraded(std::move(self->req_), settings);
+            }));
     }
+#endif
 
     void do_close() {
         // Send a TCP shutdown
         boost::beast::error_code ec;
-        socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+        stream_.socket().shutdown(Socket::shutdown_send, ec);
 
         // At this point the connection is closed gracefully
     }
+
+  private:
+    // Handles a request on the io_context, concurrently with the other sessions and the other safe requests of this one
+    // An upload comes with the length of its body (0 if unknown), which is yet to be read
+    void dispatch(std::uint64_t seq, Request req, std::optional<unsigned long long> upload = std::nullopt) {
+        ++in_handler_;
+        boost::asio::post(stream_.get_executor(), [self = this->shared_from_this(), seq, req = std::move(req), upload]() mutable {
+            if (upload)
+                return handle_volume_upload(self->m_gstore, self->stream_.get_executor(), std::move(req), *upload, SendLambda{self, seq},
+                                            self->trusted_);
+            handle_request(self->m_gstore, self->stream_.get_executor(), std::move(req), SendLambda{self, seq}, self->trusted_);
+        });
+    }
+
+    // Wraps a response to be queued, in the recycled work when there is one
+    template <class Message> std::unique_ptr<work> make_work(Message&& msg) {
+        if constexpr (std::is_same_v<Message, StringResponse>) {
+            if (spare_) {
+                spare_->msg_ = std::move(msg);
+                return std::move(spare_);
+            }
+        }
+        return std::make_unique<work_impl<Message>>(*this, std::move(msg));
+    }
+
+    // Answers a request that could not be read in full, then stops reading, as what follows in the stream is unknown
+    void refuse(boost::beast::http::status status) {
+        read_closed_ = true;
+        const auto seq = head_seq_ + queue_.size();
+        queue_.emplace_back();
+        ++in_handler_;
+
+        boost::beast::http::response<boost::beast::http::string_body> res{status, parser_->get().version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.keep_alive(false);
+        res.prepare_payload();
+        SendLambda{this->shared_from_this(), seq}(std::move(res));
+    }
+
+    // Back on the strand with the response of a request
+    void on_handled(std::uint64_t seq, std::unique_ptr<work> w) {
+        queue_[seq - head_seq_] = std::move(w);
+        --in_handler_;
+
+        if (in_handler_ == 0) {
+            if (held_) {
+                auto [held_seq, held_req, held_upload] = std::move(*held_);
+                held_.reset();
+                dispatch(held_seq, std::move(held_req), held_upload);
+            } else
+                barrier_ = false;
+        }
+
+        maybe_read();
+        maybe_write();
+    }
+
+    // Enters a phase of the reads timed by timer_, arming it anew unless already in that phase
+    void enter(ReadPhase phase) {
+        if (std::exchange(phase_, phase) != phase)
+            arm_timer();
+    }
+
+    // Arms timer_ for the current phase; waiting for the next request is only timed once every response has been written,
+    // as the client may just be waiting for them
+    void arm_timer() {
+        const auto& config = m_gstore.get().config();
+        long seconds = 0;
+        switch (phase_) {
+        case ReadPhase::none:
+            break;
+        case ReadPhase::idle:
+            seconds = queue_.empty() ? config.http_idle_timeout : 0;
+            break;
+        case ReadPhase::header:
+            seconds = config.http_header_timeout;
+            break;
+        case ReadPhase::body:
+            seconds = config.http_body_timeout;
+            break;
+        }
+
+        if (seconds <= 0) {
+            timer_.expires_at(boost::asio::steady_timer::time_point::max());
+            return;
+        }
+        timer_.expires_after(std::chrono::seconds{seconds});
+        timer_.async_wait(boost::asio::bind_executor(strand_, std::bind(&BasicSession::on_timer, this->shared_from_this(), std::placeholders::_1)));
+    }
+
+    void on_timer(boost::beast::error_code ec) {
+        // Cancelled, or rearmed after expiring
+        if (ec || timer_.expiry() > boost::asio::steady_timer::clock_type::now())
+            return;
+        m_gstore.get().sessions.timed_out();
+        stream_.close();
+    }
+
+    void maybe_read() {
+        if (!reading_ && !read_closed_ && !upgrading_ && !barrier_ && !upload_parser_ && queue_.size() < depth_)
+            do_read();
+    }
+
+    void maybe_write() {
+        if (!writing_ && !queue_.empty() && queue_.front()) {
+            writing_ = true;
+            (*queue_.front())();
+        }
+    }
 };
+
+using Session = BasicSession<boost::asio::ip::tcp::socket>;
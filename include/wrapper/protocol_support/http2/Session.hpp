@@ -0,0 +1,602 @@
+#pragma once
+
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <nghttp2/nghttp2.h>
+#include "../../events.hpp"
+#include "../../general_store.hpp"
+#include "../../volume_transfer.hpp"
+#include "logger.hpp"
+#include "small_vector.hpp"
+#include "../beast_internals.hpp"
+#include "../registered_buffers.hpp"
+#include "../request_handler.hpp"
+
+/**
+ * \internal
+ * Connection preface every HTTP/2 client starts with, whether it knew the server spoke HTTP/2 or upgraded to it
+ **/
+constexpr std::string_view http2_client_preface{NGHTTP2_CLIENT_MAGIC, NGHTTP2_CLIENT_MAGIC_LEN};
+
+/**
+ * \internal
+ * Name of the HTTP/1.1 header carrying the client's SETTINGS in an `Upgrade: h2c` request
+ **/
+constexpr std::string_view http2_settings_field = "HTTP2-Settings";
+
+/**
+ * \internal
+ * Decodes the base64url (RFC 4648 §5, padding optional) encoding used by the `HTTP2-Settings` header
+ *
+ * \param[in] in the encoded string
+ * \return the decoded bytes, or nothing if `in` is not base64url
+ **/
+inline std::optional<std::string> base64url_decode(std::string_view in) {
+    std::string out;
+    out.reserve(in.size() * 3 / 4);
+    std::uint32_t acc = 0;
+    int bits = 0;
+    for (const char c : in) {
+        std::uint32_t v;
+        if (c >= 'A' && 'Z' >= c)
+            v = c - 'A';
+        else if (c >= 'a' && 'z' >= c)
+            v = c - 'a' + 26;
+        else if (c >= '0' && '9' >= c)
+            v = c - '0' + 52;
+        else if (c == '-')
+            v = 62;
+        else if (c == '_')
+            v = 63;
+        else if (c == '=')
+            break;
+        else
+            return std::nullopt;
+        acc = (acc << 6u) | v;
+        bits += 6;
+        if (bits >= 8) {
+            bits -= 8;
+            out.push_back(static_cast<char>((acc >> static_cast<unsigned>(bits)) & 0xFFu));
+        }
+    }
+    return out;
+}
+
+/**
+ * \internal
+ * Handles an HTTP/2 server connection over cleartext TCP (h2c)
+ *
+ * nghttp2 takes care of the framing, HPACK and flow control, all on the strand of the session.
+ * Each stream is turned into a Beast request once complete, and handed to `handle_request` on the io_context itself rather than the strand,
+ * so that the streams of a single connection are served concurrently instead of one after the other.
+ * Responses come back to the strand to be submitted, in whatever order they complete.
+ * The connection is closed once it stays without open streams for longer than `idle-timeout`, or writing to it takes longer than `write-timeout`.
+ * An event stream is a response whose data is deferred until events come in, which leaves the other streams of the connection usable.
+ * So is a volume download, whose content is received from libvirt straight into the DATA frames, as fast as flow control lets them out.
+ **/
+class Http2Session : public std::enable_shared_from_this<Http2Session> {
+    using Request = boost::beast::http::request<boost::beast::http::string_body>;
+    constexpr static std::size_t read_size = 16 * 1024;
+
+    /**
+     * \internal
+     * Response of a stream, in the form handed over to nghttp2
+     **/
+    struct Response {
+        std::vector<std::pair<std::string, std::string>> headers; ///< lowercase names, `:status` first
+        std::string body;
+        std::size_t sent = 0;                                ///< how much of the body has been framed so far
+        std::shared_ptr<EventHub::Subscription> events = {}; ///< refills the body as events come in, if an event stream
+        std::shared_ptr<VolumeDownload> download = {};       ///< fills the DATA frames as the content comes in, if a volume download
+        bool finishing = false;                              ///< the download was all received, and is being finished
+    };
+
+    /**
+     * \internal
+     * State of an open stream
+     **/
+    struct Stream {
+        Request req;
+        Response res;
+        std::size_t header_size = 0; ///< as accounted for SETTINGS_MAX_HEADER_LIST_SIZE
+        bool rejected = false;       ///< reset by us; nothing more to do but wait for the close
+    };
+
+    /**
+     * \internal
+     * Send functor passed to `handle_request` for a stream; runs on whichever thread handled the request
+     **/
+    struct StreamSend {
+        std::shared_ptr<Http2Session> self_;
+        std::int32_t stream_id_;
+
+        template <bool isRequest, class Body, class Fields> void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg) const {
+            Response res;
+            res.headers.emplace_back(":status", std::to_string(msg.result_int()));
+            for (const auto& field : msg) {
+                std::string name{field.name_string()};
+                std::transform(name.begin(), name.end(), name.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+                // Connection-specific header fields are forbidden in HTTP/2 (RFC 7540 §8.1.2.2)
+                if (name == "connection" || name == "keep-alive" || name == "proxy-connection" || name == "transfer-encoding" || name == "upgrade")
+                    continue;
+                res.headers.emplace_back(std::move(name), std::string{field.value()});
+            }
+            if constexpr (std::is_same_v<Body, EventStreamBody>)
+                res.events = std::move(msg.body());
+            else if constexpr (std::is_same_v<Body, VolumeDownloadBody>)
+                res.download = std::move(msg.body());
+            else if constexpr (std::is_same_v<typename Body::value_type, std::string>)
+                res.body = std::move(msg.body());
+
+            boost::asio::post(self_->strand_, [self = self_, stream_id = stream_id_, res = std::move(res)]() mutable {
+                self->submit(stream_id, std::move(res));
+            });
+        }
+    };
+
+    boost::beast::tcp_stream stream_;
+    boost::asio::strand<boost::beast::tcp_stream::executor_type> strand_;
+    boost::asio::steady_timer idle_timer_; ///< runs while there is no open stream
+    SessionCap::Slot session_slot_;
+    boost::beast::flat_buffer buffer_;
+    std::reference_wrapper<GeneralStore> m_gstore;
+    std::size_t body_limit_;        ///< `body-limit` of the configuration
+    std::size_t header_limit_;      ///< `header-limit` of the configuration
+    std::size_t idle_buffer_limit_; ///< `idle-buffer-limit` of the configuration
+    std::unique_ptr<nghttp2_session, decltype(&nghttp2_session_del)> session_{nullptr, &nghttp2_session_del};
+    std::unordered_map<std::int32_t, std::unique_ptr<Stream>> streams_;
+    std::string out_;
+    bool writing_ = false;
+    bool closed_ = false;
+#ifdef VIRTHTTP_IO_URING
+    RegisteredBuffers::Slot slot_; ///< fixed buffer reads go through, if one was available
+#endif
+
+  public:
+    /**
+     * \internal
+     * Takes ownership of the socket, along with whatever has already been read from it (e.g. the preface, when detecting the protocol)
+     **/
+    Http2Session(boost::asio::ip::tcp::socket socket, GeneralStore& gstore, boost::beast::flat_buffer buffer = {})
+        : stream_(std::move(socket)), strand_(stream_.get_executor()), idle_timer_(strand_), session_slot_(gstore.sessions.open()),
+          buffer_(std::move(buffer)), m_gstore(gstore),
+          body_limit_(static_cast<std::size_t>(gstore.config().http_body_limit)),
+          header_limit_(static_cast<std::size_t>(gstore.config().http_header_limit)),
+          idle_buffer_limit_(static_cast<std::size_t>(gstore.config().http_idle_buffer_limit)) {
+#ifdef VIRTHTTP_IO_URING
+        slot_ = RegisteredBuffers::acquire(stream_.get_executor());
+#endif
+    }
+
+    /**
+     * \internal
+     * Starts serving a connection whose client sent the HTTP/2 preface right away ("prior knowledge")
+     **/
+    void run() {
+        if (!init())
+            return do_close();
+        boost::asio::dispatch(strand_, [self = shared_from_this()] { self->start(); });
+    }
+
+    /**
+     * \internal
+     * Starts serving a connection upgraded from HTTP/1.1, once the 101 response has been written
+     *
+     * \param[in] req the request which carried the upgrade; it becomes stream 1
+     * \param[in] settings the value of its `HTTP2-Settings` header
+     **/
+    void run_upgraded(Request req, std::string_view settings) {
+        const auto payload = base64url_decode(settings);
+        if (!payload || !init())
+            return do_close();
+        const auto head = req.method() == boost::beast::http::verb::head;
+        const auto* const data = reinterpret_cast<const std::uint8_t*>(payload->data());
+        if (const auto rv = nghttp2_session_upgrade2(session_.get(), data, payload->size(), head, nullptr); rv != 0) {
+            logger.error("HTTP/2 upgrade: ", nghttp2_strerror(rv));
+            return do_close();
+        }
+        streams_.emplace(1, std::make_unique<Stream>());
+        dispatch(1, std::move(req));
+        boost::asio::dispatch(strand_, [self = shared_from_this()] { self->start(); });
+    }
+
+  private:
+    bool init() {
+        nghttp2_session_callbacks* callbacks;
+        if (nghttp2_session_callbacks_new(&callbacks) != 0)
+            return false;
+        nghttp2_session_callbacks_set_on_begin_headers_callback(callbacks, &Http2Session::on_begin_headers);
+        nghttp2_session_callbacks_set_on_header_callback(callbacks, &Http2Session::on_header);
+        nghttp2_session_callbacks_set_on_data_chunk_recv_callback(callbacks, &Http2Session::on_data_chunk_recv);
+        nghttp2_session_callbacks_set_on_frame_recv_callback(callbacks, &Http2Session::on_frame_recv);
+        nghttp2_session_callbacks_set_on_stream_close_callback(callbacks, &Http2Session::on_stream_close);
+
+        nghttp2_session* session;
+        const auto rv = nghttp2_session_server_new(&session, callbacks, this);
+        nghttp2_session_callbacks_del(callbacks);
+        if (rv != 0)
+            return false;
+        session_.reset(session);
+
+        const auto max_streams = static_cast<std::uint32_t>(std::max(1L, m_gstore.get().config().http2_max_streams));
+        // A stream may send its whole body at once, but no more
+        const auto window = static_cast<std::uint32_t>(std::min<std::size_t>(body_limit_, NGHTTP2_MAX_WINDOW_SIZE));
+        const nghttp2_settings_entry settings[] = {{NGHTTP2_SETTINGS_MAX_CONCURRENT_STREAMS, max_streams},
+                                                   {NGHTTP2_SETTINGS_INITIAL_WINDOW_SIZE, window},
+                                                   {NGHTTP2_SETTINGS_MAX_HEADER_LIST_SIZE, static_cast<std::uint32_t>(header_limit_)}};
+        return nghttp2_submit_settings(session_.get(), NGHTTP2_FLAG_NONE, settings, std::size(settings)) == 0;
+    }
+
+    void start() {
+        watch_idle();
+        if (buffer_.size() != 0 && !consume())
+            return;
+        do_write();
+        do_read();
+    }
+
+    void do_read() {
+#ifdef VIRTHTTP_IO_URING
+        if (slot_)
+            return stream_.socket().async_read_some(slot_.buffer(), boost::asio::bind_executor(strand_, std::bind(&Http2Session::on_read_fixed,
+                                                                                                         shared_from_this(), std::placeholders::_1,
+                                                                                                         std::placeholders::_2)));
+#endif
+        // A connection without open streams waits for its next frames without a buffer
+        if (streams_.empty() && buffer_.size() == 0) {
+            if (buffer_.capacity() > idle_buffer_limit_)
+                buffer_.shrink_to_fit();
+            if (!writing_ && out_.capacity() > idle_buffer_limit_)
+                std::string{}.swap(out_);
+            return stream_.socket().async_wait(
+                boost::asio::ip::tcp::socket::wait_read,
+                boost::asio::bind_executor(strand_, std::bind(&Http2Session::on_readable, shared_from_this(), std::placeholders::_1)));
+        }
+        do_read_some();
+    }
+
+    void on_readable(boost::beast::error_code ec) {
+        if (ec)
+            return on_read(ec, 0);
+        do_read_some();
+    }
+
+    void do_read_some() {
+        // Reads are not timed: the client may well be waiting for responses; idle_timer_ covers the time without any
+        stream_.expires_never();
+        stream_.async_read_some(buffer_.prepare(read_size),
+                                boost::asio::bind_executor(strand_, std::bind(&Http2Session::on_read, shared_from_this(), std::placeholders::_1,
+                                                                              std::placeholders::_2)));
+    }
+
+    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        // This means they closed the connection, or we did as it stayed idle
+        if (ec == boost::asio::error::eof || ec == boost::asio::error::operation_aborted)
+            return do_close();
+
+        if (ec)
+            return fail(ec, "read");
+
+        buffer_.commit(bytes_transferred);
+        if (!consume())
+            return;
+        do_write();
+        if (nghttp2_session_want_read(session_.get()))
+            do_read();
+    }
+
+#ifdef VIRTHTTP_IO_URING
+    // Same as on_read, but nghttp2 is fed straight from the registered slot
+    void on_read_fixed(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        if (ec == boost::asio::error::eof || ec == boost::asio::error::operation_aborted)
+            return do_close();
+
+        if (ec)
+            return fail(ec, "read");
+
+        if (!feed(slot_.data(), bytes_transferred))
+            return;
+        do_write();
+        if (nghttp2_session_want_read(session_.get()))
+            do_read();
+    }
+#endif
+
+    // Feeds everything buffered to nghttp2
+    bool consume() {
+        const auto data = buffer_.data();
+        if (!feed(data.data(), data.size()))
+            return false;
+        buffer_.consume(data.size());
+        return true;
+    }
+
+    // Feeds bytes to nghttp2, which calls back into the on_* functions below
+    bool feed(const void* data, std::size_t size) {
+        const auto rv = nghttp2_session_mem_recv(session_.get(), static_cast<const std::uint8_t*>(data), size);
+        if (rv < 0) {
+            logger.error("HTTP/2 receive: ", nghttp2_strerror(static_cast<int>(rv)));
+            do_close();
+            return false;
+        }
+        return true;
+    }
+
+    void do_write() {
+        if (writing_ || closed_)
+            return;
+
+        out_.clear();
+        for (;;) {
+            const std::uint8_t* data;
+            const auto n = nghttp2_session_mem_send(session_.get(), &data);
+            if (n < 0) {
+                logger.error("HTTP/2 send: ", nghttp2_strerror(static_cast<int>(n)));
+                return do_close();
+            }
+            if (n == 0)
+                break;
+            out_.append(reinterpret_cast<const char*>(data), static_cast<std::size_t>(n));
+        }
+
+        if (out_.empty()) {
+            if (!nghttp2_session_want_read(session_.get()) && !nghttp2_session_want_write(session_.get()))
+                do_close();
+            return;
+        }
+
+        writing_ = true;
+        expire_after(stream_, m_gstore.get().config().http_write_timeout);
+        boost::asio::async_write(stream_, boost::asio::buffer(out_),
+                                 boost::asio::bind_executor(strand_, std::bind(&Http2Session::on_write, shared_from_this(), std::placeholders::_1,
+                                                                               std::placeholders::_2)));
+    }
+
+    void on_write(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+        writing_ = false;
+
+        if (ec == boost::beast::error::timeout) {
+            closed_ = true;
+            return m_gstore.get().sessions.timed_out();
+        }
+        if (ec)
+            return fail(ec, "write");
+
+        do_write();
+    }
+
+    // Arms idle_timer_ if there is no open stream, else disarms it
+    void watch_idle() {
+        const auto seconds = m_gstore.get().config().http_idle_timeout;
+        if (!streams_.empty() || seconds <= 0) {
+            idle_timer_.expires_at(boost::asio::steady_timer::time_point::max());
+            return;
+        }
+        idle_timer_.expires_after(std::chrono::seconds{seconds});
+        idle_timer_.async_wait(boost::asio::bind_executor(strand_, std::bind(&Http2Session::on_idle, shared_from_this(), std::placeholders::_1)));
+    }
+
+    void on_idle(boost::beast::error_code ec) {
+        // Cancelled, or rearmed after expiring
+        if (ec || closed_ || idle_timer_.expiry() > boost::asio::steady_timer::clock_type::now())
+            return;
+        m_gstore.get().sessions.timed_out();
+        closed_ = true;
+        stream_.close();
+    }
+
+    void do_close() {
+        if (std::exchange(closed_, true))
+            return;
+
+        // Send a TCP shutdown
+        boost::beast::error_code ec;
+        stream_.socket().shutdown(boost::asio::ip::tcp::socket::shutdown_send, ec);
+
+        // At this point the connection is closed gracefully
+    }
+
+    // Hands a complete request over to the io_context
+    void dispatch(std::int32_t stream_id, Request req) {
+        req.version(11);
+        boost::asio::post(stream_.get_executor(), [self = shared_from_this(), stream_id, req = std::move(req)]() mutable {
+            handle_request(self->m_gstore, self->stream_.get_executor(), std::move(req), StreamSend{self, stream_id});
+        });
+    }
+
+    // Submits the response of a stream, unless the stream was reset in the meantime
+    void submit(std::int32_t stream_id, Response res) {
+        const auto it = streams_.find(stream_id);
+        if (closed_ || it == streams_.end())
+            return;
+        auto& stream = *it->second;
+        stream.res = std::move(res);
+
+        const auto as_bytes = [](const std::string& s) { return reinterpret_cast<std::uint8_t*>(const_cast<char*>(s.data())); };
+        SmallVector<nghttp2_nv, 16> nva;
+        for (const auto& [name, value] : stream.res.headers)
+            nva.push_back(nghttp2_nv{as_bytes(name), as_bytes(value), name.size(), value.size(), NGHTTP2_NV_FLAG_NONE});
+
+        nghttp2_data_provider provider{};
+        provider.source.ptr = &stream;
+        provider.read_callback = &Http2Session::on_data_source_read;
+        const auto has_data = !stream.res.body.empty() || stream.res.events || stream.res.download;
+        if (const auto rv = nghttp2_submit_response(session_.get(), stream_id, nva.data(), nva.size(), has_data ? &provider : nullptr); rv != 0)
+            nghttp2_submit_rst_stream(session_.get(), NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_INTERNAL_ERROR);
+        do_write();
+    }
+
+    // Replaces the body of an event stream with the frames which came in since; false once the subscription is over
+    bool refill(std::int32_t stream_id, Response& res) {
+        std::vector<EventHub::Frame> frames;
+        const auto open = res.events->take(frames, resumer(stream_id));
+        res.body.clear();
+        res.sent = 0;
+        for (const auto& frame : frames)
+            res.body += *frame;
+        return open;
+    }
+
+    // Waker of a stream whose data was deferred, resuming it; may be called from any thread
+    std::function<void()> resumer(std::int32_t stream_id) {
+        return [weak = weak_from_this(), stream_id] {
+            if (auto self = weak.lock())
+                boost::asio::post(self->strand_, [self, stream_id] {
+                    if (!self->closed_ && self->find_stream(stream_id) && nghttp2_session_resume_data(self->session_.get(), stream_id) == 0)
+                        self->do_write();
+                });
+        };
+    }
+
+    Stream* find_stream(std::int32_t stream_id) noexcept {
+        const auto it = streams_.find(stream_id);
+        return it == streams_.end() ? nullptr : it->second.get();
+    }
+
+    static bool is_request_headers(const nghttp2_frame* frame) noexcept {
+        return frame->hd.type == NGHTTP2_HEADERS && frame->headers.cat == NGHTTP2_HCAT_REQUEST;
+    }
+
+    static int on_begin_headers(nghttp2_session*, const nghttp2_frame* frame, void* user_data) {
+        if (!is_request_headers(frame))
+            return 0;
+        auto& self = *static_cast<Http2Session*>(user_data);
+        self.streams_.emplace(frame->hd.stream_id, std::make_unique<Stream>());
+        if (self.streams_.size() == 1)
+            self.watch_idle();
+        return 0;
+    }
+
+    static int on_header(nghttp2_session*, const nghttp2_frame* frame, const std::uint8_t* name, std::size_t namelen, const std::uint8_t* value,
+                         std::size_t valuelen, std::uint8_t, void* user_data) {
+        auto& self = *static_cast<Http2Session*>(user_data);
+        auto* const stream = self.find_stream(frame->hd.stream_id);
+        if (!is_request_headers(frame) || !stream || stream->rejected)
+            return 0;
+
+        // Same accounting as SETTINGS_MAX_HEADER_LIST_SIZE (RFC 7540 §6.5.2); past it, the stream is reset
+        stream->header_size += namelen + valuelen + 32;
+        if (stream->header_size > self.header_limit_) {
+            stream->rejected = true;
+            return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+        }
+
+        const std::string_view n{reinterpret_cast<const char*>(name), namelen};
+        const std::string_view v{reinterpret_cast<const char*>(value), valuelen};
+        auto& req = stream->req;
+        if (n == ":method")
+            req.method_string(v);
+        else if (n == ":path")
+            req.target(v);
+        else if (n == ":authority")
+            req.set(boost::beast::http::field::host, v);
+        else if (n.front() != ':')
+            req.insert(n, v);
+        return 0;
+    }
+
+    static int on_data_chunk_recv(nghttp2_session* session, std::uint8_t, std::int32_t stream_id, const std::uint8_t* data, std::size_t len,
+                                  void* user_data) {
+        auto& self = *static_cast<Http2Session*>(user_data);
+        auto* const stream = self.find_stream(stream_id);
+        if (!stream || stream->rejected)
+            return 0;
+
+        auto& body = stream->req.body();
+        if (body.size() + len > self.body_limit_) {
+            stream->rejected = true;
+            body.clear();
+            return nghttp2_submit_rst_stream(session, NGHTTP2_FLAG_NONE, stream_id, NGHTTP2_REFUSED_STREAM);
+        }
+        body.append(reinterpret_cast<const char*>(data), len);
+        return 0;
+    }
+
+    static int on_frame_recv(nghttp2_session*, const nghttp2_frame* frame, void* user_data) {
+        if ((frame->hd.type != NGHTTP2_HEADERS && frame->hd.type != NGHTTP2_DATA) || !(frame->hd.flags & NGHTTP2_FLAG_END_STREAM))
+            return 0;
+
+        auto& self = *static_cast<Http2Session*>(user_data);
+        auto* const stream = self.find_stream(frame->hd.stream_id);
+        if (stream && !stream->rejected)
+            self.dispatch(frame->hd.stream_id, std::move(stream->req));
+        return 0;
+    }
+
+    static int on_stream_close(nghttp2_session*, std::int32_t stream_id, std::uint32_t, void* user_data) {
+        auto& self = *static_cast<Http2Session*>(user_data);
+        if (self.streams_.erase(stream_id) != 0 && self.streams_.empty() && !self.closed_)
+            self.watch_idle();
+        return 0;
+    }
+
+    static ssize_t on_data_source_read(nghttp2_session*, std::int32_t stream_id, std::uint8_t* buf, std::size_t length, std::uint32_t* data_flags,
+                                       nghttp2_data_source* source, void* user_data) {
+        auto& res = static_cast<Stream*>(source->ptr)->res;
+
+        // A volume download is received straight into the frame, as the content comes in; failing midway resets the stream
+        if (res.download) {
+            const auto n = res.download->read(reinterpret_cast<char*>(buf), length, static_cast<Http2Session*>(user_data)->resumer(stream_id));
+            if (n == VolumeDownload::would_block)
+                return NGHTTP2_ERR_DEFERRED;
+            if (n < 0)
+                return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+            // libvirt confirms that the content was whole over a call, made out of the strand, the stream resuming once it did
+            if (n == 0 && !res.download->done()) {
+                if (std::exchange(res.finishing, true))
+                    return NGHTTP2_ERR_TEMPORAL_CALLBACK_FAILURE;
+                auto& self = *static_cast<Http2Session*>(user_data);
+                boost::asio::post(self.stream_.get_executor(), [download = res.download, resume = self.resumer(stream_id)] {
+                    download->finish();
+                    resume();
+                });
+                return NGHTTP2_ERR_DEFERRED;
+            }
+            if (res.download->done()) {
+                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                // The digests of the content asked for come after it, in a trailer, which then ends the stream
+                if (res.download->digest) {
+                    std::string name{"content-digest"}, value{res.download->digest.value()};
+                    const auto as_bytes = [](std::string& s) { return reinterpret_cast<std::uint8_t*>(s.data()); };
+                    nghttp2_nv nv{as_bytes(name), as_bytes(value), name.size(), value.size(), NGHTTP2_NV_FLAG_NONE};
+                    if (nghttp2_submit_trailer(static_cast<Http2Session*>(user_data)->session_.get(), stream_id, &nv, 1) == 0)
+                        *data_flags |= NGHTTP2_DATA_FLAG_NO_END_STREAM;
+                }
+            }
+            return n;
+        }
+
+        // An event stream waits for the next events once it has sent the previous ones, and ends along with its subscription
+        if (res.events && res.sent == res.body.size()) {
+            const auto open = static_cast<Http2Session*>(user_data)->refill(stream_id, res);
+            if (res.body.empty()) {
+                if (open)
+                    return NGHTTP2_ERR_DEFERRED;
+                *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+                return 0;
+            }
+        }
+
+        const auto n = std::min(length, res.body.size() - res.sent);
+        std::memcpy(buf, res.body.data() + res.sent, n);
+        res.sent += n;
+        if (res.sent == res.body.size() && !res.events)
+            *data_flags |= NGHTTP2_DATA_FLAG_EOF;
+        return static_cast<ssize_t>(n);
+    }
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#ifdef VIRTHTTP_IO_URING
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+#include <boost/asio.hpp>
+#include "beast_internals.hpp"
+
+/**
+ * \internal
+ * Pool of read buffers registered with the io_uring instance of an io_context
+ *
+ * Reads into registered buffers are submitted as fixed-buffer operations, which spares the kernel from pinning and mapping the destination
+ * pages on every read. Asio allows a single registration per execution context, hence this service owns it and hands out fixed-size slots.
+ * Sessions hold on to a slot for their lifetime; once the pool runs dry, they fall back to plain reads.
+ **/
+class RegisteredBuffers : public boost::asio::execution_context::service {
+  public:
+    using key_type = RegisteredBuffers;
+    static inline boost::asio::execution_context::id id;
+
+    constexpr static std::size_t slot_size = 16 * 1024;
+    constexpr static std::size_t slot_count = 1024; ///< 16MiB per io_context
+
+    /**
+     * \internal
+     * Slot borrowed from the pool, given back on destruction; converts to `false` when none was available
+     **/
+    class Slot {
+        RegisteredBuffers* pool = nullptr;
+        std::size_t index = 0;
+
+      public:
+        Slot() noexcept = default;
+        Slot(RegisteredBuffers& pool, std::size_t index) noexcept : pool(&pool), index(index) {}
+        Slot(Slot&& oth) noexcept : pool(std::exchange(oth.pool, nullptr)), index(oth.index) {}
+        Slot& operator=(Slot&& oth) noexcept {
+            if (this != &oth) {
+                this->~Slot();
+                pool = std::exchange(oth.pool, nullptr);
+                index = oth.index;
+            }
+            return *this;
+        }
+        ~Slot() {
+            if (pool)
+                pool->release(index);
+        }
+
+        [[nodiscard]] explicit operator bool() const noexcept { return pool != nullptr; }
+        [[nodiscard]] boost::asio::mutable_registered_buffer buffer() const { return (*pool->registration)[index]; }
+        [[nodiscard]] const char* data() const noexcept { return pool->storage.get() + index * slot_size; }
+    };
+
+    explicit RegisteredBuffers(boost::asio::execution_context& ctx) : service(ctx) {
+        std::vector<boost::asio::mutable_buffer> views;
+        views.reserve(slot_count);
+        for (std::size_t i = 0; i < slot_count; ++i)
+            views.push_back(boost::asio::buffer(storage.get() + i * slot_size, slot_size));
+        try {
+            registration.emplace(boost::asio::register_buffers(ctx, views));
+        } catch (const boost::system::system_error& e) {
+            fail(e.code(), "register_buffers");
+            return;
+        }
+        free.reserve(slot_count);
+        for (auto i = slot_count; i > 0; --i)
+            free.push_back(i - 1);
+    }
+
+    /**
+     * \internal
+     * Borrows a slot from the pool of the execution context of `ex`
+     **/
+    template <class Executor> [[nodiscard]] static Slot acquire(const Executor& ex) {
+        auto& pool = boost::asio::use_service<RegisteredBuffers>(boost::asio::query(ex, boost::asio::execution::context));
+        const std::lock_guard lock{pool.mtx};
+        if (pool.free.empty())
+            return {};
+        const auto index = pool.free.back();
+        pool.free.pop_back();
+        return {pool, index};
+    }
+
+  private:
+    void shutdown() override {}
+
+    void release(std::size_t index) noexcept {
+        const std::lock_guard lock{mtx};
+        free.push_back(index); // never reallocates: capacity is slot_count
+    }
+
+    std::unique_ptr<char[]> storage = std::make_unique<char[]>(slot_size * slot_count);
+    std::optional<boost::asio::buffer_registration<std::vector<boost::asio::mutable_buffer>>> registration;
+    std::mutex mtx; ///< only contended when several threads run the io_context
+    std::vector<std::size_t> free;
+};
+#endif
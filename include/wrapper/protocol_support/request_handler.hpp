@@ -1,20 +1,167 @@
 #pragma once
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <utility>
+#include <variant>
 #include <boost/beast.hpp>
 #include <rapidjson/document.h>
 #include <rapidjson/stringbuffer.h>
 #include <rapidjson/writer.h>
+#include "../events.hpp"
 #include "../general_store.hpp"
 #include "../handler.hpp"
 #include "../handlers/async/async_handler.hpp"
+#include "../metrics.hpp"
+#include "../stream_connection.hpp"
+#include "../volume_transfer.hpp"
 #include "wrapper/decoder_support/compression.hpp"
+#include "alloc_counter.hpp"
 #include "urlparser.hpp"
 
+// Wraps the JSON response body of a request, compressed if the client accepts it
+template <class Body, class Allocator>
+boost::beast::http::response<boost::beast::http::string_body>
+json_response(const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& req, std::string body) {
+    boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::ok, req.version()};
+    res.body() = std::move(body);
+    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    res.set(boost::beast::http::field::content_type, "application/json");
+    if (const auto pakid = req["X-Packet-ID"]; !pakid.empty())
+        res.set("X-Packet-ID", pakid);
+    handle_compression(static_cast<const boost::beast::http::basic_fields<Allocator>&>(req), static_cast<boost::beast::http::fields&>(res),
+                       res.body());
+    res.content_length(std::size_t{res.body().size()});
+    res.keep_alive(req.keep_alive());
+    return res;
+}
+
+// Tells in a response how many allocations the calling thread made since it counted `allocs_at`, when they are counted
+template <class Message> void count_allocs(Message& msg, std::size_t allocs_at) {
+    if constexpr (alloc_counter::enabled)
+        msg.set(alloc_counter::header_name, std::to_string(alloc_counter::thread_allocs() - allocs_at));
+}
+
+// Whether a request targets the events of libvirt: libvirt/events
+inline bool is_event_stream(const TargetParser& target) noexcept {
+    const auto& path_parts = target.getPathParts();
+    return path_parts.size() == 2 && path_parts[0] == "libvirt" && path_parts[1] == "events";
+}
+
+// Whether a request targets the content of a storage volume: libvirt/storage_pools/{by-name,by-uuid}/<pool>/volumes/<vol>/content
+inline bool is_volume_content(const TargetParser& target) noexcept {
+    const auto& path_parts = target.getPathParts();
+    return path_parts.size() == 7 && path_parts[0] == "libvirt" && path_parts[1] == "storage_pools" &&
+           (path_parts[2] == "by-name" || path_parts[2] == "by-uuid") && path_parts[4] == "volumes" && path_parts[6] == "content";
+}
+
+// Looks up the storage pool and volume whose content a request targets, over `conn`; the volume is null if there is none
+inline std::pair<virt::StoragePool, virt::StorageVol> lookup_content_volume(const virt::Connection& conn, const TargetParser& target) {
+    const auto& path_parts = target.getPathParts();
+    const std::string pool_id{path_parts[3]};
+    auto pool = conn.limited([&] {
+        return path_parts[2] == "by-name" ? conn.storagePoolLookupByName(pool_id.c_str()) : conn.storagePoolLookupByUUIDString(pool_id.c_str());
+    });
+    auto vol = pool ? conn.limited([&] { return pool.volLookupByName(std::string{path_parts[5]}.c_str()); }) : virt::StorageVol{};
+    return {std::move(pool), std::move(vol)};
+}
+
+// Response to a request for the content of a storage volume: the download, or why there is none
+using VolumeDownloadSetup = std::variant<boost::beast::http::response<boost::beast::http::string_body>, VolumeDownloadResponse>;
+
+// Sets up the download of the content of the storage volume a GET targets, or of the range of it asked for; the calls to libvirt it
+// makes are bound by the deadline of the calling thread, if any
+template <class Body, class Allocator>
+VolumeDownloadSetup start_volume_download(GeneralStore& gstore,
+                                          const boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>& req,
+                                          const TargetParser& target) {
+    const auto error = [&](boost::beast::http::status status, std::string why) {
+        boost::beast::http::response<boost::beast::http::string_body> res{status, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_type, "text/html");
+        res.keep_alive(req.keep_alive());
+        res.body() = std::move(why);
+        res.prepare_payload();
+        return res;
+    };
+    const auto pakid = req["X-Packet-ID"];
+    const auto sparse = target.getBool("sparse").value_or(false);
+
+    // Transfers outlive the handling of the request, hence go over the shared connection rather than a pooled one
+    auto conn = stream_connection(gstore.config().getConnURI());
+    if (!conn)
+        return error(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to connect to libvirt'");
+    auto vol = lookup_content_volume(*conn, target).second;
+    if (!vol)
+        return error(boost::beast::http::status::not_found, "The resource '" + std::string{req.target()} + "' was not found.");
+    const auto info = conn->limited([&] { return vol.getInfo(virt::StorageVol::InfoFlag{virt::StorageVol::InfoFlag::GET_PHYSICAL}); });
+    if (!info)
+        return error(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to get the size of the volume'");
+
+    // What the volume takes on its storage is what a download of it gives; a sparse one is of unknown length, and whole
+    const auto size = info->allocation();
+    const auto range = sparse ? std::nullopt : ByteRange::parse(req[boost::beast::http::field::range], size);
+    if (range && range->length == 0) {
+        boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::range_not_satisfiable, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_range, "bytes */" + std::to_string(size));
+        if (!pakid.empty())
+            res.set("X-Packet-ID", pakid);
+        res.keep_alive(req.keep_alive());
+        res.prepare_payload();
+        return res;
+    }
+
+    const auto [offset, length] = range.value_or(ByteRange{0, size});
+    auto download = conn->limited([&] { return VolumeDownload::start(conn, vol, offset, length, sparse); });
+    if (!download)
+        return error(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to start the download'");
+
+    VolumeDownloadResponse res{range ? boost::beast::http::status::partial_content : boost::beast::http::status::ok, req.version()};
+    res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    if (!pakid.empty())
+        res.set("X-Packet-ID", pakid);
+    // The digests asked for are those of the content as sent, known once it all was, hence given in the trailer
+    if (ContentDigest digest{req["Want-Content-Digest"], {}}; digest && req.version() >= 11) {
+        download->digest = std::move(digest);
+        res.set(boost::beast::http::field::trailer, "Content-Digest");
+    }
+    res.keep_alive(req.keep_alive());
+    res.body() = std::move(download);
+    if (sparse) {
+        res.set(boost::beast::http::field::content_type, "application/vnd.virthttp.sparse");
+        return res;
+    }
+    res.set(boost::beast::http::field::content_type, "application/octet-stream");
+    res.set(boost::beast::http::field::accept_ranges, "bytes");
+    if (range)
+        res.set(boost::beast::http::field::content_range,
+                "bytes " + std::to_string(offset) + '-' + std::to_string(offset + length - 1) + '/' + std::to_string(size));
+    res.content_length(length);
+    return res;
+}
+
 // This function produces an HTTP response for the given
 // request. The type of the response object depends on the
 // contents of the request, so the interface requires the
 // caller to pass a generic lambda for receiving the response.
-template <class Body, class Allocator, class Send>
-void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req, Send&& send) {
+// `trusted` tells that the transport already authenticated the peer, which then needs no auth key.
+// A request waiting for its admission is resumed on `ex`, with the outcome of its admission.
+// The allocations it took to produce a response are counted on the thread producing it, as of the last (re)entry here.
+template <class Body, class Allocator, class Executor, class Send>
+void handle_request(GeneralStore& gstore, const Executor& ex, boost::beast::http::request<Body, boost::beast::http::basic_fields<Allocator>>&& req,
+                    Send&& respond, bool trusted = false,
+                    std::optional<std::pair<AdmissionController::Verdict, AdmissionController::Ticket>> admission = std::nullopt) {
+    // Sends a response produced on this thread
+    const auto allocs_at_entry = alloc_counter::thread_allocs();
+    const auto send = [&respond, allocs_at_entry](auto&& msg) {
+        count_allocs(msg, allocs_at_entry);
+        respond(std::move(msg));
+    };
+
     // Returns a bad request response
     const auto bad_request = [&](boost::beast::string_view why) {
         boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::bad_request, req.version()};
@@ -48,8 +195,30 @@ void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boos
         return res;
     };
 
+    // Returns a response refusing a client which did not present the auth key
+    const auto unauthorized = [&] {
+        boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::unauthorized, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.keep_alive(req.keep_alive());
+        res.prepare_payload();
+        return res;
+    };
+
+    // Returns a response shedding the request, for the client to retry later
+    const auto overloaded = [&](boost::beast::http::status status) {
+        boost::beast::http::response<boost::beast::http::string_body> res{status, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_type, "text/html");
+        res.set(boost::beast::http::field::retry_after, std::to_string(gstore.admission.retry_after_seconds()));
+        res.keep_alive(req.keep_alive());
+        res.body() = "The server is too busy to handle this request";
+        res.prepare_payload();
+        return res;
+    };
+
     auto req_method = req.method();
-    logger.info("Received from a Session: HTTP ", boost::beast::http::to_string(req.method()), ' ', req.target());
+    if (!admission)
+        logger.info("Received from a Session: HTTP ", boost::beast::http::to_string(req.method()), ' ', req.target());
 
     // Respond to HEAD request
     if (req_method == boost::beast::http::verb::head) {
@@ -62,7 +231,7 @@ void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boos
     }
 
     constexpr std::array supported_methods = {boost::beast::http::verb::get, boost::beast::http::verb::patch, boost::beast::http::verb::post,
-                                              boost::beast::http::verb::delete_};
+                                              boost::beast::http::verb::delete_, boost::beast::http::verb::put};
     // Make sure we can handle the method
     if (std::find(supported_methods.begin(), supported_methods.end(), req_method) == supported_methods.end())
         return send(bad_request("Unknown/Unsupported HTTP-method"));
@@ -82,6 +251,63 @@ void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boos
     if (path_parts.empty())
         return send(bad_request("No module name specified"));
 
+    // Whether the client may be served outside of handle_json, which checks the auth key by itself
+    const auto authorized = [&] {
+        const auto& config = gstore.config();
+        return trusted || !config.isHTTPAuthRequired() || req["X-Auth-Key"] == config.http_auth_key;
+    };
+
+    // Stream the events of libvirt, for as long as the client stays; the stream takes no admission ticket, as it holds no thread
+    if (is_event_stream(target)) {
+        if (req_method != boost::beast::http::verb::get)
+            return send(bad_request("Invalid request target"));
+        if (!authorized())
+            return send(unauthorized());
+
+        std::optional<std::uint64_t> last_id;
+        if (const auto header = req["Last-Event-ID"]; !header.empty()) {
+            std::uint64_t value{};
+            const auto last = header.data() + header.size();
+            if (const auto [ptr, ec] = std::from_chars(header.data(), last, value); ec != std::errc{} || ptr != last)
+                return send(bad_request("Invalid Last-Event-ID"));
+            last_id = value;
+        }
+
+        EventStreamResponse res{boost::beast::http::status::ok, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_type, "text/event-stream");
+        res.set(boost::beast::http::field::cache_control, "no-cache");
+        forward_packid(res);
+        res.keep_alive(false);
+        res.body() = gstore.events.subscribe(EventHub::Filter{target}, last_id);
+        return send(std::move(res));
+    }
+
+    // The content of a storage volume, downloaded with GET and uploaded with PUT; `?sparse` transfers it without its holes
+    const auto volume_content = is_volume_content(target);
+    if (volume_content && req_method != boost::beast::http::verb::get && req_method != boost::beast::http::verb::put)
+        return send(bad_request("Invalid request target"));
+    if (!volume_content && req_method == boost::beast::http::verb::put)
+        return send(bad_request("Unknown/Unsupported HTTP-method"));
+    const auto sparse = volume_content && target.getBool("sparse").value_or(false);
+
+    // Handle scrapes of the server's metrics
+    if (path_parts[0] == "metrics") {
+        if (path_parts.size() != 1 || req_method != boost::beast::http::verb::get)
+            return send(bad_request("Invalid request target"));
+
+        if (!authorized())
+            return send(unauthorized());
+
+        boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::ok, req.version()};
+        res.body() = render_metrics(gstore);
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_type, "text/plain; version=0.0.4");
+        res.content_length(res.body().size());
+        res.keep_alive(req.keep_alive());
+        return send(std::move(res));
+    }
+
     // Handle cases where the client wants to retrieve an async result
     if (path_parts[0] == "async") {
         if (path_parts.size() != 2)
@@ -102,11 +328,72 @@ void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boos
         return send(std::move(res));
     }
 
-    if (auto opt = target.getBool("async"); opt && *opt) {
-        auto launch_res = gstore.async_store.launch([&gstore, target = std::move(target), req = std::move(req)]() {
-            auto buf = handle_json(gstore, req, target);
-            return std::string{buf.GetString(), buf.GetLength()};
-        });
+    // Shed the request if its class is saturated, rather than letting it pile up behind the others
+    // A request which has to wait for its turn is handled again once it came up, the thread going on with other requests meanwhile
+    const auto request_class = classify_request(req_method, target);
+    if (!admission) {
+        return gstore.admission.admit(request_class, ex,
+                                      [&gstore, ex, req = std::move(req), respond = std::forward<Send>(respond),
+                                       trusted](AdmissionController::Verdict verdict, AdmissionController::Ticket ticket) mutable {
+                                          handle_request(gstore, ex, std::move(req), std::move(respond), trusted,
+                                                         std::pair{verdict, std::move(ticket)});
+                                      });
+    }
+    auto& [verdict, ticket] = *admission;
+    if (verdict != AdmissionController::Verdict::admitted) {
+        logger.warning("Shedding ", request_class_names[static_cast<std::size_t>(request_class)], " request ",
+                       verdict == AdmissionController::Verdict::queue_full ? "(queue full)" : "(wait timed out)");
+        return send(overloaded(request_class == RequestClass::async_launch ? boost::beast::http::status::too_many_requests
+                                                                           : boost::beast::http::status::service_unavailable));
+    }
+
+    if (volume_content && !authorized())
+        return send(unauthorized());
+
+    // Store the body of the request as the content of a storage volume, from its start; the upload holds its ticket like any mutation
+    // HTTP/1 sessions stream the body into the volume instead, through handle_volume_upload
+    if (volume_content && req_method == boost::beast::http::verb::put) {
+        auto conn = stream_connection(gstore.config().getConnURI());
+        if (!conn)
+            return send(server_error("Unable to connect to libvirt"));
+        auto [pool, vol] = lookup_content_volume(*conn, target);
+        if (!vol)
+            return send(not_found(req.target()));
+
+        // The body being all there, it is checked against the digests it came with before any of it is stored
+        const auto& body = req.body();
+        ContentDigest digest{req["Want-Content-Digest"], req["Content-Digest"]};
+        digest.update(body.data(), body.size());
+        if (!digest.matches())
+            return send(bad_request("The content does not match its Content-Digest"));
+        if (!body.empty()) {
+            const auto upload = VolumeUpload::start(std::move(conn), vol, 0, body.size(), sparse, false);
+            if (!upload)
+                return send(server_error("Unable to start the upload"));
+            upload->pool = pool.getName();
+            for (std::size_t sent = 0; sent < body.size();) {
+                const auto n = upload->write(body.data() + sent, body.size() - sent, {});
+                if (n < 0)
+                    return send(server_error("Unable to upload the content"));
+                sent += static_cast<std::size_t>(n);
+            }
+            if (!upload->finish())
+                return send(server_error("Unable to upload the content"));
+        }
+
+        boost::beast::http::response<boost::beast::http::empty_body> res{boost::beast::http::status::no_content, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        if (digest)
+            res.set("X-Content-Digest", digest.value());
+        forward_packid(res);
+        res.keep_alive(req.keep_alive());
+        return send(std::move(res));
+    }
+
+    if (request_class == RequestClass::async_launch && !volume_content) {
+        // The task holds on to the ticket until it is done
+        auto launch_res = gstore.async_store.launch([&gstore, target = std::move(target), req = std::move(req), trusted,
+                                                     ticket = std::move(ticket)]() mutable { return handle_json(gstore, req, target, trusted); });
 
         if (!launch_res)
             return send(server_error("Unable to enqueue async request"));
@@ -123,7 +410,66 @@ void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boos
         return send(std::move(res));
     }
 
-    auto buffer = handle_json(gstore, req, std::move(target));
+    // Give the request a deadline: the one set by the client, or else the default of its class
+    const auto& config = gstore.config();
+    const std::array class_timeouts = {config.deadline_cheap_read_ms, config.deadline_agent_read_ms, config.deadline_mutation_ms, 0L};
+    auto timeout_ms = class_timeouts[static_cast<std::size_t>(request_class)];
+    if (const auto header = req["X-Request-Timeout"]; !header.empty()) {
+        long value{};
+        const auto last = header.data() + header.size();
+        if (const auto [ptr, ec] = std::from_chars(header.data(), last, value); ec != std::errc{} || ptr != last || value <= 0)
+            return send(bad_request("Invalid X-Request-Timeout"));
+        timeout_ms = std::min(value, config.deadline_max_ms);
+    }
+
+    // A request with a deadline runs on the quarantine pool, which answers it with 504 Gateway Timeout once the deadline has passed;
+    // the work keeps its admission ticket until it is actually over, and counts its allocations on the thread of the pool running it
+    // The download of the content of a volume only takes its ticket and its deadline to be set up; its content is then streamed by the
+    // session, as it holds no thread meanwhile
+    if (timeout_ms > 0) {
+        auto timed_out = [respond, version = req.version(), keep_alive = req.keep_alive(), pakid = std::string{req["X-Packet-ID"]}]() mutable {
+            boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::gateway_timeout, version};
+            res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+            res.set(boost::beast::http::field::content_type, "text/html");
+            if (!pakid.empty())
+                res.set("X-Packet-ID", pakid);
+            res.keep_alive(keep_alive);
+            res.body() = "The request did not complete within its deadline";
+            res.prepare_payload();
+            respond(std::move(res));
+        };
+
+        const auto at = virt::Deadline::Clock::now() + std::chrono::milliseconds{timeout_ms};
+        if (volume_content) {
+            gstore.quarantine.run(
+                at,
+                [&gstore, target = std::move(target), req = std::move(req), ticket = std::move(ticket)]() mutable {
+                    const auto allocs_at = alloc_counter::thread_allocs();
+                    auto res = start_volume_download(gstore, req, target);
+                    std::visit([&](auto& msg) { count_allocs(msg, allocs_at); }, res);
+                    return res;
+                },
+                [respond](auto&& res) mutable { std::visit([&](auto& msg) { respond(std::move(msg)); }, res); }, timed_out);
+            return;
+        }
+        gstore.quarantine.run(
+            at,
+            [&gstore, target = std::move(target), req = std::move(req), trusted, ticket = std::move(ticket)]() mutable {
+                const auto allocs_at = alloc_counter::thread_allocs();
+                auto res = json_response(req, handle_json(gstore, req, target, trusted));
+                count_allocs(res, allocs_at);
+                return res;
+            },
+            [respond](auto&& res) mutable { respond(std::move(res)); }, timed_out);
+        return;
+    }
+
+    if (volume_content) {
+        auto res = start_volume_download(gstore, req, target);
+        return std::visit([&](auto& msg) { send(std::move(msg)); }, res);
+    }
+
+    auto body = handle_json(gstore, req, std::move(target), trusted);
 
     // Build the path to the requested file
     /*
@@ -149,14 +495,76 @@ void handle_request(GeneralStore& gstore, boost::beast::http::request<Body, boos
     auto const size = body.size();
     */
 
-    boost::beast::http::response<boost::beast::http::string_body> res{boost::beast::http::status::ok, req.version()};
-    res.body() = std::string{buffer.GetString()};
+    return send(json_response(req, std::move(body)));
+}
+
+// Handles a PUT to the content of a storage volume whose body of `length` bytes (0 if unknown) is still to be read, by a session
+// streaming it into the volume: the upload is started, and handed to the session along with its admission ticket in the body of the
+// response. A refusal closes the connection, as the body is left unread. Like handle_request, it is resumed on `ex` once admitted,
+// and counts allocations from then on.
+template <class Executor, class Send>
+void handle_volume_upload(GeneralStore& gstore, const Executor& ex, boost::beast::http::request<boost::beast::http::string_body>&& req,
+                          unsigned long long length, Send&& respond, bool trusted = false,
+                          std::optional<std::pair<AdmissionController::Verdict, AdmissionController::Ticket>> admission = std::nullopt) {
+    const auto allocs_at_entry = alloc_counter::thread_allocs();
+    const auto send = [&respond, allocs_at_entry](auto&& msg) {
+        count_allocs(msg, allocs_at_entry);
+        respond(std::move(msg));
+    };
+
+    if (!admission)
+        logger.info("Received from a Session: HTTP PUT ", req.target(), " (streamed)");
+
+    const auto refuse = [&](boost::beast::http::status status, std::string why) {
+        boost::beast::http::response<boost::beast::http::string_body> res{status, req.version()};
+        res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+        res.set(boost::beast::http::field::content_type, "text/html");
+        if (status == boost::beast::http::status::service_unavailable)
+            res.set(boost::beast::http::field::retry_after, std::to_string(gstore.admission.retry_after_seconds()));
+        res.keep_alive(false);
+        res.body() = std::move(why);
+        res.prepare_payload();
+        send(std::move(res));
+    };
+
+    const auto& config = gstore.config();
+    if (!trusted && config.isHTTPAuthRequired() && req["X-Auth-Key"] != config.http_auth_key)
+        return refuse(boost::beast::http::status::unauthorized, {});
+
+    if (!admission) {
+        return gstore.admission.admit(RequestClass::mutation, ex,
+                                      [&gstore, ex, req = std::move(req), length, respond = std::forward<Send>(respond),
+                                       trusted](AdmissionController::Verdict verdict, AdmissionController::Ticket ticket) mutable {
+                                          handle_volume_upload(gstore, ex, std::move(req), length, std::move(respond), trusted,
+                                                               std::pair{verdict, std::move(ticket)});
+                                      });
+    }
+    auto& [verdict, ticket] = *admission;
+    if (verdict != AdmissionController::Verdict::admitted) {
+        logger.warning("Shedding ", request_class_names[static_cast<std::size_t>(RequestClass::mutation)], " request ",
+                       verdict == AdmissionController::Verdict::queue_full ? "(queue full)" : "(wait timed out)");
+        return refuse(boost::beast::http::status::service_unavailable, "The server is too busy to handle this request");
+    }
+
+    const TargetParser target{req.target()};
+    auto conn = stream_connection(config.getConnURI());
+    if (!conn)
+        return refuse(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to connect to libvirt'");
+    auto [pool, vol] = lookup_content_volume(*conn, target);
+    if (!vol)
+        return refuse(boost::beast::http::status::not_found, "The resource '" + std::string{req.target()} + "' was not found.");
+    auto upload = VolumeUpload::start(std::move(conn), vol, 0, length, target.getBool("sparse").value_or(false), true);
+    if (!upload)
+        return refuse(boost::beast::http::status::internal_server_error, "An error occurred: 'Unable to start the upload'");
+    // The body is digested as the session streams it, and checked against the digests it came with once all of it was written
+    upload->digest = ContentDigest{req["Want-Content-Digest"], req["Content-Digest"]};
+    upload->pool = pool.getName();
+
+    VolumeUploadResponse res{boost::beast::http::status::no_content, req.version()};
     res.set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
-    res.set(boost::beast::http::field::content_type, "application/json");
-    forward_packid(res);
-    handle_compression(static_cast<const boost::beast::http::basic_fields<Allocator>&>(req), static_cast<boost::beast::http::fields&>(res),
-                       res.body());
-    res.content_length(std::size_t{res.body().size()});
+    if (const auto pakid = req["X-Packet-ID"]; !pakid.empty())
+        res.set("X-Packet-ID", pakid);
     res.keep_alive(req.keep_alive());
-    return send(std::move(res));
+    res.body() = {std::move(upload), std::move(ticket)};
+    send(std::move(res));
 }
@@ -1,18 +1,20 @@
 #pragma once
 
+#include <boost/asio/detail/socket_option.hpp>
 #include <boost/beast.hpp>
 #include "../general_store.hpp"
-#include "http1/Session.hpp"
-//#include "http2/Session.hpp"
+#include "detect_session.hpp"
 
-// Accepts incoming connections and launches the sessions
+// Accepts incoming connections and launches the sessions, pausing while the `max-sessions` cap is reached
 class TcpListener : public std::enable_shared_from_this<TcpListener> {
     boost::beast::net::ip::tcp::acceptor acceptor_;
     boost::beast::net::ip::tcp::socket socket_;
     std::reference_wrapper<GeneralStore> gstore;
 
   public:
-    TcpListener(boost::beast::net::io_context& ioc, const boost::beast::net::ip::tcp::endpoint& endpoint, GeneralStore& gstore)
+    // `reuse_port` lets several listeners bind the same endpoint, the kernel spreading incoming connections among them
+    TcpListener(boost::beast::net::io_context& ioc, const boost::beast::net::ip::tcp::endpoint& endpoint, GeneralStore& gstore,
+                bool reuse_port = false)
         : acceptor_(ioc), socket_(ioc), gstore(gstore) {
         boost::beast::error_code ec;
 
@@ -30,6 +32,18 @@ class TcpListener : public std::enable_shared_from_this<TcpListener> {
             return;
         }
 
+        if (reuse_port) {
+#ifdef SO_REUSEPORT
+            acceptor_.set_option(boost::asio::detail::socket_option::boolean<SOL_SOCKET, SO_REUSEPORT>(true), ec);
+#else
+            ec = boost::asio::error::operation_not_supported;
+#endif
+            if (ec) {
+                fail(ec, "set_option");
+                return;
+            }
+        }
+
         // Bind to the server address
         acceptor_.bind(endpoint, ec);
         if (ec) {
@@ -59,11 +73,14 @@ class TcpListener : public std::enable_shared_from_this<TcpListener> {
             fail(ec, "accept");
         else {
             // Create the Session and run it
-            /// FIXME: select the right kind of session to create
-            std::make_shared<Session>(std::move(socket_), gstore)->run();
+            launch_session(std::move(socket_), gstore);
         }
 
-        // Accept another connection
-        do_accept();
+        // Accept another connection, once there is room for it
+        const auto resume = [self = shared_from_this()] {
+            boost::asio::post(self->acceptor_.get_executor(), std::bind(&TcpListener::do_accept, self));
+        };
+        if (!gstore.get().sessions.pause_if_full(resume))
+            do_accept();
     }
 };
\ No newline at end of file
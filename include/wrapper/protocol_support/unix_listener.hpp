@@ -0,0 +1,105 @@
+#pragma once
+
+#include <algorithm>
+#include <string>
+#include <boost/asio/local/stream_protocol.hpp>
+#include <boost/beast.hpp>
+#include "../general_store.hpp"
+#include "http1/Session.hpp"
+
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// Accepts incoming connections on a UNIX domain socket and launches the sessions, pausing while the `max-sessions` cap is reached
+//
+// Meant for clients running on the same host, which are spared the TCP loopback stack.
+// Peers running as one of the trusted UIDs (as reported by SO_PEERCRED) are served without presenting the auth key.
+class UnixListener : public std::enable_shared_from_this<UnixListener> {
+    using protocol = boost::asio::local::stream_protocol;
+
+    protocol::acceptor acceptor_;
+    protocol::socket socket_;
+    std::reference_wrapper<GeneralStore> gstore;
+
+  public:
+    UnixListener(boost::beast::net::io_context& ioc, const std::string& path, GeneralStore& gstore) : acceptor_(ioc), socket_(ioc), gstore(gstore) {
+        boost::beast::error_code ec;
+
+        // Remove the socket left behind by a previous run, but nothing else
+        if (struct stat st {}; ::lstat(path.c_str(), &st) == 0 && S_ISSOCK(st.st_mode))
+            ::unlink(path.c_str());
+
+        // Open the acceptor
+        acceptor_.open(protocol{}, ec);
+        if (ec) {
+            fail(ec, "open");
+            return;
+        }
+
+        // Bind to the socket path
+        acceptor_.bind(protocol::endpoint{path}, ec);
+        if (ec) {
+            fail(ec, "bind");
+            return;
+        }
+
+        // Restrict who may connect
+        if (::chmod(path.c_str(), static_cast<mode_t>(gstore.config().http_unix_socket_mode)) != 0) {
+            fail(boost::beast::error_code{errno, boost::system::generic_category()}, "chmod");
+            return;
+        }
+
+        // Start listening for connections
+        acceptor_.listen(boost::beast::net::socket_base::max_listen_connections, ec);
+        if (ec) {
+            fail(ec, "listen");
+            return;
+        }
+    }
+
+    // Start accepting incoming connections
+    void run() {
+        if (!acceptor_.is_open())
+            return;
+        do_accept();
+    }
+
+    void do_accept() { acceptor_.async_accept(socket_, std::bind(&UnixListener::on_accept, shared_from_this(), std::placeholders::_1)); }
+
+    void on_accept(boost::beast::error_code ec) {
+        if (ec)
+            fail(ec, "accept");
+        else {
+            // Create the Session and run it
+            const auto trusted = is_trusted();
+            std::make_shared<BasicSession<protocol::socket>>(std::move(socket_), gstore, boost::beast::flat_buffer{}, trusted)->run();
+        }
+
+        // Accept another connection, once there is room for it
+        const auto resume = [self = shared_from_this()] {
+            boost::asio::post(self->acceptor_.get_executor(), std::bind(&UnixListener::do_accept, self));
+        };
+        if (!gstore.get().sessions.pause_if_full(resume))
+            do_accept();
+    }
+
+  private:
+    // Whether the peer of the accepted socket runs as a trusted UID
+    [[nodiscard]] bool is_trusted() {
+#ifdef SO_PEERCRED
+        const auto& uids = gstore.get().config().http_unix_trusted_uids;
+        if (uids.empty())
+            return false;
+        ucred cred{};
+        socklen_t len = sizeof(cred);
+        if (::getsockopt(socket_.native_handle(), SOL_SOCKET, SO_PEERCRED, &cred, &len) != 0)
+            return false;
+        return std::find(uids.begin(), uids.end(), cred.uid) != uids.end();
+#else
+        return false;
+#endif
+    }
+};
+#endif
@@ -0,0 +1,281 @@
+#pragma once
+
+#include <array>
+#include <memory>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/websocket.hpp>
+#include <libvirt/libvirt.h>
+#include "../../general_store.hpp"
+#include "../../stream_connection.hpp"
+#include "../beast_internals.hpp"
+#include "Session.hpp"
+#include "logger.hpp"
+#include "urlparser.hpp"
+#include "virt_wrap.hpp"
+
+// Domain an upgrade request for /libvirt/domains/by-name/<name>/... (or by-uuid) is about
+struct TargetDomain {
+    std::shared_ptr<virt::Connection> conn;
+    virt::Domain dom;                   ///< null if the request is to be refused
+    boost::beast::http::status status{}; ///< to refuse the request with
+    std::string_view why;
+};
+
+// Authenticates an upgrade request for a console, then looks its domain up over the stream connection
+template <class Request> TargetDomain lookup_target_domain(const IniConfig& config, const Request& req, const TargetParser& target, bool trusted) {
+    if (!trusted && config.isHTTPAuthRequired() && req["X-Auth-Key"] != config.http_auth_key)
+        return {nullptr, virt::Domain{}, boost::beast::http::status::unauthorized, {}};
+
+    auto conn = stream_connection(config.getConnURI());
+    if (!conn) {
+        logger.error("Failed to open connection to ", config.getConnURI());
+        return {nullptr, virt::Domain{}, boost::beast::http::status::service_unavailable, "Unable to connect to libvirt"};
+    }
+
+    const auto& parts = target.getPathParts();
+    const std::string key{parts[3]};
+    auto dom = parts[2] == "by-name" ? conn->domainLookupByName(key) : conn->domainLookupByUUIDString(key);
+    if (!dom)
+        return {nullptr, virt::Domain{}, boost::beast::http::status::not_found, "No such domain"};
+    return {std::move(conn), std::move(dom), boost::beast::http::status::ok, {}};
+}
+
+// Whether `target` is /libvirt/domains/by-name/<name>/<what> (or by-uuid)
+[[nodiscard]] inline bool is_domain_target(const TargetParser& target, std::string_view what) {
+    const auto& parts = target.getPathParts();
+    return parts.size() == 5 && parts[0] == "libvirt" && parts[1] == "domains" && (parts[2] == "by-name" || parts[2] == "by-uuid") &&
+           parts[4] == what;
+}
+
+// Answers an upgrade request with an error over `stream`, then shuts the connection down; `owner` keeps the stream alive meanwhile
+template <class Stream, class Owner>
+void refuse_upgrade(Stream& stream, std::shared_ptr<Owner> owner, unsigned version, boost::beast::http::status status, std::string_view why,
+                    long timeout) {
+    auto res = std::make_shared<boost::beast::http::response<boost::beast::http::string_body>>(status, version);
+    res->set(boost::beast::http::field::server, BOOST_BEAST_VERSION_STRING);
+    res->set(boost::beast::http::field::content_type, "text/html");
+    res->keep_alive(false);
+    res->body() = why;
+    res->prepare_payload();
+
+    expire_after(stream, timeout);
+    boost::beast::http::async_write(stream, *res, [&stream, owner = std::move(owner), res](boost::beast::error_code, std::size_t) {
+        boost::beast::error_code ec;
+        stream.socket().shutdown(Stream::socket_type::shutdown_send, ec);
+    });
+}
+
+// Relays the serial console of a domain over a WebSocket, upgraded from HTTP/1 on /libvirt/domains/by-name/<name>/console
+// (or by-uuid), optionally with `?dev=<alias>` to pick a console other than the first, and `?force=true` to take it over from another client
+//
+// The console is a non-blocking virt::Stream, whose readiness the event loop of libvirt reports to the strand of the session.
+// Console output is received into a fixed buffer, which the next binary message is written from; client input is sent to the console
+// straight from the buffer its message was read into. Neither direction moves more before the other end took what it was given:
+// the console is not read while a message is being written, and no message is read until the console took the last one entirely.
+// A slow client or guest thus only stalls its own direction, with nothing piling up in between, and a session holds the same memory
+// however much goes through it.
+//
+// `Socket` is the stream socket of the connection: TCP, or UNIX domain for co-located clients.
+template <class Socket> class BasicConsoleSession : public std::enable_shared_from_this<BasicConsoleSession<Socket>> {
+    using Stream = boost::beast::basic_stream<typename Socket::protocol_type, typename Socket::executor_type>;
+    using Request = boost::beast::http::request<boost::beast::http::string_body>;
+    constexpr static std::size_t buffer_size = 64 * 1024;
+    constexpr static int always_watched = VIR_STREAM_EVENT_ERROR | VIR_STREAM_EVENT_HANGUP;
+
+    // Opaque of the console callback, freed by libvirt once the callback is removed
+    struct Watch {
+        std::weak_ptr<BasicConsoleSession> self;
+    };
+
+    boost::beast::websocket::stream<Stream> ws_; ///< on a strand, which runs the completion handlers
+    SessionCap::Slot session_slot_;
+    std::reference_wrapper<GeneralStore> m_gstore;
+    bool trusted_;
+    std::optional<virt::Stream> console_;
+    int watched_ = 0;                   ///< events of the console the callback is registered for, if any
+    std::array<char, buffer_size> out_; ///< console output, being written to the client
+    boost::beast::flat_buffer in_;      ///< client input, being sent to the console
+    std::size_t in_sent_ = 0;           ///< how much of `in_` the console took
+    bool reading_ = false;
+    bool writing_ = false;
+    bool closed_ = false;
+
+  public:
+    // Take ownership of the socket of an HTTP/1 session; `trusted` tells that the transport already authenticated the peer
+    BasicConsoleSession(Socket socket, GeneralStore& gstore, bool trusted)
+        : ws_(on_strand(std::move(socket))), session_slot_(gstore.sessions.open()), m_gstore(gstore), trusted_(trusted) {}
+
+    ~BasicConsoleSession() { close_console(); }
+
+    // Whether an upgrade request for `target` asks for a console
+    [[nodiscard]] static bool is_console(const TargetParser& target) { return is_domain_target(target, "console"); }
+
+    // Open the console, then answer the upgrade request
+    void run(Request req) {
+        boost::asio::dispatch(ws_.get_executor(),
+                              [self = this->shared_from_this(), req = std::move(req)]() mutable { self->do_open(std::move(req)); });
+    }
+
+  private:
+    void do_open(const Request& req) {
+        const auto& config = m_gstore.get().config();
+        const TargetParser target{req.target()};
+        auto [conn, dom, status, why] = lookup_target_domain(config, req, target, trusted_);
+        if (!dom)
+            return refuse(req.version(), status, why);
+
+        const std::string dev{target["dev"]};
+        virt::enums::domain::ConsoleFlag flags{};
+        if (target.getBool("force").value_or(false))
+            flags = virt::enums::domain::ConsoleFlag::FORCE;
+        console_.emplace(*conn, virt::Stream::Flag::NONBLOCK);
+        if (!*console_ || !dom.openConsole(dev.empty() ? nullptr : dev.c_str(), *console_, flags)) {
+            console_.reset();
+            return refuse(req.version(), boost::beast::http::status::conflict, "Unable to open the console; another client may hold it");
+        }
+
+        set_timeouts(ws_, config.http_write_timeout, config.http_idle_timeout);
+        ws_.read_message_max(buffer_size);
+        ws_.binary(true);
+        ws_.async_accept(req, std::bind(&BasicConsoleSession::on_accept, this->shared_from_this(), std::placeholders::_1));
+    }
+
+    // Answers the upgrade request with an error, then closes the connection
+    void refuse(unsigned version, boost::beast::http::status status, std::string_view why) {
+        refuse_upgrade(ws_.next_layer(), this->shared_from_this(), version, status, why, m_gstore.get().config().http_write_timeout);
+    }
+
+    void on_accept(boost::beast::error_code ec) {
+        if (ec)
+            return on_error(ec, "accept");
+
+        watched_ = always_watched | VIR_STREAM_EVENT_READABLE;
+        auto watch = std::make_unique<Watch>(Watch{this->weak_from_this()});
+        if (!console_->eventAddCallback(watched_, &BasicConsoleSession::on_console_event, watch.get(), &BasicConsoleSession::free_watch)) {
+            watched_ = 0;
+            return finish(boost::beast::websocket::close_code::internal_error);
+        }
+        watch.release();
+        do_read();
+    }
+
+    // Runs on the thread of the libvirt event loop
+    static void on_console_event(virStreamPtr, int events, void* opaque) {
+        if (auto self = static_cast<Watch*>(opaque)->self.lock())
+            boost::asio::post(self->ws_.get_executor(), [self, events] { self->on_console(events); });
+    }
+
+    static void free_watch(void* opaque) { delete static_cast<Watch*>(opaque); }
+
+    void on_console(int events) {
+        if (closed_)
+            return;
+        if (events & VIR_STREAM_EVENT_READABLE) {
+            // Not to be told again and again while the client is still being written the previous output
+            if (writing_)
+                watch(false, (watched_ & VIR_STREAM_EVENT_WRITABLE) != 0);
+            else
+                pump_out();
+        }
+        if ((events & VIR_STREAM_EVENT_WRITABLE) && !reading_ && in_sent_ < in_.size())
+            pump_in();
+        if ((events & always_watched) && !(events & VIR_STREAM_EVENT_READABLE))
+            finish(boost::beast::websocket::close_code::going_away);
+    }
+
+    // Registers the callback for the events of the console the session is waiting for
+    void watch(bool readable, bool writable) {
+        const auto events = always_watched | (readable ? VIR_STREAM_EVENT_READABLE : 0) | (writable ? VIR_STREAM_EVENT_WRITABLE : 0);
+        if (events != watched_ && console_->eventUpdateCallback(events))
+            watched_ = events;
+    }
+
+    // Writes the output of the console to the client, until there is none ready
+    void pump_out() {
+        if (writing_ || closed_)
+            return;
+        const auto n = console_->recv(out_.data(), out_.size());
+        if (n == -2)
+            return watch(true, (watched_ & VIR_STREAM_EVENT_WRITABLE) != 0);
+        if (n <= 0)
+            return finish(n == 0 ? boost::beast::websocket::close_code::going_away : boost::beast::websocket::close_code::internal_error);
+
+        writing_ = true;
+        ws_.async_write(boost::asio::buffer(out_.data(), static_cast<std::size_t>(n)),
+                        std::bind(&BasicConsoleSession::on_write, this->shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void on_write(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+        writing_ = false;
+        if (ec)
+            return on_error(ec, "write");
+        pump_out();
+    }
+
+    void do_read() {
+        reading_ = true;
+        ws_.async_read(in_, std::bind(&BasicConsoleSession::on_read, this->shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+        reading_ = false;
+        if (ec)
+            return on_error(ec, "read");
+        in_sent_ = 0;
+        pump_in();
+    }
+
+    // Sends the input of the client to the console, then reads the next message once the console took all of it
+    void pump_in() {
+        if (closed_)
+            return;
+        const auto* const data = static_cast<const char*>(in_.data().data());
+        while (in_sent_ < in_.size()) {
+            const auto n = console_->send(data + in_sent_, in_.size() - in_sent_);
+            if (n == -2)
+                return watch((watched_ & VIR_STREAM_EVENT_READABLE) != 0, true);
+            if (n < 0)
+                return finish(boost::beast::websocket::close_code::internal_error);
+            in_sent_ += static_cast<std::size_t>(n);
+        }
+        in_.consume(in_.size());
+        in_sent_ = 0;
+        watch((watched_ & VIR_STREAM_EVENT_READABLE) != 0, false);
+        do_read();
+    }
+
+    void on_error(boost::beast::error_code ec, const char* what) {
+        if (ec == boost::beast::error::timeout)
+            m_gstore.get().sessions.timed_out();
+        else if (ec != boost::beast::websocket::error::closed && ec != boost::asio::error::operation_aborted)
+            fail(ec, what);
+        closed_ = true;
+        close_console();
+    }
+
+    // Closes the console, then the connection
+    void finish(boost::beast::websocket::close_code code) {
+        if (std::exchange(closed_, true))
+            return;
+        close_console();
+        ws_.async_close(code, [self = this->shared_from_this()](boost::beast::error_code) {});
+    }
+
+    void close_console() noexcept {
+        if (!console_)
+            return;
+        if (watched_ != 0)
+            console_->eventRemoveCallback();
+        console_->abort();
+        console_.reset();
+    }
+};
+
+using ConsoleSession = BasicConsoleSession<boost::asio::ip::tcp::socket>;
@@ -0,0 +1,314 @@
+#pragma once
+
+#include <cerrno>
+#include <charconv>
+#include <chrono>
+#include <memory>
+#include <string_view>
+#include <utility>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/websocket.hpp>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "../../general_store.hpp"
+#include "../beast_internals.hpp"
+#include "ConsoleSession.hpp"
+#include "Session.hpp"
+#include "urlparser.hpp"
+#include "virt_wrap.hpp"
+
+// Tunnels the graphics (VNC or SPICE) of a domain, upgraded from HTTP/1 on /libvirt/domains/by-name/<name>/graphics (or by-uuid),
+// optionally with `?idx=<n>` to pick a graphics device other than the first, and `?skipauth=true` to skip its own authentication
+//
+// The graphics are reached through the socket libvirt hands over from `virDomainOpenGraphicsFD`, and tunnelled either
+// - over a WebSocket (`Upgrade: websocket`), in binary messages, as web clients such as noVNC expect them; or
+// - as is (any other upgrade token, e.g. `Upgrade: vnc`), the connection then carrying the bytes of the protocol unframed.
+//   Raw tunnels move their bytes with splice(2) through a pipe per direction, the data never being copied into user space.
+//
+// Either way, each direction moves at most a buffer (or a pipe) at a time before its destination took it, the session waiting on
+// readiness in between; an idle tunnel thus costs no CPU, and a busy one only the system calls. A raw tunnel through which nothing
+// moved for an `idle-timeout` is closed, lest a half-open peer hold on to its descriptors and its session slot.
+//
+// `Socket` is the stream socket of the connection: TCP, or UNIX domain for co-located clients.
+template <class Socket> class BasicGraphicsSession : public std::enable_shared_from_this<BasicGraphicsSession<Socket>> {
+    using Stream = boost::beast::basic_stream<typename Socket::protocol_type, typename Socket::executor_type>;
+    using Request = boost::beast::http::request<boost::beast::http::string_body>;
+    using Descriptor = boost::asio::posix::stream_descriptor;
+    constexpr static std::size_t buffer_size = 32 * 1024;
+#ifdef SPLICE_F_MOVE
+    constexpr static std::size_t splice_size = 64 * 1024; ///< default capacity of a pipe
+    constexpr static int splice_rounds = 16;              ///< splices a direction may do before yielding the strand to the other
+#endif
+
+    // One direction of a raw tunnel: bytes are spliced from the source into the pipe, then from the pipe into the destination
+    struct Pipe {
+        int fds[2] = {-1, -1};
+        std::size_t pending = 0; ///< bytes in the pipe, not yet spliced out
+        bool done = false;       ///< the source reached its end, which was passed on
+
+        Pipe() = default;
+        Pipe(const Pipe&) = delete;
+        Pipe& operator=(const Pipe&) = delete;
+        ~Pipe() {
+            for (const auto fd : fds)
+                if (fd >= 0)
+                    ::close(fd);
+        }
+    };
+
+    boost::beast::websocket::stream<Stream> ws_; ///< on a strand, which runs the completion handlers; only its socket is used when raw
+    Descriptor graphics_;                        ///< on the same strand
+    boost::asio::steady_timer idle_timer_;       ///< raw tunnels only: on the same strand, checks once per `idle-timeout` that bytes moved
+    SessionCap::Slot session_slot_;
+    std::reference_wrapper<GeneralStore> m_gstore;
+    bool trusted_;
+    boost::beast::flat_buffer buffer_;  ///< read along with the upgrade request, to be passed on to the graphics
+    std::unique_ptr<char[]> buffers_;   ///< WebSocket tunnels only: client input, then graphics output, `buffer_size` each
+    std::unique_ptr<Pipe[]> pipes_;     ///< raw tunnels only: to the graphics, then to the client
+    bool moved_ = false;                ///< raw tunnels only: bytes were spliced since idle_timer_ was last armed
+    bool closed_ = false;
+
+  public:
+    // Take ownership of the socket of an HTTP/1 session, along with whatever has been read past the upgrade request;
+    // `trusted` tells that the transport already authenticated the peer
+    BasicGraphicsSession(Socket socket, GeneralStore& gstore, boost::beast::flat_buffer buffer, bool trusted)
+        : ws_(on_strand(std::move(socket))), graphics_(ws_.get_executor()), idle_timer_(ws_.get_executor()),
+          session_slot_(gstore.sessions.open()), m_gstore(gstore), trusted_(trusted), buffer_(std::move(buffer)) {}
+
+    // Whether an upgrade request for `target` asks for graphics
+    [[nodiscard]] static bool is_graphics(const TargetParser& target) { return is_domain_target(target, "graphics"); }
+
+    // Open the graphics, then answer the upgrade request
+    void run(Request req) {
+        boost::asio::dispatch(ws_.get_executor(),
+                              [self = this->shared_from_this(), req = std::move(req)]() mutable { self->do_open(std::move(req)); });
+    }
+
+  private:
+    void do_open(Request req) {
+        const auto& config = m_gstore.get().config();
+        const TargetParser target{req.target()};
+        auto [conn, dom, status, why] = lookup_target_domain(config, req, target, trusted_);
+        if (!dom)
+            return refuse(req.version(), status, why);
+
+        unsigned idx = 0;
+        if (const auto idx_str = target["idx"]; !idx_str.empty()) {
+            const auto [end, ec] = std::from_chars(idx_str.data(), idx_str.data() + idx_str.size(), idx);
+            if (ec != std::errc{} || end != idx_str.data() + idx_str.size())
+                return refuse(req.version(), boost::beast::http::status::bad_request, "Invalid graphics index");
+        }
+        virt::enums::domain::OpenGraphicsFlag flags{};
+        if (target.getBool("skipauth").value_or(false))
+            flags = virt::enums::domain::OpenGraphicsFlag::SKIPAUTH;
+        const auto fd = dom.openGraphicsFD(idx, flags);
+        if (fd < 0)
+            return refuse(req.version(), boost::beast::http::status::conflict, "Unable to open the graphics; the domain may not be running");
+
+        boost::beast::error_code ec;
+        graphics_.assign(fd, ec);
+        if (ec) {
+            ::close(fd);
+            return refuse(req.version(), boost::beast::http::status::internal_server_error, {});
+        }
+
+        if (boost::beast::websocket::is_upgrade(req))
+            return do_accept(req);
+#ifdef SPLICE_F_MOVE
+        do_switch(req);
+#else
+        refuse(req.version(), boost::beast::http::status::not_implemented, "Raw tunnels are not supported on this system");
+#endif
+    }
+
+    void refuse(unsigned version, boost::beast::http::status status, std::string_view why) {
+        refuse_upgrade(ws_.next_layer(), this->shared_from_this(), version, status, why, m_gstore.get().config().http_write_timeout);
+    }
+
+    // WebSocket tunnel
+
+    void do_accept(const Request& req) {
+        const auto& config = m_gstore.get().config();
+        set_timeouts(ws_, config.http_write_timeout, config.http_idle_timeout);
+        ws_.binary(true);
+        // noVNC, among others, asks for the "binary" subprotocol
+        if (req[boost::beast::http::field::sec_websocket_protocol].find("binary") != boost::beast::string_view::npos)
+            ws_.set_option(boost::beast::websocket::stream_base::decorator(
+                [](boost::beast::websocket::response_type& res) { res.set(boost::beast::http::field::sec_websocket_protocol, "binary"); }));
+        buffers_ = std::make_unique<char[]>(2 * buffer_size);
+        ws_.async_accept(req, std::bind(&BasicGraphicsSession::on_accept, this->shared_from_this(), std::placeholders::_1));
+    }
+
+    void on_accept(boost::beast::error_code ec) {
+        if (ec)
+            return on_error(ec, "accept");
+        do_read_client();
+        do_read_graphics();
+    }
+
+    // Reads whatever part of a message the client sent, then writes it to the graphics
+    void do_read_client() {
+        ws_.async_read_some(boost::asio::buffer(buffers_.get(), buffer_size), [self = this->shared_from_this()](auto ec, std::size_t n) {
+            if (ec)
+                return self->on_error(ec, "read");
+            boost::asio::async_write(self->graphics_, boost::asio::buffer(self->buffers_.get(), n), [self](auto ec, std::size_t) {
+                if (ec)
+                    return self->on_error(ec, "write");
+                self->do_read_client();
+            });
+        });
+    }
+
+    // Reads what the graphics have to say, then writes it to the client as a message
+    void do_read_graphics() {
+        const auto out = boost::asio::buffer(buffers_.get() + buffer_size, buffer_size);
+        graphics_.async_read_some(out, [self = this->shared_from_this(), out](boost::beast::error_code ec, std::size_t n) {
+            if (ec == boost::asio::error::eof)
+                return self->finish(boost::beast::websocket::close_code::going_away);
+            if (ec)
+                return self->on_error(ec, "read");
+            self->ws_.async_write(boost::asio::buffer(out, n), [self](auto ec, std::size_t) {
+                if (ec)
+                    return self->on_error(ec, "write");
+                self->do_read_graphics();
+            });
+        });
+    }
+
+    // Closes the graphics, then the connection
+    void finish(boost::beast::websocket::close_code code) {
+        if (std::exchange(closed_, true))
+            return;
+        close_graphics();
+        ws_.async_close(code, [self = this->shared_from_this()](boost::beast::error_code) {});
+    }
+
+#ifdef SPLICE_F_MOVE
+    // Raw tunnel
+
+    // Answers 101 Switching Protocols, then passes on what the client sent past its request and starts splicing
+    void do_switch(const Request& req) {
+        auto sp = std::make_shared<boost::beast::http::response<boost::beast::http::empty_body>>(boost::beast::http::status::switching_protocols,
+                                                                                                 req.version());
+        sp->set(boost::beast::http::field::connection, "Upgrade");
+        sp->set(boost::beast::http::field::upgrade, req[boost::beast::http::field::upgrade]);
+
+        pipes_ = std::make_unique<Pipe[]>(2);
+        for (int i = 0; i < 2; ++i) {
+            if (::pipe2(pipes_[i].fds, O_CLOEXEC | O_NONBLOCK) != 0)
+                return refuse(req.version(), boost::beast::http::status::service_unavailable, "Out of pipes");
+        }
+
+        auto& stream = ws_.next_layer();
+        expire_after(stream, m_gstore.get().config().http_write_timeout);
+        boost::beast::http::async_write(stream, *sp, [self = this->shared_from_this(), sp](boost::beast::error_code ec, std::size_t) {
+            if (ec)
+                return self->on_error(ec, "write");
+            // Both ends are watched by the idle timer from here on, along with TCP keep-alives on the side of the client
+            auto& socket = self->ws_.next_layer().socket();
+            self->ws_.next_layer().expires_never();
+            self->watch_idle();
+            socket.set_option(typename Socket::keep_alive{true}, ec);
+            socket.non_blocking(true, ec);
+            self->graphics_.non_blocking(true, ec);
+            boost::asio::async_write(self->graphics_, self->buffer_.data(), [self](boost::beast::error_code ec, std::size_t) {
+                if (ec)
+                    return self->on_error(ec, "write");
+                self->buffer_ = {};
+                self->splice(self->ws_.next_layer().socket(), self->graphics_, self->pipes_[0]);
+            });
+            self->splice(self->graphics_, socket, self->pipes_[1]);
+        });
+    }
+
+    // Splices from `from` to `to` through `pipe`, until either would block
+    template <class From, class To> void splice(From& from, To& to, Pipe& pipe) {
+        constexpr unsigned flags = SPLICE_F_MOVE | SPLICE_F_NONBLOCK;
+        for (int round = 0; !closed_; ++round) {
+            if (round == splice_rounds) {
+                return boost::asio::post(ws_.get_executor(),
+                                         [self = this->shared_from_this(), &from, &to, &pipe] { self->splice(from, to, pipe); });
+            }
+
+            if (pipe.pending != 0) {
+                const auto n = ::splice(pipe.fds[0], nullptr, to.native_handle(), nullptr, pipe.pending, flags);
+                if (n < 0 && errno == EAGAIN)
+                    return await(to, To::wait_write, from, to, pipe);
+                if (n < 0)
+                    return on_error(boost::beast::error_code{errno, boost::system::system_category()}, "splice");
+                pipe.pending -= static_cast<std::size_t>(n);
+                moved_ = true;
+                continue;
+            }
+
+            const auto n = ::splice(from.native_handle(), nullptr, pipe.fds[1], nullptr, splice_size, flags);
+            if (n < 0 && errno == EAGAIN)
+                return await(from, From::wait_read, from, to, pipe);
+            if (n < 0)
+                return on_error(boost::beast::error_code{errno, boost::system::system_category()}, "splice");
+            if (n == 0) {
+                // Pass the end of the stream on; the tunnel is over once both directions reached theirs
+                pipe.done = true;
+                ::shutdown(to.native_handle(), SHUT_WR);
+                if (pipes_[0].done && pipes_[1].done)
+                    close();
+                return;
+            }
+            pipe.pending = static_cast<std::size_t>(n);
+        }
+    }
+
+    template <class Waited, class WaitType, class From, class To> void await(Waited& waited, WaitType what, From& from, To& to, Pipe& pipe) {
+        waited.async_wait(what, [self = this->shared_from_this(), &from, &to, &pipe](boost::beast::error_code ec) {
+            if (ec)
+                return self->on_error(ec, "wait");
+            self->splice(from, to, pipe);
+        });
+    }
+
+    // Closes the tunnel once nothing moved either way for an `idle-timeout`; rather than being rearmed by every splice, the timer
+    // checks once per period whether any did, so that a tunnel is closed after one to two periods of silence
+    void watch_idle() {
+        const auto seconds = m_gstore.get().config().http_idle_timeout;
+        if (seconds <= 0)
+            return;
+        moved_ = false;
+        idle_timer_.expires_after(std::chrono::seconds{seconds});
+        idle_timer_.async_wait([self = this->shared_from_this()](boost::beast::error_code ec) {
+            if (ec || self->closed_)
+                return;
+            if (self->moved_)
+                return self->watch_idle();
+            self->m_gstore.get().sessions.timed_out();
+            self->close();
+        });
+    }
+#endif
+
+    void on_error(boost::beast::error_code ec, const char* what) {
+        if (ec == boost::beast::error::timeout)
+            m_gstore.get().sessions.timed_out();
+        else if (ec != boost::beast::websocket::error::closed && ec != boost::asio::error::operation_aborted && ec != boost::asio::error::eof &&
+                 ec != boost::asio::error::connection_reset && ec != boost::asio::error::broken_pipe)
+            fail(ec, what);
+        close();
+    }
+
+    // Closes both ends, cancelling whatever is still waiting on them
+    void close() {
+        closed_ = true;
+        idle_timer_.cancel();
+        close_graphics();
+        boost::beast::error_code ec;
+        ws_.next_layer().socket().close(ec);
+    }
+
+    void close_graphics() {
+        boost::beast::error_code ec;
+        graphics_.close(ec);
+    }
+};
+
+using GraphicsSession = BasicGraphicsSession<boost::asio::ip::tcp::socket>;
@@ -0,0 +1,341 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <string>
+#include <string_view>
+#include <type_traits>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include <boost/beast/websocket.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+#include "../../events.hpp"
+#include "../../general_store.hpp"
+#include "../../volume_transfer.hpp"
+#include "../beast_internals.hpp"
+#include "../request_handler.hpp"
+
+// Moves a socket onto a strand of its executor, on which the completion handlers of its operations then run.
+// Older Beasts cannot suspend handlers bound to a strand, as the websocket stream does while a control frame is written;
+// hence websocket streams go over a socket on a strand instead.
+template <class Socket> Socket on_strand(Socket socket) {
+    boost::beast::error_code ec;
+    Socket ret{boost::asio::make_strand(socket.get_executor())};
+    const auto protocol = socket.local_endpoint(ec).protocol();
+    ret.assign(protocol, socket.release(ec), ec);
+    if (ec)
+        fail(ec, "assign");
+    return ret;
+}
+
+// Times out the handshake of a websocket stream, and the connection once silent for `idle_seconds`, pongs included; none if not positive.
+// The websocket stream has timeouts of its own, which those of the stream underneath would only get in the way of.
+template <class WebSocket> void set_timeouts(WebSocket& ws, long handshake_seconds, long idle_seconds) {
+    boost::beast::get_lowest_layer(ws).expires_never();
+    auto timeout = boost::beast::websocket::stream_base::timeout::suggested(boost::beast::role_type::server);
+    if (handshake_seconds > 0)
+        timeout.handshake_timeout = std::chrono::seconds{handshake_seconds};
+    timeout.idle_timeout = idle_seconds > 0 ? std::chrono::seconds{idle_seconds} : boost::beast::websocket::stream_base::none();
+    timeout.keep_alive_pings = true;
+    ws.set_option(timeout);
+}
+
+// Handles a WebSocket connection, upgraded from HTTP/1
+//
+// Every text message from the client is a request of the HTTP API, as a JSON object:
+//     {"id": 1, "method": "GET", "target": "/libvirt/domains", "headers": {"X-Auth-Key": "..."}, "body": {...}}
+// Requests are handled like their HTTP counterparts, concurrently, up to `pipeline-depth` at once; each gets a message in return:
+//     {"id": 1, "status": 200, "body": [...]}
+// A request for GET /libvirt/events subscribes the connection to the events, which then come as {"subscription": 1, "event": {...}},
+// until the subscription is cancelled with {"id": 2, "cancel": 1}, or lags too far behind, which ends it with {"subscription": 1, "end": true}.
+// Clients which presented the auth key on upgrade, or came through a trusted UNIX socket, need not present it on every request.
+//
+// Messages are written one at a time. Events are only taken from their subscriptions once the responses are written, so that
+// a slow client leaves them waiting in the hub, which bounds them. The connection is closed once the client stays silent,
+// pongs included, for longer than `idle-timeout`.
+//
+// `Socket` is the stream socket of the connection: TCP, or UNIX domain for co-located clients.
+template <class Socket> class BasicWebSocketSession : public std::enable_shared_from_this<BasicWebSocketSession<Socket>> {
+    using Stream = boost::beast::basic_stream<typename Socket::protocol_type, typename Socket::executor_type>;
+    using Request = boost::beast::http::request<boost::beast::http::string_body>;
+
+    // Send functor passed to `handle_request` for a message; runs on whichever thread handled the request
+    struct RpcSend {
+        std::shared_ptr<BasicWebSocketSession> self_;
+        std::string id_; ///< of the request, as JSON
+
+        template <bool isRequest, class Body, class Fields> void operator()(boost::beast::http::message<isRequest, Body, Fields>&& msg) const {
+            if constexpr (std::is_same_v<Body, EventStreamBody>) {
+                boost::asio::post(self_->ws_.get_executor(), [self = self_, id = id_, sub = std::move(msg.body())]() mutable {
+                    self->on_reply(reply(id, 200, {}, false));
+                    self->subscribe(std::move(id), std::move(sub));
+                });
+            } else if constexpr (std::is_same_v<Body, VolumeDownloadBody>) {
+                // Dropping the download aborts it; binary content has no place among the JSON messages
+                boost::asio::post(self_->ws_.get_executor(),
+                                  [self = self_, text = reply(id_, 501, "Volume content is only served over HTTP", false)]() mutable {
+                                      self->on_reply(std::move(text));
+                                  });
+            } else {
+                std::string_view body;
+                if constexpr (std::is_same_v<typename Body::value_type, std::string>)
+                    body = msg.body();
+                const auto json = msg[boost::beast::http::field::content_type] == "application/json";
+                boost::asio::post(self_->ws_.get_executor(),
+                                  [self = self_, text = reply(id_, msg.result_int(), body, json)]() mutable { self->on_reply(std::move(text)); });
+            }
+        }
+    };
+
+    // Event subscription made by a request of the connection
+    struct Subscription {
+        std::shared_ptr<EventHub::Subscription> sub;
+        bool ready = true; ///< may have frames pending; otherwise, it wakes the session once it does
+    };
+
+    typename Socket::executor_type executor_;    ///< of the io_context, which handles the requests
+    boost::beast::websocket::stream<Stream> ws_; ///< on a strand, which runs the completion handlers
+    SessionCap::Slot session_slot_;
+    boost::beast::flat_buffer buffer_;
+    std::reference_wrapper<GeneralStore> m_gstore;
+    std::size_t depth_; ///< requests handled at once
+    bool trusted_;
+    std::size_t in_flight_ = 0;
+    bool reading_ = false;
+    bool writing_ = false;
+    bool closed_ = false;
+    std::deque<std::string> out_;                                 ///< messages to write, the one being written first
+    std::unordered_map<std::string, Subscription> subscriptions_; ///< by the id of the request which made them, as JSON
+    std::vector<EventHub::Frame> frames_;
+
+  public:
+    // Take ownership of the socket of an HTTP/1 session; `trusted` tells that the transport already authenticated the peer
+    BasicWebSocketSession(Socket socket, GeneralStore& gstore, bool trusted)
+        : executor_(socket.get_executor()), ws_(on_strand(std::move(socket))), session_slot_(gstore.sessions.open()), m_gstore(gstore),
+          depth_(static_cast<std::size_t>(std::max(1L, gstore.config().http_pipeline_depth))), trusted_(trusted) {}
+
+    // Answer the upgrade request, then serve the connection
+    void run(Request req) {
+        boost::asio::dispatch(ws_.get_executor(),
+                              [self = this->shared_from_this(), req = std::move(req)]() mutable { self->do_accept(std::move(req)); });
+    }
+
+  private:
+    void do_accept(const Request& req) {
+        const auto& config = m_gstore.get().config();
+
+        set_timeouts(ws_, config.http_write_timeout, config.http_idle_timeout);
+        ws_.read_message_max(static_cast<std::uint64_t>(config.http_body_limit + config.http_header_limit));
+
+        trusted_ = trusted_ || !config.isHTTPAuthRequired() || req["X-Auth-Key"] == config.http_auth_key;
+        ws_.async_accept(req, std::bind(&BasicWebSocketSession::on_accept, this->shared_from_this(), std::placeholders::_1));
+    }
+
+    void on_accept(boost::beast::error_code ec) {
+        if (ec == boost::beast::error::timeout)
+            return m_gstore.get().sessions.timed_out();
+        if (ec)
+            return fail(ec, "accept");
+        do_read();
+    }
+
+    void do_read() {
+        reading_ = true;
+        ws_.async_read(buffer_, std::bind(&BasicWebSocketSession::on_read, this->shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void on_read(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+        reading_ = false;
+
+        // This means they closed the connection
+        if (ec == boost::beast::websocket::error::closed || ec == boost::asio::error::operation_aborted)
+            return close();
+        if (ec == boost::beast::error::timeout) {
+            m_gstore.get().sessions.timed_out();
+            return close();
+        }
+        if (ec) {
+            fail(ec, "read");
+            return close();
+        }
+
+        handle_message({static_cast<const char*>(buffer_.data().data()), buffer_.size()});
+        buffer_.consume(buffer_.size());
+        maybe_read();
+    }
+
+    // Turns a message into a request, and hands it over to the io_context
+    void handle_message(std::string_view text) {
+        rapidjson::Document doc;
+        doc.Parse(text.data(), text.size());
+        if (doc.HasParseError() || !doc.IsObject())
+            return send(reply("null", 400, "Malformed message", false));
+
+        std::string id = "null";
+        if (const auto it = doc.FindMember("id"); it != doc.MemberEnd())
+            id = to_json(it->value);
+
+        if (const auto it = doc.FindMember("cancel"); it != doc.MemberEnd()) {
+            const auto found = subscriptions_.erase(to_json(it->value)) != 0;
+            return send(reply(id, found ? 200 : 404, {}, false));
+        }
+
+        const auto method = doc.FindMember("method");
+        const auto target = doc.FindMember("target");
+        if (method == doc.MemberEnd() || !method->value.IsString() || target == doc.MemberEnd() || !target->value.IsString())
+            return send(reply(id, 400, "Missing method or target", false));
+
+        Request req;
+        req.version(11);
+        req.method_string({method->value.GetString(), method->value.GetStringLength()});
+        req.target({target->value.GetString(), target->value.GetStringLength()});
+        if (const auto headers = doc.FindMember("headers"); headers != doc.MemberEnd() && headers->value.IsObject()) {
+            for (const auto& [name, value] : headers->value.GetObject()) {
+                const std::string_view n{name.GetString(), name.GetStringLength()};
+                // Bodies stay plain JSON, to be embedded into the messages
+                if (!value.IsString() || boost::beast::iequals(n, "Accept-Encoding"))
+                    continue;
+                req.set(n, std::string_view{value.GetString(), value.GetStringLength()});
+            }
+        }
+        if (const auto body = doc.FindMember("body"); body != doc.MemberEnd() && !body->value.IsNull())
+            req.body() = body->value.IsString() ? std::string{body->value.GetString(), body->value.GetStringLength()} : to_json(body->value);
+        req.prepare_payload();
+
+        ++in_flight_;
+        boost::asio::post(executor_, [self = this->shared_from_this(), req = std::move(req), id = std::move(id)]() mutable {
+            handle_request(self->m_gstore, self->executor_, std::move(req), RpcSend{self, std::move(id)}, self->trusted_);
+        });
+    }
+
+    void on_reply(std::string text) {
+        --in_flight_;
+        send(std::move(text));
+        maybe_read();
+    }
+
+    void subscribe(std::string id, std::shared_ptr<EventHub::Subscription> sub) {
+        if (closed_)
+            return;
+        subscriptions_.insert_or_assign(std::move(id), Subscription{std::move(sub)});
+        flush();
+    }
+
+    void on_event(const std::string& id) {
+        if (const auto it = subscriptions_.find(id); it != subscriptions_.end())
+            it->second.ready = true;
+        flush();
+    }
+
+    void send(std::string text) {
+        if (closed_)
+            return;
+        out_.push_back(std::move(text));
+        flush();
+    }
+
+    // Writes the next message, taking the pending events once every response is written
+    void flush() {
+        if (writing_ || closed_)
+            return;
+        if (out_.empty())
+            take_events();
+        if (out_.empty())
+            return;
+
+        writing_ = true;
+        ws_.text(true);
+        ws_.async_write(boost::asio::buffer(out_.front()),
+                        std::bind(&BasicWebSocketSession::on_write, this->shared_from_this(), std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void take_events() {
+        for (auto it = subscriptions_.begin(); it != subscriptions_.end();) {
+            auto& [id, subscription] = *it;
+            if (!subscription.ready) {
+                ++it;
+                continue;
+            }
+
+            frames_.clear();
+            const auto open = subscription.sub->take(frames_, [weak = this->weak_from_this(), id = id] {
+                if (auto self = weak.lock())
+                    boost::asio::post(self->ws_.get_executor(), [self, id] { self->on_event(id); });
+            });
+            for (const auto& frame : frames_)
+                if (const auto data = EventHub::frame_data(frame); !data.empty())
+                    out_.push_back(std::string{"{\"subscription\":"}.append(id).append(",\"event\":").append(data).append("}"));
+            if (!open) {
+                out_.push_back(std::string{"{\"subscription\":"}.append(id).append(",\"end\":true}"));
+                it = subscriptions_.erase(it);
+                continue;
+            }
+            subscription.ready = !frames_.empty();
+            ++it;
+        }
+    }
+
+    void on_write(boost::beast::error_code ec, std::size_t bytes_transferred) {
+        boost::ignore_unused(bytes_transferred);
+        writing_ = false;
+
+        if (ec == boost::beast::error::timeout)
+            m_gstore.get().sessions.timed_out();
+        else if (ec && ec != boost::beast::websocket::error::closed && ec != boost::asio::error::operation_aborted)
+            fail(ec, "write");
+        if (ec)
+            return close();
+
+        out_.pop_front();
+        flush();
+    }
+
+    void maybe_read() {
+        if (!reading_ && !closed_ && in_flight_ < depth_)
+            do_read();
+    }
+
+    // Stops serving the connection; the session goes away along with the last handler referring to it
+    void close() {
+        closed_ = true;
+        subscriptions_.clear();
+    }
+
+    static std::string to_json(const rapidjson::Value& value) {
+        rapidjson::StringBuffer out;
+        rapidjson::Writer<rapidjson::StringBuffer> writer{out};
+        value.Accept(writer);
+        return {out.GetString(), out.GetSize()};
+    }
+
+    // Serializes the response to a request; `body` is embedded as is if `json`, else as a string
+    static std::string reply(std::string_view id, unsigned status, std::string_view body, bool json) {
+        rapidjson::StringBuffer out;
+        rapidjson::Writer<rapidjson::StringBuffer> writer{out};
+        writer.StartObject();
+        writer.Key("id");
+        writer.RawValue(id.data(), id.size(), rapidjson::kObjectType);
+        writer.Key("status");
+        writer.Uint(status);
+        if (!body.empty()) {
+            writer.Key("body");
+            if (json)
+                writer.RawValue(body.data(), body.size(), rapidjson::kObjectType);
+            else
+                writer.String(body.data(), static_cast<rapidjson::SizeType>(body.size()));
+        }
+        writer.EndObject();
+        return {out.GetString(), out.GetSize()};
+    }
+};
+
+using WebSocketSession = BasicWebSocketSession<boost::asio::ip::tcp::socket>;
@@ -0,0 +1,109 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <type_traits>
+#include <utility>
+#include <boost/asio/post.hpp>
+#include <boost/asio/steady_timer.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include "virt_wrap/Deadline.hpp"
+
+/**
+ * \internal
+ * Pool running the requests that have a deadline
+ *
+ * The request is answered when its work completes or when its deadline passes, whichever comes first.
+ * In the latter case, the work is left to run to completion on the pool, quarantined: it stops at its next call to libvirt,
+ * but a call in progress (e.g. to the guest agent of a hung guest) cannot be interrupted, and keeps the pool thread busy meanwhile.
+ * Hence the pool is kept small and separate from the threads serving the sessions, which remain responsive.
+ * Deadlines are kept by a thread of their own, so that they still expire while every thread of the pool is stuck.
+ **/
+class QuarantinePool {
+  public:
+    explicit QuarantinePool(long threads) : pool(static_cast<std::size_t>(std::max(threads, 1L))) {}
+
+    QuarantinePool(const QuarantinePool&) = delete;
+    QuarantinePool& operator=(const QuarantinePool&) = delete;
+
+    /**
+     * \internal
+     * Runs `work` on the pool under the deadline `at`, then passes its result to `done`, or calls `expired` if the deadline passed first
+     *
+     * Exactly one of `done` and `expired` is called, from a thread of the pool or from the one keeping the deadlines.
+     * \param[in] at the deadline
+     * \param[in] work callable returning the result; may only throw virt::DeadlineExceeded, when it ran out of time
+     * \param[in] done callable taking the result of `work`
+     * \param[in] expired callable taking no argument
+     **/
+    template <class Work, class Done, class Expired>
+    void run(virt::Deadline::Clock::time_point at, Work&& work, Done&& done, Expired&& expired) {
+        struct State {
+            std::atomic<bool> answered{false};
+            boost::asio::steady_timer timer;
+            std::decay_t<Expired> expired;
+
+            State(boost::asio::thread_pool& timers, virt::Deadline::Clock::time_point at, Expired&& expired)
+                : timer(timers, at), expired(std::forward<Expired>(expired)) {}
+
+            bool answer() noexcept { return !answered.exchange(true); }
+        };
+        auto state = std::make_shared<State>(timers, at, std::forward<Expired>(expired));
+
+        // A request answered on expiry counts as quarantined until its work is over; it is counted before answering,
+        // so that the work cannot uncount it first
+        state->timer.async_wait([this, state](boost::system::error_code ec) {
+            ++quarantined;
+            if (ec || !state->answer()) {
+                --quarantined;
+                return;
+            }
+            ++expired_total;
+            state->expired();
+        });
+
+        boost::asio::post(pool, [this, at, state, work = std::forward<Work>(work), done = std::forward<Done>(done)]() mutable {
+            const virt::Deadline::Scope scope{at};
+            ++running;
+            try {
+                auto res = work();
+                if (state->answer()) {
+                    state->timer.cancel();
+                    done(std::move(res));
+                } else
+                    --quarantined;
+            } catch (const virt::DeadlineExceeded&) {
+                if (state->answer()) {
+                    state->timer.cancel();
+                    ++expired_total;
+                    state->expired();
+                } else
+                    --quarantined;
+            }
+            --running;
+        });
+    }
+
+    /**
+     * \internal
+     * Appends the state of the pool to `out`, in the Prometheus text exposition format
+     **/
+    void write_metrics(std::string& out) const {
+        out.append("# HELP virthttp_deadline_running Requests with a deadline being handled\n# TYPE virthttp_deadline_running gauge\n");
+        out.append("virthttp_deadline_running ").append(std::to_string(running.load())).append("\n");
+        out.append("# HELP virthttp_deadline_quarantined Requests answered with 504 whose work is still running\n");
+        out.append("# TYPE virthttp_deadline_quarantined gauge\n");
+        out.append("virthttp_deadline_quarantined ").append(std::to_string(quarantined.load())).append("\n");
+        out.append("# HELP virthttp_deadline_exceeded_total Requests answered with 504\n# TYPE virthttp_deadline_exceeded_total counter\n");
+        out.append("virthttp_deadline_exceeded_total ").append(std::to_string(expired_total.load())).append("\n");
+    }
+
+  private:
+    boost::asio::thread_pool timers{1}; ///< outlives the pool, whose work cancels its timers
+    boost::asio::thread_pool pool;
+    std::atomic<std::int64_t> running{0};
+    std::atomic<std::int64_t> quarantined{0};
+    std::atomic<std::uint64_t> expired_total{0};
+};
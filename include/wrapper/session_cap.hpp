@@ -0,0 +1,134 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+/**
+ * \internal
+ * Bounds the number of sessions open at once, over all the listeners
+ *
+ * Every session holds a slot for as long as it lives. A listener which finds the cap reached after launching a session stops accepting,
+ * leaving further connections in the backlog of the kernel, and is resumed once a session ends; one listener per session ended,
+ * so that several listeners do not overshoot the cap together. Hence the file descriptors and the memory of the sessions stay bounded,
+ * whatever the number of clients trying to connect.
+ **/
+class SessionCap {
+  public:
+    /**
+     * \internal
+     * Slot of an open session, given back on destruction
+     **/
+    class Slot {
+        SessionCap* cap = nullptr;
+
+      public:
+        Slot() noexcept = default;
+        explicit Slot(SessionCap& cap) noexcept : cap(&cap) {}
+        Slot(Slot&& oth) noexcept : cap(std::exchange(oth.cap, nullptr)) {}
+        Slot& operator=(Slot&& oth) noexcept {
+            if (this != &oth) {
+                this->~Slot();
+                cap = std::exchange(oth.cap, nullptr);
+            }
+            return *this;
+        }
+        ~Slot() {
+            if (cap)
+                cap->close();
+        }
+    };
+
+    /**
+     * \internal
+     * \param[in] max_sessions the cap; none if not positive
+     **/
+    explicit SessionCap(long max_sessions) noexcept : max(max_sessions) {}
+
+    SessionCap(const SessionCap&) = delete;
+    SessionCap& operator=(const SessionCap&) = delete;
+
+    /**
+     * \internal
+     * Counts a session in; never refused, as the connection has been accepted already
+     **/
+    [[nodiscard]] Slot open() {
+        const std::lock_guard lock{mtx};
+        ++count;
+        ++opened_total;
+        return Slot{*this};
+    }
+
+    /**
+     * \internal
+     * Pauses a listener if the cap is reached
+     *
+     * \param[in] resume callable run once the listener may accept again, from the thread closing a session
+     * \return whether the listener was paused; if not, it may accept right away
+     **/
+    bool pause_if_full(std::function<void()> resume) {
+        {
+            const std::lock_guard lock{mtx};
+            if (max <= 0 || count < max)
+                return false;
+            paused.push_back(std::move(resume));
+        }
+        ++pauses_total;
+        return true;
+    }
+
+    /**
+     * \internal
+     * Counts a session closed for going past one of its timeouts
+     **/
+    void timed_out() noexcept { ++timeouts_total; }
+
+    /**
+     * \internal
+     * Appends the state of the sessions to `out`, in the Prometheus text exposition format
+     **/
+    void write_metrics(std::string& out) const {
+        long open_now;
+        {
+            const std::lock_guard lock{mtx};
+            open_now = count;
+        }
+        out.append("# HELP virthttp_sessions_open Sessions open\n# TYPE virthttp_sessions_open gauge\n");
+        out.append("virthttp_sessions_open ").append(std::to_string(open_now)).append("\n");
+        out.append("# HELP virthttp_sessions_limit Sessions allowed open at once, 0 if unbounded\n# TYPE virthttp_sessions_limit gauge\n");
+        out.append("virthttp_sessions_limit ").append(std::to_string(max > 0 ? max : 0)).append("\n");
+        out.append("# HELP virthttp_sessions_opened_total Sessions opened\n# TYPE virthttp_sessions_opened_total counter\n");
+        out.append("virthttp_sessions_opened_total ").append(std::to_string(opened_total.load())).append("\n");
+        out.append("# HELP virthttp_sessions_accept_pauses_total Listeners paused on reaching the limit\n");
+        out.append("# TYPE virthttp_sessions_accept_pauses_total counter\n");
+        out.append("virthttp_sessions_accept_pauses_total ").append(std::to_string(pauses_total.load())).append("\n");
+        out.append("# HELP virthttp_sessions_timeouts_total Sessions closed for going past a timeout\n");
+        out.append("# TYPE virthttp_sessions_timeouts_total counter\n");
+        out.append("virthttp_sessions_timeouts_total ").append(std::to_string(timeouts_total.load())).append("\n");
+    }
+
+  private:
+    void close() {
+        std::function<void()> resume;
+        {
+            const std::lock_guard lock{mtx};
+            --count;
+            if (paused.empty() || count >= max)
+                return;
+            resume = std::move(paused.back());
+            paused.pop_back();
+        }
+        resume();
+    }
+
+    const long max;
+    mutable std::mutex mtx{};
+    long count = 0;
+    std::vector<std::function<void()>> paused{}; ///< resumers of the paused listeners
+    std::atomic<std::uint64_t> opened_total{0};
+    std::atomic<std::uint64_t> pauses_total{0};
+    std::atomic<std::uint64_t> timeouts_total{0};
+};
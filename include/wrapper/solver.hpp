@@ -1,9 +1,11 @@
 #pragma once
+#include <iterator>
 #include <string_view>
 #include <boost/utility/string_view.hpp> // C++2a this include goes away long before using modules
 #include <gsl/gsl>
 #include "handlers/domain.hpp"
 #include "wrapper/handlers/base.hpp"
+#include "small_vector.hpp"
 #include "urlparser.hpp"
 
 using namespace std::literals;
@@ -48,9 +50,15 @@ template <class TPOUH, class KeysT, class FcnsT, class ListFcn> class Resolver {
     constexpr Resolver(TPOUH, std::string_view type, KeysT skeys, FcnsT sfcns, ListFcn list_fcn) noexcept
         : type(type), skeys(skeys), sfcns(sfcns), list_fcn(list_fcn) {}
 
-    auto operator()(HandlerContext& hc) const -> std::vector<O> {
+    /**
+     * \internal
+     * Resolved objects; a lookup by key yields at most one, which is then kept inline
+     **/
+    using Objects = SmallVector<O, 1>;
+
+    auto operator()(HandlerContext& hc) const -> Objects {
         const TargetParser& target = hc.target;
-        using Ret = std::vector<O>;
+        using Ret = Objects;
         auto error = [&](auto... args) { return hc.json_res.error(args...); };
 
         const auto [idx, search_value] = getSearchKey(target);
@@ -68,7 +76,8 @@ template <class TPOUH, class KeysT, class FcnsT, class ListFcn> class Resolver {
             if (!flags_opt)
                 return error(102), Ret{}; // Happens when flags cause failure
             const auto flags = *flags_opt;
-            ret = list_fcn(hc, flags);
+            auto list = list_fcn(hc, flags);
+            ret = Ret{std::make_move_iterator(list.begin()), std::make_move_iterator(list.end())};
         }
         return ret;
     }
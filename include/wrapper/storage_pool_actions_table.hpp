@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include "virt_wrap/StoragePool.hpp"
+#include "actions_table.hpp"
+#include "volume_catalog.hpp"
+
+using StoragePoolActionsHdl = DependsOutcome (*)(const rapidjson::Value& val, JsonRes& json_res, virt::StoragePool& pool);
+class StoragePoolActionsTable : public NamedCallTable<StoragePoolActionsTable, StoragePoolActionsHdl> {
+  private:
+    friend NamedCallTable<StoragePoolActionsTable, StoragePoolActionsHdl>;
+
+    using Hdl = StoragePoolActionsHdl;
+
+    constexpr static std::array<std::string_view, 1> keys = {"refresh"};
+    constexpr static std::array<Hdl, 1> fcns = {+[](const rapidjson::Value& val, JsonRes& json_res, virt::StoragePool& pool) -> DependsOutcome {
+        auto error = [&](auto... args) { return json_res.error(args...), DependsOutcome::FAILURE; };
+        if (!val.IsBool())
+            return error(0);
+        if (!val.GetBool())
+            return DependsOutcome::SUCCESS;
+        if (!virt::RpcLimiter::call([&] { return pool.refresh(); }))
+            return error(602);
+        // The volumes may have changed behind libvirt's back, which the refresh just found out
+        VolumeCatalog::global().invalidate(pool.getName());
+        return DependsOutcome::SUCCESS;
+    }};
+    static_assert(keys.size() == fcns.size());
+} constexpr static const storage_pool_actions_table{};
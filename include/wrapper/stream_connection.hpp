@@ -0,0 +1,24 @@
+#pragma once
+#include <memory>
+#include <mutex>
+#include <string>
+#include "virt_wrap.hpp"
+
+/**
+ * \internal
+ * Connection the long-lived streams of libvirt (consoles, volume transfers) are opened over, shared by all of them
+ *
+ * Unlike those of the ConnectionPool, which belong to a thread, it may be used from any, as the streams outlive the handling of
+ * their request. It is replaced once found dead, the streams opened over the old one keeping it open for as long as they last.
+ *
+ * \param[in] uri the libvirt URI to connect to
+ * \return the connection, or null if it could not be opened
+ **/
+inline std::shared_ptr<virt::Connection> stream_connection(const std::string& uri) {
+    static std::mutex mtx;
+    static std::shared_ptr<virt::Connection> conn;
+    const std::lock_guard lock{mtx};
+    if (!conn || !*conn || !conn->isAlive())
+        conn = std::make_shared<virt::Connection>(uri.c_str());
+    return *conn ? conn : nullptr;
+}
@@ -0,0 +1,181 @@
+#pragma once
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include <boost/asio/post.hpp>
+#include <boost/asio/thread_pool.hpp>
+#include "virt_wrap/Deadline.hpp"
+#include "connection_pool.hpp"
+#include "virt_wrap.hpp"
+
+/**
+ * \internal
+ * Listings of the volumes of storage pools, kept until the pool is refreshed, one of its volumes changes, or they are `ttl` old
+ *
+ * Changes made behind the back of the server (e.g. by virsh) are thus seen within `ttl` at the latest.
+ *
+ * Describing a volume takes two calls to libvirt (for its info and its path), which add up to seconds for pools of thousands of them.
+ * The volumes of a pool are thus split among the threads of the catalog, each describing its share over a connection of its own shard
+ * of the ConnectionPool, so that as many calls are in flight at once, within the bound of the RpcLimiter of the endpoint they all share.
+ **/
+class VolumeCatalog {
+  public:
+    constexpr static std::size_t threads = 8;      ///< volumes described at once
+    constexpr static std::size_t min_share = 32;   ///< volumes below which splitting a listing further costs more than it saves
+    constexpr static std::chrono::seconds ttl{30}; ///< age past which a listing is made anew
+
+    /**
+     * \internal
+     * Description of a volume
+     **/
+    struct Volume {
+        std::string name;
+        std::string key;
+        std::string path;
+        std::optional<virt::StorageVol::Info> info; ///< null until described
+    };
+
+    /**
+     * \internal
+     * Volumes of a pool, as listed at some point; shared with the cache, hence immutable
+     **/
+    using Listing = std::shared_ptr<const std::vector<Volume>>;
+
+    /**
+     * \internal
+     * Catalog of the whole process, whose threads are started on first use
+     **/
+    [[nodiscard]] static VolumeCatalog& global() {
+        static VolumeCatalog catalog{};
+        return catalog;
+    }
+
+    VolumeCatalog(const VolumeCatalog&) = delete;
+    VolumeCatalog& operator=(const VolumeCatalog&) = delete;
+
+    /**
+     * \internal
+     * Lists the volumes of `pool`, found over `conn`, or gets them from the cache if they were listed since the last invalidation,
+     * less than `ttl` ago
+     *
+     * To be called from a thread serving a request, which waits for the threads of the catalog to be done; volumes which vanished
+     * meanwhile are left out. The deadline of the calling thread, if any, applies to the calls of the catalog's threads as well.
+     * \return the listing, or null if the volumes could not be listed
+     * \throw virt::DeadlineExceeded if the deadline passed before the volumes were all described
+     **/
+    [[nodiscard]] Listing list(const virt::Connection& conn, const virt::StoragePool& pool) {
+        const std::string name = pool.getName();
+        std::uint64_t listed_at{};
+        const auto now = std::chrono::steady_clock::now();
+        {
+            const std::lock_guard lock{mtx};
+            if (const auto it = listings.find(name); it != listings.end()) {
+                if (now - it->second.at < ttl)
+                    return it->second.listing;
+                listings.erase(it);
+            }
+            listed_at = generation;
+        }
+
+        std::vector<Volume> volumes;
+        try {
+            auto vols = conn.limited([&] { return pool.extractAllVolumes(); });
+            volumes.reserve(vols.size());
+            // Neither takes a call to libvirt, the handle of a volume carrying them
+            for (const auto& vol : vols)
+                volumes.push_back({vol.getName(), vol.getKey(), {}, std::nullopt});
+        } catch (const std::runtime_error&) {
+            return nullptr;
+        }
+
+        const UniqueZstring uri_str{conn.getURI()};
+        if (!uri_str)
+            return nullptr;
+        const std::string uri{uri_str.begin(), uri_str.end()};
+        const auto at = virt::Deadline::current();
+        const auto shares = std::clamp<std::size_t>(volumes.size() / min_share, 1, threads);
+        std::vector<std::future<bool>> described;
+        described.reserve(shares);
+        for (std::size_t i = 0; i < shares; ++i) {
+            const auto first = volumes.begin() + volumes.size() * i / shares;
+            const auto last = volumes.begin() + volumes.size() * (i + 1) / shares;
+            std::packaged_task<bool()> task{[&, first, last] { return describe(uri, name, at, first, last); }};
+            described.push_back(task.get_future());
+            boost::asio::post(workers, std::move(task));
+        }
+        // Every share refers to the volumes, so that all are waited for before any failure is reported
+        for (const auto& share : described)
+            share.wait();
+        for (auto& share : described)
+            if (!share.get())
+                return nullptr;
+
+        volumes.erase(std::remove_if(volumes.begin(), volumes.end(), [](const Volume& vol) { return !vol.info; }), volumes.end());
+        Listing ret = std::make_shared<const std::vector<Volume>>(std::move(volumes));
+        const std::lock_guard lock{mtx};
+        // A listing which began before an invalidation may be missing its changes
+        if (generation == listed_at)
+            listings.insert_or_assign(name, Cached{ret, now});
+        return ret;
+    }
+
+    /**
+     * \internal
+     * Drops the listing of the pool named `pool`, which changed
+     **/
+    void invalidate(const std::string& pool) {
+        const std::lock_guard lock{mtx};
+        ++generation;
+        listings.erase(pool);
+    }
+
+  private:
+    VolumeCatalog() : workers(threads) {}
+
+    using Iterator = std::vector<Volume>::iterator;
+
+    // Describes the volumes in [first, last) of the pool named `pool`, from a thread of the catalog
+    static bool describe(const std::string& uri, const std::string& pool, virt::Deadline::Clock::time_point at, Iterator first,
+                         Iterator last) {
+        const virt::Deadline::Scope scope{at};
+        auto conn = ConnectionPool::local().acquire(uri);
+        if (!conn)
+            return false;
+        // Handles are bound to the connection which got them, hence the pool is looked up again over this one
+        const auto pool_here = conn->limited([&] { return conn->storagePoolLookupByName(pool.c_str()); });
+        if (!pool_here)
+            return false;
+        for (auto it = first; it != last; ++it) {
+            const auto vol = conn->limited([&] { return pool_here.volLookupByName(it->name.c_str()); });
+            if (!vol)
+                continue;
+            auto info = conn->limited([&] { return vol.getInfo(); });
+            if (!info)
+                continue;
+            if (const auto path = conn->limited([&] { return vol.getPath(); }); path)
+                it->path.assign(path.begin(), path.end());
+            it->info = std::move(info);
+        }
+        return true;
+    }
+
+    // Listing, with the time it began at
+    struct Cached {
+        Listing listing;
+        std::chrono::steady_clock::time_point at;
+    };
+
+    std::mutex mtx;
+    std::unordered_map<std::string, Cached> listings;
+    std::uint64_t generation = 0; ///< invalidations so far
+    boost::asio::thread_pool workers;
+};
@@ -0,0 +1,433 @@
+#pragma once
+#include <algorithm>
+#include <charconv>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <boost/beast/http/message.hpp>
+#include <libvirt/libvirt.h>
+#include "admission.hpp"
+#include "content_digest.hpp"
+#include "virt_wrap.hpp"
+#include "volume_catalog.hpp"
+#include "zero_scan.hpp"
+
+/**
+ * \internal
+ * Byte range of a resource, as asked for by the `Range` header of a request
+ **/
+struct ByteRange {
+    unsigned long long offset;
+    unsigned long long length;
+
+    /**
+     * \internal
+     * Reads a `Range` header for a resource of `size` bytes; only a single range of bytes is honoured, anything else (none, several,
+     * or in other units) asking for the whole resource
+     *
+     * \return the range, `std::nullopt` for the whole resource, or an empty range if the one asked for starts past its end
+     **/
+    [[nodiscard]] static std::optional<ByteRange> parse(std::string_view header, unsigned long long size) noexcept {
+        constexpr std::string_view unit = "bytes=";
+        if (header.substr(0, unit.size()) != unit || header.find(',') != std::string_view::npos)
+            return std::nullopt;
+        header.remove_prefix(unit.size());
+        const auto dash = header.find('-');
+        if (dash == std::string_view::npos)
+            return std::nullopt;
+
+        const auto number = [](std::string_view str) -> std::optional<unsigned long long> {
+            unsigned long long value{};
+            const auto last = str.data() + str.size();
+            if (const auto [ptr, ec] = std::from_chars(str.data(), last, value); str.empty() || ec != std::errc{} || ptr != last)
+                return std::nullopt;
+            return value;
+        };
+        const auto first = header.substr(0, dash);
+        const auto last = header.substr(dash + 1);
+
+        // The last `n` bytes
+        if (first.empty()) {
+            const auto suffix = number(last);
+            if (!suffix)
+                return std::nullopt;
+            const auto length = std::min(*suffix, size);
+            return length == 0 ? ByteRange{size, 0} : ByteRange{size - length, length};
+        }
+
+        const auto from = number(first);
+        if (!from)
+            return std::nullopt;
+        if (*from >= size)
+            return ByteRange{size, 0};
+        if (last.empty())
+            return ByteRange{*from, size - *from};
+        const auto to = number(last);
+        if (!to || *to < *from)
+            return std::nullopt;
+        return ByteRange{*from, std::min(*to, size - 1) - *from + 1};
+    }
+};
+
+/**
+ * \internal
+ * Transfer of the content of a storage volume over a stream of libvirt, to or from a client
+ *
+ * The stream may be non-blocking, in which case a session finding it not ready registers a waker, called by the event loop of libvirt
+ * once it is; the stream is only watched meanwhile, lest the loop keep reporting a readiness nobody waits for.
+ *
+ * The content is digested as it goes through, if asked to, rather than in a second pass over the volume.
+ **/
+class VolumeTransfer : public std::enable_shared_from_this<VolumeTransfer> {
+  public:
+    constexpr static long would_block = -2; ///< returned when the stream is not ready yet
+
+    VolumeTransfer(std::shared_ptr<virt::Connection> conn, bool nonblocking)
+        : conn(std::move(conn)), stream(*this->conn, nonblocking ? virt::Stream::Flag{virt::Stream::Flag::NONBLOCK} : virt::Stream::Flag{}) {}
+    VolumeTransfer(const VolumeTransfer&) = delete;
+    VolumeTransfer& operator=(const VolumeTransfer&) = delete;
+
+    virtual ~VolumeTransfer() {
+        if (registered)
+            stream.eventRemoveCallback();
+        if (!over)
+            stream.abort();
+    }
+
+    ContentDigest digest{}; ///< of the content transferred so far; none are computed unless set before it starts
+
+  protected:
+    // Registers the callback of the stream, not watching anything yet; false on failure
+    bool register_callback() {
+        auto watch = std::make_unique<std::weak_ptr<VolumeTransfer>>(weak_from_this());
+        if (!stream.eventAddCallback(0, &VolumeTransfer::on_event, watch.get(), &VolumeTransfer::free_watch))
+            return false;
+        watch.release();
+        return registered = true;
+    }
+
+    // Calls `wake` once the stream has `events`, from the thread of the libvirt event loop; false on failure
+    bool watch(int events, std::function<void()> wake) {
+        const std::lock_guard lock{mtx};
+        waker = std::move(wake);
+        return stream.eventUpdateCallback(events | VIR_STREAM_EVENT_ERROR | VIR_STREAM_EVENT_HANGUP);
+    }
+
+    std::shared_ptr<virt::Connection> conn;
+    virt::Stream stream;
+    bool over = false; ///< finished; nothing to abort
+
+  private:
+    static void on_event(virStreamPtr, int, void* opaque) {
+        const auto self = static_cast<std::weak_ptr<VolumeTransfer>*>(opaque)->lock();
+        if (!self)
+            return;
+        std::function<void()> wake;
+        {
+            const std::lock_guard lock{self->mtx};
+            self->stream.eventUpdateCallback(0);
+            wake = std::exchange(self->waker, nullptr);
+        }
+        if (wake)
+            wake();
+    }
+
+    static void free_watch(void* opaque) { delete static_cast<std::weak_ptr<VolumeTransfer>*>(opaque); }
+
+    bool registered = false;
+    std::mutex mtx{};
+    std::function<void()> waker{}; ///< of the session waiting for the stream
+};
+
+/**
+ * \internal
+ * Download of (a range of) the content of a storage volume, received out of libvirt as the client takes it
+ *
+ * The stream is non-blocking: the session receives from it only once it wrote what it received before, straight into the buffer it
+ * writes from, and finding nothing ready, waits for the event loop of libvirt to wake it. A download thus holds no thread and buffers
+ * no more than a session writes at once, whatever the size of the volume; any number of them may go on at the same time.
+ * Once all of the content was received, the session ends the download with `finish`, a blocking call, out of its strand.
+ *
+ * A sparse download skips the holes of the volume, the content then being a sequence of segments, each made of a kind, `D` for data
+ * or `H` for a hole, and a length, as a 64-bit big-endian integer; data segments go on with as many bytes of data.
+ **/
+class VolumeDownload : public VolumeTransfer {
+  public:
+    constexpr static std::size_t segment_header_size = 9; ///< of a segment of a sparse download
+
+    /**
+     * \internal
+     * Starts downloading `length` bytes of `vol` from `offset`, over `conn`, which it keeps open meanwhile
+     *
+     * \return the download, or null if libvirt refused it
+     **/
+    [[nodiscard]] static std::shared_ptr<VolumeDownload> start(std::shared_ptr<virt::Connection> conn, virt::StorageVol& vol,
+                                                               unsigned long long offset, unsigned long long length, bool sparse = false) {
+        auto ret = std::make_shared<VolumeDownload>(std::move(conn), length, sparse);
+        if (!ret->stream)
+            return nullptr;
+        // libvirt takes a length of 0 as "up to the end"
+        if (length == 0) {
+            ret->received = ret->over = true;
+            return ret;
+        }
+        auto flags = virt::StorageVol::DownloadFlag{};
+        if (sparse)
+            flags = virt::StorageVol::DownloadFlag::SPARSE_STREAM;
+        if (!vol.download(ret->stream, offset, length, flags) || !ret->register_callback())
+            return nullptr;
+        return ret;
+    }
+
+    VolumeDownload(std::shared_ptr<virt::Connection> conn, unsigned long long length, bool sparse)
+        : VolumeTransfer(std::move(conn), true), remaining(length), sparse(sparse) {}
+
+    /**
+     * \internal
+     * Receives up to `len` bytes of the content into `buf`, at least `segment_header_size` + 1 for sparse downloads;
+     * if none are ready yet, `wake` is called once there are, from the thread of the libvirt event loop
+     *
+     * \return the number of bytes received, 0 once all of them were, `would_block`, or -1 if the download failed
+     **/
+    long read(char* buf, std::size_t len, std::function<void()> wake) {
+        const auto n = receive(buf, len, std::move(wake));
+        if (n > 0)
+            digest.update(buf, static_cast<std::size_t>(n));
+        return n;
+    }
+
+    /**
+     * \internal
+     * Ends the download, once `read` returned 0; makes a call to libvirt, and waits for it
+     *
+     * \return whether libvirt confirmed that the content was whole
+     **/
+    bool finish() {
+        if (!over)
+            over = stream.finish();
+        return over;
+    }
+
+    /**
+     * \internal
+     * Whether the whole content was received, and the download finished
+     **/
+    [[nodiscard]] bool done() const noexcept { return over && staged_at == staged.size(); }
+
+  private:
+    long receive(char* buf, std::size_t len, std::function<void()> wake) {
+        if (staged_at != staged.size())
+            return unstage(buf, len);
+        if (received)
+            return 0;
+        if (sparse) {
+            if (len > segment_header_size)
+                return read_segment(buf, len, std::move(wake));
+            // Too little room for a segment; it is then received aside and handed out over as many reads as it takes
+            staged.resize(segment_header_size + staging_size);
+            const auto n = read_segment(staged.data(), staged.size(), std::move(wake));
+            staged.resize(n > 0 ? static_cast<std::size_t>(n) : 0);
+            staged_at = 0;
+            return n > 0 ? unstage(buf, len) : n;
+        }
+
+        const auto n = stream.recv(buf, static_cast<std::size_t>(std::min<unsigned long long>(len, remaining)));
+        if (n == would_block)
+            return watch(VIR_STREAM_EVENT_READABLE, std::move(wake)) ? would_block : -1;
+        // The volume ending before the range did is as much of a failure
+        if (n <= 0)
+            return -1;
+        remaining -= static_cast<unsigned long long>(n);
+        received = remaining == 0;
+        return n;
+    }
+
+    long read_segment(char* buf, std::size_t len, std::function<void()> wake) {
+        const auto n = stream.recv(buf + segment_header_size, len - segment_header_size, virt::Stream::RecvFlag::STOP_AT_HOLE);
+        if (n == would_block)
+            return watch(VIR_STREAM_EVENT_READABLE, std::move(wake)) ? would_block : -1;
+        // At a hole
+        if (n == -3) {
+            const auto hole = stream.recvHole();
+            if (!hole || *hole < 0)
+                return -1;
+            encode_segment_header(buf, 'H', static_cast<unsigned long long>(*hole));
+            return segment_header_size;
+        }
+        if (n < 0)
+            return -1;
+        if (n == 0) {
+            received = true;
+            return 0;
+        }
+        encode_segment_header(buf, 'D', static_cast<unsigned long long>(n));
+        return static_cast<long>(segment_header_size) + n;
+    }
+
+    long unstage(char* buf, std::size_t len) noexcept {
+        const auto n = std::min(len, staged.size() - staged_at);
+        std::copy_n(staged.data() + staged_at, n, buf);
+        staged_at += n;
+        return static_cast<long>(n);
+    }
+
+    static void encode_segment_header(char* out, char kind, unsigned long long length) noexcept {
+        out[0] = kind;
+        for (std::size_t i = 0; i < 8; ++i)
+            out[1 + i] = static_cast<char>((length >> (56 - 8 * i)) & 0xFF);
+    }
+
+    constexpr static std::size_t staging_size = 64; ///< of the data received aside
+
+    unsigned long long remaining; ///< bytes of the range yet to be received, if not sparse
+    bool sparse;
+    bool received = false;     ///< the whole content; the download is yet to be finished
+    std::string staged{};      ///< segment received aside, for want of room
+    std::size_t staged_at = 0; ///< part of it already handed out
+};
+
+/**
+ * \internal
+ * Upload of content into a storage volume, sent into libvirt as the client sends it
+ *
+ * A sparse upload looks for zero blocks in the data, aligned on the volume, and sends the runs of them as holes rather than bytes;
+ * most of an image being zeroes, only what it allocates then goes through libvirt, and the volume stays as sparse as the image.
+ **/
+class VolumeUpload : public VolumeTransfer {
+  public:
+    constexpr static std::size_t block_size = 4096; ///< granularity of the holes found in the data
+
+    /**
+     * \internal
+     * Starts uploading `length` bytes into `vol` from `offset`, over `conn`, which it keeps open meanwhile
+     *
+     * \param[in] nonblocking whether `write` may return `would_block` rather than wait for libvirt to take the data
+     * \return the upload, or null if libvirt refused it
+     **/
+    [[nodiscard]] static std::shared_ptr<VolumeUpload> start(std::shared_ptr<virt::Connection> conn, virt::StorageVol& vol,
+                                                             unsigned long long offset, unsigned long long length, bool sparse,
+                                                             bool nonblocking) {
+        auto ret = std::make_shared<VolumeUpload>(std::move(conn), sparse, nonblocking);
+        if (!ret->stream)
+            return nullptr;
+        auto flags = virt::StorageVol::UploadFlag{};
+        if (sparse)
+            flags = virt::StorageVol::UploadFlag::SPARSE_STREAM;
+        if (!vol.upload(ret->stream, offset, length, flags) || (nonblocking && !ret->register_callback()))
+            return nullptr;
+        return ret;
+    }
+
+    VolumeUpload(std::shared_ptr<virt::Connection> conn, bool sparse, bool nonblocking)
+        : VolumeTransfer(std::move(conn), nonblocking), sparse(sparse) {}
+
+    ~VolumeUpload() override {
+        // Whether it went through or not, the volume changed
+        if (!pool.empty())
+            VolumeCatalog::global().invalidate(pool);
+    }
+
+    std::string pool{}; ///< name of the pool of the volume, whose listing is dropped from the VolumeCatalog once the upload is over
+
+    /**
+     * \internal
+     * Sends as much as libvirt takes of the `len` bytes at `data`; if it takes none, `wake` is called once it would,
+     * from the thread of the libvirt event loop
+     *
+     * \return the number of bytes taken, `would_block`, or -1 if the upload failed
+     **/
+    long write(const char* data, std::size_t len, std::function<void()> wake) {
+        const auto n = send(data, len, std::move(wake));
+        if (n > 0)
+            digest.update(data, static_cast<std::size_t>(n));
+        return n;
+    }
+
+    /**
+     * \internal
+     * Ends the upload, once all of the data was taken
+     *
+     * \return whether libvirt stored it all
+     **/
+    bool finish() {
+        if (hole != 0 && !flush_hole())
+            return false;
+        return over = stream.finish();
+    }
+
+  private:
+    long send(const char* data, std::size_t len, std::function<void()> wake) {
+        std::size_t taken = 0;
+        while (taken < len) {
+            const auto* const at = data + taken;
+            auto size = len - taken;
+            if (sparse) {
+                if (position % block_size == 0) {
+                    if (const auto zeros = zero_scan::zero_blocks(at, size, block_size) * block_size; zeros != 0) {
+                        hole += zeros;
+                        position += zeros;
+                        taken += zeros;
+                        continue;
+                    }
+                }
+                if (hole != 0 && !flush_hole())
+                    return -1;
+                // Up to the next zero block, the bytes before the next boundary always being data
+                const auto head = std::min<std::size_t>(size, (block_size - position % block_size) % block_size);
+                size = head + zero_scan::first_zero_block(at + head, size - head, block_size);
+            }
+
+            const auto n = stream.send(at, size);
+            if (n == would_block) {
+                if (taken != 0)
+                    return static_cast<long>(taken);
+                return watch(VIR_STREAM_EVENT_WRITABLE, std::move(wake)) ? would_block : -1;
+            }
+            if (n < 0)
+                return -1;
+            position += static_cast<unsigned long long>(n);
+            taken += static_cast<std::size_t>(n);
+        }
+        return static_cast<long>(taken);
+    }
+
+    bool flush_hole() { return stream.sendHole(static_cast<long long>(std::exchange(hole, 0))); }
+
+    bool sparse;
+    unsigned long long position = 0; ///< bytes taken so far, holes included
+    unsigned long long hole = 0;     ///< length of the run of zero blocks not sent yet
+};
+
+/**
+ * \internal
+ * Body of a response carrying the content of a volume
+ *
+ * Responses with this body are not written at once: the sessions recognise them and write the content as it is received.
+ * The `Content-Length` of the response is that of the range being downloaded, unless it is sparse; HTTP/1 sessions chunk the content
+ * instead when its digests follow it, in a trailer.
+ **/
+struct VolumeDownloadBody {
+    using value_type = std::shared_ptr<VolumeDownload>;
+};
+
+using VolumeDownloadResponse = boost::beast::http::response<VolumeDownloadBody>;
+
+/**
+ * \internal
+ * Body of the response to an upload whose content is yet to be read, carrying the upload it goes into
+ *
+ * The session reads the body of the request into the upload once every response before it is written, then answers the request
+ * with the header of this response, or with an error if the upload fails. The upload keeps the admission ticket of its request.
+ **/
+struct VolumeUploadBody {
+    struct value_type {
+        std::shared_ptr<VolumeUpload> upload;
+        AdmissionController::Ticket ticket;
+    };
+};
+
+using VolumeUploadResponse = boost::beast::http::response<VolumeUploadBody>;
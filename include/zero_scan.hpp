@@ -0,0 +1,80 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#if defined(__AVX2__) || defined(__SSE2__)
+#include <immintrin.h>
+#endif
+
+/**
+ * \internal
+ * \file
+ * Detection of all-zero blocks, to turn them into holes of sparse streams
+ *
+ * The bytes are ORed together a few vectors at a time (AVX2 when compiled for it, SSE2 on any x86-64, machine words elsewhere),
+ * bailing out at the first group holding a set bit; data blocks are thus usually told apart within their first bytes,
+ * while zero blocks are scanned at memory bandwidth.
+ **/
+
+namespace zero_scan {
+
+/**
+ * \internal
+ * Whether the `size` bytes at `data` are all zero
+ **/
+[[nodiscard]] inline bool all_zero(const char* data, std::size_t size) noexcept {
+    std::size_t i = 0;
+#if defined(__AVX2__)
+    for (; i + 64 <= size; i += 64) {
+        const auto a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+        const auto b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i + 32));
+        const auto acc = _mm256_or_si256(a, b);
+        if (!_mm256_testz_si256(acc, acc))
+            return false;
+    }
+#elif defined(__SSE2__)
+    for (; i + 64 <= size; i += 64) {
+        const auto a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+        const auto b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 16));
+        const auto c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 32));
+        const auto d = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i + 48));
+        const auto acc = _mm_or_si128(_mm_or_si128(a, b), _mm_or_si128(c, d));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(acc, _mm_setzero_si128())) != 0xFFFF)
+            return false;
+    }
+#endif
+    for (; i + sizeof(std::uint64_t) <= size; i += sizeof(std::uint64_t)) {
+        std::uint64_t word;
+        std::memcpy(&word, data + i, sizeof(word));
+        if (word != 0)
+            return false;
+    }
+    for (; i < size; ++i)
+        if (data[i] != 0)
+            return false;
+    return true;
+}
+
+/**
+ * \internal
+ * Number of whole `block`-sized zero blocks `data` starts with, out of its `size` bytes
+ **/
+[[nodiscard]] inline std::size_t zero_blocks(const char* data, std::size_t size, std::size_t block) noexcept {
+    std::size_t n = 0;
+    while ((n + 1) * block <= size && all_zero(data + n * block, block))
+        ++n;
+    return n;
+}
+
+/**
+ * \internal
+ * Offset of the first whole `block`-sized zero block of `data`, out of its `size` bytes, or `size` if there is none
+ **/
+[[nodiscard]] inline std::size_t first_zero_block(const char* data, std::size_t size, std::size_t block) noexcept {
+    for (std::size_t off = 0; off + block <= size; off += block)
+        if (all_zero(data + off, block))
+            return off;
+    return size;
+}
+
+} // namespace zero_scan
@@ -1,8 +1,17 @@
 //
 // Created by hugo on 30.01.19.
 //
+#include <csignal>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <thread>
+#include <vector>
 #include <gsl/gsl>
+#ifdef __linux__
+#include <pthread.h>
+#include <sched.h>
+#endif
 #include "wrapper/config.hpp"
 #include "wrapper/general_store.hpp"
 #include "wrapper/http_wrapper.hpp"
@@ -10,6 +19,79 @@
 
 using namespace std::literals;
 
+/**
+ * \internal
+ * Pins the calling thread to a CPU; best effort
+ *
+ * \param[in] cpu the index of the CPU
+ **/
+void pin_to_cpu(unsigned cpu) {
+#ifdef __linux__
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu % CPU_SETSIZE, &set);
+    if (const auto rc = pthread_setaffinity_np(pthread_self(), sizeof(set), &set); rc != 0)
+        logger.warning("Unable to pin a thread to CPU ", cpu, ": ", std::strerror(rc));
+#else
+    logger.warning("Pinning threads is not supported on this platform");
+#endif
+}
+
+/**
+ * \internal
+ * Launches the UNIX domain socket listener, if one is configured
+ **/
+void run_unix_listener(boost::beast::net::io_context& ioc, GeneralStore& gstore) {
+    const auto& path = gstore.config().http_unix_socket;
+    if (path.empty())
+        return;
+#ifdef BOOST_ASIO_HAS_LOCAL_SOCKETS
+    logger.info("http server socket: ", path);
+    std::make_shared<UnixListener>(ioc, path, gstore)->run();
+#else
+    logger.warning("UNIX domain sockets are not supported on this platform; not listening on ", path);
+#endif
+}
+
+/**
+ * \internal
+ * Thread-per-core serving: each thread runs its own io_context, with its own SO_REUSEPORT listener on the same endpoint
+ *
+ * The kernel spreads incoming connections among the listeners, and a connection stays on the core which accepted it,
+ * along with the per-thread state it uses (JSON arena, libvirt connection pool shard, compressor); nothing on that path is shared between cores.
+ **/
+int run_per_core(GeneralStore& gstore, const boost::beast::net::ip::tcp::endpoint& endpoint) {
+    const auto threads = gstore.config().http_threads > 0 ? gsl::narrow_cast<unsigned>(gstore.config().http_threads)
+                                                          : std::max(1u, std::thread::hardware_concurrency());
+    const auto pin = gstore.config().http_pin_threads;
+    logger.info("Serving on ", threads, " cores");
+
+    // A concurrency hint of 1 lets Asio skip the locking it needs to run one io_context on several threads
+    std::vector<std::unique_ptr<boost::beast::net::io_context>> contexts;
+    contexts.reserve(threads);
+    for (auto i = 0u; i < threads; ++i) {
+        contexts.push_back(std::make_unique<boost::beast::net::io_context>(1));
+        std::make_shared<TcpListener>(*contexts.back(), endpoint, gstore, true)->run();
+    }
+    run_unix_listener(*contexts.front(), gstore);
+
+    std::vector<std::thread> v;
+    v.reserve(threads - 1);
+    for (auto i = threads - 1; i > 0; --i)
+        v.emplace_back([&ioc = *contexts[i], i, pin] {
+            if (pin)
+                pin_to_cpu(i);
+            ioc.run();
+        });
+    if (pin)
+        pin_to_cpu(0);
+    contexts.front()->run();
+    for (auto& t : v)
+        t.join();
+
+    return EXIT_SUCCESS;
+}
+
 /**
  * \internal
  * \brief Program entry-point
@@ -24,16 +106,28 @@ int main(int argc, char** argv) {
     if (!gstore.config().isHTTPAuthRequired())
         logger.warning("The HTTP authentication is disabled! Beware of unauthorized access!");
 
+    // Raw graphics tunnels splice into the sockets of their clients, which, unlike sends, cannot be kept from raising SIGPIPE
+    std::signal(SIGPIPE, SIG_IGN);
+
+    // The event loop of libvirt has to be registered before any connection is opened
+    gstore.events.start(gstore.config().getConnURI());
+
     const auto address = boost::beast::net::ip::make_address(gstore.config().http_address);
     const auto port = static_cast<unsigned short>(gstore.config().http_port);
     const auto doc_root = std::make_shared<std::string>(gstore.config().http_doc_root);
+    const auto endpoint = boost::beast::net::ip::tcp::endpoint{address, port};
+
+    if (gstore.config().http_thread_per_core)
+        return run_per_core(gstore, endpoint);
+
     const auto threads = std::max(1, gsl::narrow_cast<int>(gstore.config().http_threads));
 
     // The io_context is required for all I/O
     boost::beast::net::io_context ioc{threads};
 
     // Create and launch a listening port
-    std::make_shared<TcpListener>(ioc, boost::beast::net::ip::tcp::endpoint{address, port}, gstore)->run();
+    std::make_shared<TcpListener>(ioc, endpoint, gstore)->run();
+    run_unix_listener(ioc, gstore);
 
     // Run the I/O service on the requested number of threads
     std::vector<std::thread> v;
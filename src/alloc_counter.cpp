@@ -0,0 +1,36 @@
+#include <cstdlib>
+#include <new>
+#include "alloc_counter.hpp"
+
+#ifdef VIRTHTTP_COUNT_ALLOCS
+
+namespace alloc_counter {
+namespace {
+thread_local std::size_t allocs = 0;
+}
+
+std::size_t thread_allocs() noexcept { return allocs; }
+void note() noexcept { ++allocs; }
+} // namespace alloc_counter
+
+void* operator new(std::size_t size) {
+    alloc_counter::note();
+    if (void* ptr = std::malloc(size ? size : 1))
+        return ptr;
+    throw std::bad_alloc{};
+}
+void* operator new[](std::size_t size) { return ::operator new(size); }
+void* operator new(std::size_t size, const std::nothrow_t&) noexcept {
+    alloc_counter::note();
+    return std::malloc(size ? size : 1);
+}
+void* operator new[](std::size_t size, const std::nothrow_t& tag) noexcept { return ::operator new(size, tag); }
+
+void operator delete(void* ptr) noexcept { std::free(ptr); }
+void operator delete[](void* ptr) noexcept { std::free(ptr); }
+void operator delete(void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, std::size_t) noexcept { std::free(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { std::free(ptr); }
+
+#endif
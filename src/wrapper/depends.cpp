@@ -1,7 +1,7 @@
 #include <algorithm>
 #include "wrapper/depends.hpp"
 
-bool check_depends(const rapidjson::Value& json, std::vector<DependsOutcome>& outcomes, JsonRes& json_res) noexcept {
+bool check_depends(const rapidjson::Value& json, DependsOutcomes& outcomes, JsonRes& json_res) noexcept {
     auto error = [&](auto... args) { return json_res.error(args...); };
     if (!json.IsObject())
         return true;
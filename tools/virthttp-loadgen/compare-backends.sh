@@ -0,0 +1,29 @@
+#!/bin/sh
+# Compares two virthttp builds, typically the default (epoll) one and a -DVIRTHTTP_IO_URING=ON one,
+# under 1k and 10k keep-alive connections against libvirt's test driver.
+# Reports are printed and written to backend-<name>-<connections>.json in the current directory.
+#
+# Usage: compare-backends.sh LOADGEN EPOLL_BINARY URING_BINARY [extra virthttp-loadgen options...]
+set -eu
+
+if [ $# -lt 3 ]; then
+    sed -n '2,6p' "$0" | cut -c3-
+    exit 1
+fi
+
+loadgen=$1
+epoll=$2
+uring=$3
+shift 3
+
+# Each connection is a descriptor on both ends
+ulimit -n 65536 2>/dev/null || echo "warning: could not raise the open files limit to 65536 ($(ulimit -n))" >&2
+
+for connections in 1000 10000; do
+    for backend in epoll uring; do
+        eval binary=\$$backend
+        echo "== $backend, $connections connections"
+        "$loadgen" --server "$binary" --server-threads 4 --threads 4 --connections "$connections" --warmup 5 --duration 30 \
+            --json "backend-$backend-$connections.json" "$@"
+    done
+done
@@ -0,0 +1,159 @@
+#pragma once
+
+#include <atomic>
+#include <charconv>
+#include <chrono>
+#include <memory>
+#include <optional>
+#include <random>
+#include <string>
+#include <boost/asio.hpp>
+#include <boost/beast.hpp>
+#include "stats.hpp"
+#include "workload.hpp"
+
+/**
+ * \internal
+ * State shared by every client of a run
+ **/
+struct RunControl {
+    boost::asio::ip::tcp::endpoint endpoint;
+    std::string host;      ///< value of the `Host` header
+    std::string auth_key;  ///< sent as `X-Auth-Key` when not empty
+    std::chrono::steady_clock::time_point measure_from; ///< responses completed before this are warmup and not recorded
+    std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max();
+    std::atomic<long long> budget{-1}; ///< requests left to send; negative means unbounded
+    std::atomic<bool> stop{false};
+};
+
+/**
+ * \internal
+ * One keep-alive connection issuing requests back-to-back (closed loop), reconnecting whenever the server closes it
+ **/
+class Client : public std::enable_shared_from_this<Client> {
+  public:
+    Client(boost::asio::io_context& ioc, RunControl& ctl, Workload& wl, Recorder& rec, std::uint64_t seed)
+        : sock_(ioc), ctl_(ctl), wl_(wl), rec_(rec), rng_(seed), dist_(wl.distribution()) {}
+
+    void run() { connect(); }
+
+  private:
+    using clock = std::chrono::steady_clock;
+
+    void connect() {
+        sock_.async_connect(ctl_.endpoint, [self = shared_from_this()](boost::beast::error_code ec) {
+            if (ec) {
+                ++self->rec_.transport_errors;
+                return self->retry_later();
+            }
+            self->sock_.set_option(boost::asio::ip::tcp::no_delay{true});
+            self->send();
+        });
+    }
+
+    void retry_later() {
+        if (done())
+            return;
+        auto timer = std::make_shared<boost::asio::steady_timer>(sock_.get_executor(), std::chrono::milliseconds{10});
+        timer->async_wait([self = shared_from_this(), timer](boost::beast::error_code) { self->reconnect(); });
+    }
+
+    void reconnect() {
+        boost::beast::error_code ec;
+        sock_.close(ec);
+        if (done())
+            return;
+        ++rec_.reconnects;
+        buffer_.clear();
+        connect();
+    }
+
+    [[nodiscard]] bool done() const noexcept { return ctl_.stop.load(std::memory_order_relaxed) || clock::now() >= ctl_.deadline; }
+
+    bool take_budget() noexcept {
+        if (ctl_.budget.load(std::memory_order_relaxed) < 0)
+            return true;
+        return ctl_.budget.fetch_sub(1, std::memory_order_relaxed) > 0;
+    }
+
+    void send() {
+        if (done() || !take_budget())
+            return close();
+        const auto* spec = wl_.next(rng_, dist_);
+        if (!spec)
+            return close();
+
+        namespace http = boost::beast::http;
+        req_ = {};
+        req_.version(11);
+        req_.method(spec->method);
+        req_.target(spec->target);
+        req_.set(http::field::host, ctl_.host);
+        req_.set(http::field::user_agent, "virthttp-loadgen");
+        if (!ctl_.auth_key.empty())
+            req_.set("X-Auth-Key", ctl_.auth_key);
+        if (!spec->body.empty()) {
+            req_.set(http::field::content_type, "application/json");
+            req_.body() = spec->body;
+        }
+        req_.prepare_payload();
+
+        start_ = clock::now();
+        http::async_write(sock_, req_, [self = shared_from_this()](boost::beast::error_code ec, std::size_t) {
+            if (ec)
+                return self->failed();
+            self->receive();
+        });
+    }
+
+    void receive() {
+        res_.emplace();
+        res_->body_limit(std::uint64_t{64} * 1024 * 1024);
+        boost::beast::http::async_read(sock_, buffer_, *res_, [self = shared_from_this()](boost::beast::error_code ec, std::size_t) {
+            if (ec)
+                return self->failed();
+            self->completed();
+        });
+    }
+
+    void completed() {
+        const auto end = clock::now();
+        const auto& res = res_->get();
+        if (start_ >= ctl_.measure_from) {
+            Sample s{end - start_, res.result_int(), std::nullopt};
+            if (const auto hdr = res["X-Alloc-Count"]; !hdr.empty()) {
+                std::size_t n;
+                if (std::from_chars(hdr.data(), hdr.data() + hdr.size(), n).ec == std::errc{})
+                    s.allocs = n;
+            }
+            rec_.record(s);
+        }
+        if (!res.keep_alive())
+            return reconnect();
+        send();
+    }
+
+    void failed() {
+        if (start_ >= ctl_.measure_from)
+            rec_.record({clock::now() - start_, 0, std::nullopt});
+        ++rec_.transport_errors;
+        retry_later();
+    }
+
+    void close() {
+        boost::beast::error_code ec;
+        sock_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ec);
+        sock_.close(ec);
+    }
+
+    boost::asio::ip::tcp::socket sock_;
+    boost::beast::flat_buffer buffer_;
+    boost::beast::http::request<boost::beast::http::string_body> req_;
+    std::optional<boost::beast::http::response_parser<boost::beast::http::string_body>> res_;
+    RunControl& ctl_;
+    Workload& wl_;
+    Recorder& rec_;
+    std::mt19937_64 rng_;
+    std::discrete_distribution<std::size_t> dist_;
+    clock::time_point start_;
+};
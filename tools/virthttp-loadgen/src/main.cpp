@@ -0,0 +1,191 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+#include <boost/asio.hpp>
+#include "client.hpp"
+#include "server.hpp"
+#include "stats.hpp"
+#include "workload.hpp"
+
+using namespace std::literals;
+
+namespace {
+constexpr std::string_view usage =
+    "Usage: virthttp-loadgen [options]\n"
+    "\n"
+    "Target:\n"
+    "  --server PATH        spawn this virthttp binary against libvirt's test driver (otherwise, target a running server)\n"
+    "  --host ADDR          server address (default 127.0.0.1)\n"
+    "  --port PORT          server port (default 18081)\n"
+    "  --server-threads N   [http_server] threads of the spawned server (default 1)\n"
+    "  --domains N          spawned server: populate a generated test node with N domains instead of test:///default\n"
+    "  --networks N         spawned server: same, for networks (default 1 when --domains is given)\n"
+    "  --preload LIB        spawned server: LD_PRELOAD this library\n"
+    "  --auth-key KEY       send this X-Auth-Key\n"
+    "\n"
+    "Load:\n"
+    "  --connections N      concurrent keep-alive connections (default 16)\n"
+    "  --threads N          client I/O threads (default 1)\n"
+    "  --duration SECS      measured run length (default 10)\n"
+    "  --requests N         stop after N requests instead\n"
+    "  --warmup SECS        unrecorded lead-in (default 1)\n"
+    "  --mix FILE           JSONL request mix, picked at random by \"weight\" (default: read-mostly mix)\n"
+    "  --trace FILE         JSONL trace, replayed in order across the connections\n"
+    "  --loop               replay the trace until the run ends\n"
+    "  --seed N             random seed (default 1)\n"
+    "\n"
+    "Output:\n"
+    "  --json FILE          also write the report as JSON\n";
+
+struct Options {
+    ServerOptions server;
+    bool spawn = false;
+    unsigned domains = 0, networks = 0;
+    std::string auth_key;
+    unsigned connections = 16, threads = 1;
+    double duration = 10, warmup = 1;
+    long long requests = -1;
+    std::string mix, trace;
+    bool loop = false;
+    std::uint64_t seed = 1;
+    std::string json;
+};
+
+Options parse_args(int argc, char** argv) {
+    Options o;
+    std::map<std::string_view, std::string_view> kv;
+    for (int i = 1; i < argc; ++i) {
+        const std::string_view arg = argv[i];
+        if (arg == "--help"sv || arg == "-h"sv)
+            std::cout << usage, std::exit(EXIT_SUCCESS);
+        if (arg == "--loop"sv) {
+            o.loop = true;
+            continue;
+        }
+        if (arg.substr(0, 2) != "--"sv || i + 1 >= argc)
+            throw std::invalid_argument{"bad argument: " + std::string{arg}};
+        kv[arg.substr(2)] = argv[++i];
+    }
+
+    const auto num = [&](std::string_view key, auto& out) {
+        if (const auto it = kv.find(key); it != kv.end()) {
+            out = static_cast<std::remove_reference_t<decltype(out)>>(std::stod(std::string{it->second}));
+            kv.erase(it);
+        }
+    };
+    const auto str = [&](std::string_view key, std::string& out) {
+        if (const auto it = kv.find(key); it != kv.end()) {
+            out = it->second;
+            kv.erase(it);
+        }
+    };
+
+    str("server", o.server.binary);
+    str("host", o.server.address);
+    num("port", o.server.port);
+    num("server-threads", o.server.threads);
+    num("domains", o.domains);
+    num("networks", o.networks);
+    str("preload", o.server.preload);
+    str("auth-key", o.auth_key);
+    num("connections", o.connections);
+    num("threads", o.threads);
+    num("duration", o.duration);
+    num("requests", o.requests);
+    num("warmup", o.warmup);
+    str("mix", o.mix);
+    str("trace", o.trace);
+    num("seed", o.seed);
+    str("json", o.json);
+    if (!kv.empty())
+        throw std::invalid_argument{"unknown option: --" + std::string{kv.begin()->first}};
+
+    o.spawn = !o.server.binary.empty();
+    if (o.domains && !o.networks)
+        o.networks = 1;
+    if (!o.mix.empty() && !o.trace.empty())
+        throw std::invalid_argument{"--mix and --trace are mutually exclusive"};
+    o.connections = std::max(1u, o.connections);
+    o.threads = std::max(1u, o.threads);
+    return o;
+}
+} // namespace
+
+/**
+ * \internal
+ * Closed-loop load generator: optionally spawns a server against libvirt's test driver,
+ * drives it from keep-alive connections, and reports latency quantiles, throughput and per-request allocations
+ **/
+int main(int argc, char** argv) try {
+    const auto opts = parse_args(argc, argv);
+
+    auto workload = std::make_unique<Workload>(!opts.trace.empty() ? load_jsonl(opts.trace) : !opts.mix.empty() ? load_jsonl(opts.mix) : default_mix(),
+                                               !opts.trace.empty() ? Workload::Mode::trace : Workload::Mode::mix, opts.loop);
+
+    std::string node_file;
+    std::unique_ptr<ServerProcess> server;
+    if (opts.spawn) {
+        auto sopts = opts.server;
+        if (opts.domains || opts.networks) {
+            node_file = "/tmp/virthttp-loadgen-node-" + std::to_string(::getpid()) + ".xml";
+            write_test_node(node_file, opts.domains, opts.networks);
+            sopts.node_file = node_file;
+        }
+        server = std::make_unique<ServerProcess>(sopts);
+        if (!server->wait_ready(10s))
+            throw std::runtime_error{"server did not come up on " + opts.server.address + ':' + std::to_string(opts.server.port)};
+    }
+
+    boost::asio::io_context ioc{static_cast<int>(opts.threads)};
+    RunControl ctl;
+    ctl.endpoint = {boost::asio::ip::make_address(opts.server.address), opts.server.port};
+    ctl.host = opts.server.address + ':' + std::to_string(opts.server.port);
+    ctl.auth_key = opts.auth_key;
+    const auto start = std::chrono::steady_clock::now();
+    ctl.measure_from = start + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opts.warmup));
+    if (opts.requests >= 0)
+        ctl.budget = opts.requests, ctl.measure_from = start;
+    else
+        ctl.deadline = ctl.measure_from + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<double>(opts.duration));
+
+    std::vector<Recorder> recorders(opts.connections);
+    std::mt19937_64 seeder{opts.seed};
+    for (auto& rec : recorders) {
+        rec.reserve(4096);
+        std::make_shared<Client>(ioc, ctl, *workload, rec, seeder())->run();
+    }
+
+    std::vector<std::thread> v;
+    v.reserve(opts.threads - 1);
+    for (auto i = opts.threads - 1; i > 0; --i)
+        v.emplace_back([&ioc] { ioc.run(); });
+    ioc.run();
+    for (auto& t : v)
+        t.join();
+    const auto end = std::chrono::steady_clock::now();
+
+    if (server)
+        server->stop();
+    if (!node_file.empty())
+        std::remove(node_file.c_str());
+
+    const Report report{recorders, end - std::max(ctl.measure_from, start)};
+    report.print(std::cout);
+    if (!opts.json.empty()) {
+        std::ofstream ofs{opts.json};
+        report.write_json(ofs);
+    }
+    return EXIT_SUCCESS;
+} catch (const std::exception& e) {
+    std::cerr << "virthttp-loadgen: " << e.what() << '\n' << usage;
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,143 @@
+#pragma once
+
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <boost/asio/connect.hpp>
+#include <boost/asio/io_context.hpp>
+#include <boost/asio/ip/tcp.hpp>
+
+/**
+ * \internal
+ * Settings of a server spawned for the duration of a run
+ **/
+struct ServerOptions {
+    std::string binary;        ///< path to the virthttp executable
+    std::string address = "127.0.0.1";
+    unsigned short port = 18081;
+    unsigned threads = 1;
+    std::string node_file;     ///< test driver node description; `default` node when empty
+    std::string preload;       ///< shared object to LD_PRELOAD into the server (e.g. a libvirt fault injector)
+    std::string extra_config;  ///< appended verbatim to the generated config.ini
+};
+
+/**
+ * \internal
+ * Writes a test driver node description with the given number of running domains and active networks
+ **/
+inline void write_test_node(const std::string& path, unsigned domains, unsigned networks) {
+    std::ofstream ofs{path};
+    if (!ofs)
+        throw std::runtime_error{"unable to write " + path};
+    ofs << "<node>\n";
+    for (unsigned i = 0; i < domains; ++i)
+        ofs << "  <domain type='test'><name>test" << i << "</name><memory>8388608</memory><currentMemory>2097152</currentMemory>"
+            << "<vcpu>2</vcpu><os><type arch='x86_64'>hvm</type></os></domain>\n";
+    for (unsigned i = 0; i < networks; ++i)
+        ofs << "  <network><name>net" << i << "</name><bridge name='virbr" << i << "'/><forward/><ip address='192.168." << (i % 255)
+            << ".1' netmask='255.255.255.0'/></network>\n";
+    ofs << "</node>\n";
+}
+
+/**
+ * \internal
+ * A virthttp server running as a child process in a scratch working directory, killed on destruction
+ **/
+class ServerProcess {
+  public:
+    explicit ServerProcess(const ServerOptions& opts) : opts_(opts) {
+        char tmpl[] = "/tmp/virthttp-loadgen.XXXXXX";
+        if (!::mkdtemp(tmpl))
+            throw std::runtime_error{std::string{"mkdtemp: "} + std::strerror(errno)};
+        workdir_ = tmpl;
+        write_config();
+
+        pid_ = ::fork();
+        if (pid_ < 0)
+            throw std::runtime_error{std::string{"fork: "} + std::strerror(errno)};
+        if (pid_ == 0) {
+            if (::chdir(workdir_.c_str()) != 0)
+                std::_Exit(127);
+            if (!opts_.preload.empty())
+                ::setenv("LD_PRELOAD", opts_.preload.c_str(), 1);
+            ::execl(opts_.binary.c_str(), opts_.binary.c_str(), static_cast<char*>(nullptr));
+            std::_Exit(127);
+        }
+    }
+
+    ServerProcess(const ServerProcess&) = delete;
+    ServerProcess& operator=(const ServerProcess&) = delete;
+
+    ~ServerProcess() {
+        stop();
+        std::remove((workdir_ + "/config.ini").c_str());
+        ::rmdir(workdir_.c_str());
+    }
+
+    /**
+     * \internal
+     * Polls the listening port until it accepts connections
+     *
+     * \return `false` if the server exited or did not come up in time
+     **/
+    bool wait_ready(std::chrono::milliseconds timeout) {
+        namespace net = boost::asio;
+        net::io_context ioc;
+        const auto deadline = std::chrono::steady_clock::now() + timeout;
+        const net::ip::tcp::endpoint ep{net::ip::make_address(opts_.address), opts_.port};
+        while (std::chrono::steady_clock::now() < deadline) {
+            if (int status; ::waitpid(pid_, &status, WNOHANG) == pid_)
+                return pid_ = -1, false;
+            net::ip::tcp::socket sock{ioc};
+            boost::system::error_code ec;
+            sock.connect(ep, ec);
+            if (!ec)
+                return true;
+            std::this_thread::sleep_for(std::chrono::milliseconds{50});
+        }
+        return false;
+    }
+
+    void stop() noexcept {
+        if (pid_ <= 0)
+            return;
+        ::kill(pid_, SIGTERM);
+        int status;
+        ::waitpid(pid_, &status, 0);
+        pid_ = -1;
+    }
+
+  private:
+    void write_config() const {
+        std::ofstream ofs{workdir_ + "/config.ini"};
+        if (!ofs)
+            throw std::runtime_error{"unable to write config.ini in " + workdir_};
+        // connURI is built as driver://host/path, so a path without its leading slash gives test:///abs/path.xml
+        const auto path = opts_.node_file.empty() ? std::string{"default"} : opts_.node_file.substr(opts_.node_file.find_first_not_of('/'));
+        ofs << "[libvirtd]\n"
+            << "driver=test\n"
+            << "path=" << path << "\n\n"
+            << "[http_server]\n"
+            << "address=" << opts_.address << '\n'
+            << "port=" << opts_.port << '\n'
+            << "threads=" << opts_.threads << '\n'
+            << "auth-key-required=false\n\n"
+            << "[wrapperd]\n"
+            << "quiet=true\n"
+            << opts_.extra_config;
+    }
+
+    ServerOptions opts_;
+    std::string workdir_;
+    pid_t pid_ = -1;
+};
@@ -0,0 +1,160 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <optional>
+#include <ostream>
+#include <vector>
+#include <rapidjson/ostreamwrapper.h>
+#include <rapidjson/prettywriter.h>
+
+/**
+ * \internal
+ * A single completed request, as observed from the client
+ **/
+struct Sample {
+    std::chrono::nanoseconds latency;
+    unsigned status;                  ///< HTTP status code; 0 when the exchange failed at the transport level
+    std::optional<std::size_t> allocs; ///< value of the server's `X-Alloc-Count` header, if any
+};
+
+/**
+ * \internal
+ * Per-client sample sink; kept separate per connection so that recording never needs to synchronize
+ **/
+struct Recorder {
+    std::vector<Sample> samples;
+    std::uint64_t transport_errors = 0;
+    std::uint64_t reconnects = 0;
+
+    void reserve(std::size_t n) { samples.reserve(n); }
+    void record(Sample s) { samples.push_back(s); }
+};
+
+/**
+ * \internal
+ * Aggregated view of a run, computed once all the clients are done
+ **/
+class Report {
+  public:
+    constexpr static std::array quantiles = {0.5, 0.9, 0.99, 0.999};
+    constexpr static std::array quantile_names = {"p50", "p90", "p99", "p999"};
+
+    Report(std::vector<Recorder>& recs, std::chrono::nanoseconds elapsed) : elapsed_(elapsed) {
+        for (auto& rec : recs) {
+            transport_errors_ += rec.transport_errors;
+            reconnects_ += rec.reconnects;
+            for (const auto& s : rec.samples) {
+                latencies_.push_back(s.latency);
+                ++status_classes_[std::min(s.status / 100, 5u)];
+                if (s.allocs)
+                    allocs_.push_back(*s.allocs);
+            }
+        }
+        std::sort(latencies_.begin(), latencies_.end());
+        std::sort(allocs_.begin(), allocs_.end());
+    }
+
+    [[nodiscard]] std::size_t count() const noexcept { return latencies_.size(); }
+    [[nodiscard]] double throughput() const noexcept {
+        const auto secs = std::chrono::duration<double>(elapsed_).count();
+        return secs > 0 ? count() / secs : 0;
+    }
+
+    /**
+     * \internal
+     * Nearest-rank quantile of a sorted sample set
+     **/
+    template <class T> [[nodiscard]] static T quantile(const std::vector<T>& sorted, double q) noexcept {
+        if (sorted.empty())
+            return T{};
+        const auto rank = static_cast<std::size_t>(q * static_cast<double>(sorted.size() - 1) + 0.5);
+        return sorted[std::min(rank, sorted.size() - 1)];
+    }
+
+    void print(std::ostream& os) const {
+        const auto us = [](std::chrono::nanoseconds ns) { return std::chrono::duration<double, std::micro>(ns).count(); };
+        os << "requests:      " << count() << " in " << std::chrono::duration<double>(elapsed_).count() << "s (" << throughput() << " req/s)\n";
+        os << "status:        0xx=" << status_classes_[0] << " 2xx=" << status_classes_[2] << " 3xx=" << status_classes_[3]
+           << " 4xx=" << status_classes_[4] << " 5xx=" << status_classes_[5] << '\n';
+        os << "transport:     errors=" << transport_errors_ << " reconnects=" << reconnects_ << '\n';
+        if (latencies_.empty())
+            return;
+        os << "latency (us):  ";
+        for (std::size_t i = 0; i < quantiles.size(); ++i)
+            os << quantile_names[i] << '=' << us(quantile(latencies_, quantiles[i])) << ' ';
+        os << "max=" << us(latencies_.back()) << '\n';
+        if (allocs_.empty())
+            os << "allocs:        n/a (server not built with VIRTHTTP_COUNT_ALLOCS)\n";
+        else
+            os << "allocs/req:    mean=" << allocs_mean() << " p50=" << quantile(allocs_, 0.5) << " p99=" << quantile(allocs_, 0.99)
+               << " max=" << allocs_.back() << '\n';
+    }
+
+    void write_json(std::ostream& os) const {
+        rapidjson::OStreamWrapper osw{os};
+        rapidjson::PrettyWriter<rapidjson::OStreamWrapper> w{osw};
+        w.StartObject();
+        w.Key("requests");
+        w.Uint64(count());
+        w.Key("elapsed_s");
+        w.Double(std::chrono::duration<double>(elapsed_).count());
+        w.Key("throughput_rps");
+        w.Double(throughput());
+        w.Key("transport_errors");
+        w.Uint64(transport_errors_);
+        w.Key("reconnects");
+        w.Uint64(reconnects_);
+        w.Key("status");
+        w.StartObject();
+        for (unsigned i = 0; i < status_classes_.size(); ++i) {
+            const char key[] = {char('0' + i), 'x', 'x', '\0'};
+            w.Key(key);
+            w.Uint64(status_classes_[i]);
+        }
+        w.EndObject();
+        w.Key("latency_us");
+        w.StartObject();
+        for (std::size_t i = 0; i < quantiles.size(); ++i) {
+            w.Key(quantile_names[i]);
+            w.Double(std::chrono::duration<double, std::micro>(quantile(latencies_, quantiles[i])).count());
+        }
+        w.Key("max");
+        w.Double(latencies_.empty() ? 0. : std::chrono::duration<double, std::micro>(latencies_.back()).count());
+        w.EndObject();
+        w.Key("allocs_per_request");
+        if (allocs_.empty())
+            w.Null();
+        else {
+            w.StartObject();
+            w.Key("mean");
+            w.Double(allocs_mean());
+            w.Key("p50");
+            w.Uint64(quantile(allocs_, 0.5));
+            w.Key("p99");
+            w.Uint64(quantile(allocs_, 0.99));
+            w.Key("max");
+            w.Uint64(allocs_.back());
+            w.EndObject();
+        }
+        w.EndObject();
+        os << '\n';
+    }
+
+  private:
+    [[nodiscard]] double allocs_mean() const noexcept {
+        double sum = 0;
+        for (auto a : allocs_)
+            sum += a;
+        return allocs_.empty() ? 0 : sum / allocs_.size();
+    }
+
+    std::chrono::nanoseconds elapsed_;
+    std::vector<std::chrono::nanoseconds> latencies_;
+    std::vector<std::size_t> allocs_;
+    std::array<std::uint64_t, 6> status_classes_{};
+    std::uint64_t transport_errors_ = 0;
+    std::uint64_t reconnects_ = 0;
+};
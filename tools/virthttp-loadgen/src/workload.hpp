@@ -0,0 +1,128 @@
+#pragma once
+
+#include <atomic>
+#include <fstream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <boost/beast/http/verb.hpp>
+#include <rapidjson/document.h>
+#include <rapidjson/stringbuffer.h>
+#include <rapidjson/writer.h>
+
+/**
+ * \internal
+ * One request of a workload; the body is sent verbatim
+ **/
+struct RequestSpec {
+    boost::beast::http::verb method = boost::beast::http::verb::get;
+    std::string target;
+    std::string body;
+    double weight = 1.;
+};
+
+/**
+ * \internal
+ * Loads a JSONL request file; each non-empty line is an object of the form
+ * `{"method": "GET", "target": "/libvirt/domains", "body": {...}, "weight": 1}`
+ * where everything but `target` is optional. A `body` that is not a string is serialized back to JSON.
+ **/
+inline std::vector<RequestSpec> load_jsonl(const std::string& path) {
+    std::ifstream ifs{path};
+    if (!ifs)
+        throw std::runtime_error{"unable to open " + path};
+
+    std::vector<RequestSpec> specs;
+    std::string line;
+    for (std::size_t lineno = 1; std::getline(ifs, line); ++lineno) {
+        if (line.find_first_not_of(" \t\r") == std::string::npos)
+            continue;
+        rapidjson::Document doc;
+        doc.Parse(line.data(), line.size());
+        if (doc.HasParseError() || !doc.IsObject() || !doc.HasMember("target") || !doc["target"].IsString())
+            throw std::runtime_error{path + ":" + std::to_string(lineno) + ": expected an object with a string \"target\""};
+
+        RequestSpec spec;
+        spec.target = doc["target"].GetString();
+        if (auto it = doc.FindMember("method"); it != doc.MemberEnd() && it->value.IsString()) {
+            spec.method = boost::beast::http::string_to_verb({it->value.GetString(), it->value.GetStringLength()});
+            if (spec.method == boost::beast::http::verb::unknown)
+                throw std::runtime_error{path + ":" + std::to_string(lineno) + ": unknown method"};
+        }
+        if (auto it = doc.FindMember("body"); it != doc.MemberEnd()) {
+            if (it->value.IsString())
+                spec.body.assign(it->value.GetString(), it->value.GetStringLength());
+            else {
+                rapidjson::StringBuffer buf;
+                rapidjson::Writer<rapidjson::StringBuffer> w{buf};
+                it->value.Accept(w);
+                spec.body.assign(buf.GetString(), buf.GetSize());
+            }
+        }
+        if (auto it = doc.FindMember("weight"); it != doc.MemberEnd() && it->value.IsNumber())
+            spec.weight = it->value.GetDouble();
+        specs.push_back(std::move(spec));
+    }
+    if (specs.empty())
+        throw std::runtime_error{path + ": no requests"};
+    return specs;
+}
+
+/**
+ * \internal
+ * Read-mostly mix suited to the test driver's default node (domain `test`, network `default`)
+ **/
+inline std::vector<RequestSpec> default_mix() {
+    using boost::beast::http::verb;
+    return {
+        {verb::get, "/libvirt/domains", {}, 4.},
+        {verb::get, "/libvirt/domains/by-name/test", {}, 4.},
+        {verb::get, "/libvirt/networks", {}, 2.},
+        {verb::get, "/libvirt/domains?active=true", {}, 1.},
+    };
+}
+
+/**
+ * \internal
+ * Hands out requests to the clients, either picked at random by weight (mix mode)
+ * or in file order, shared across all the connections (trace replay)
+ **/
+class Workload {
+  public:
+    enum class Mode { mix, trace };
+
+    Workload(std::vector<RequestSpec> specs, Mode mode, bool loop) : specs_(std::move(specs)), mode_(mode), loop_(loop) {
+        std::vector<double> weights;
+        weights.reserve(specs_.size());
+        for (const auto& s : specs_)
+            weights.push_back(s.weight);
+        dist_ = std::discrete_distribution<std::size_t>{weights.begin(), weights.end()};
+    }
+
+    /**
+     * \internal
+     * Copy of the weight distribution, for a single client to draw from
+     **/
+    [[nodiscard]] std::discrete_distribution<std::size_t> distribution() const { return dist_; }
+
+    /**
+     * \internal
+     * Next request to send, or nullptr once a non-looping trace has been fully replayed
+     **/
+    template <class URBG> const RequestSpec* next(URBG& rng, std::discrete_distribution<std::size_t>& dist) {
+        if (mode_ == Mode::mix)
+            return &specs_[dist(rng)];
+        const auto idx = cursor_.fetch_add(1, std::memory_order_relaxed);
+        if (!loop_ && idx >= specs_.size())
+            return nullptr;
+        return &specs_[idx % specs_.size()];
+    }
+
+  private:
+    std::vector<RequestSpec> specs_;
+    Mode mode_;
+    bool loop_;
+    std::discrete_distribution<std::size_t> dist_; // copied into each client, as drawing is not thread-safe
+    std::atomic<std::size_t> cursor_{0};
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+
+namespace virtsim {
+
+/**
+ * \internal
+ * Latency distribution of a simulated RPC
+ *
+ * Textual form (durations accept the `us`, `ms` and `s` suffixes, bare numbers are milliseconds):
+ * - `0` or empty: no added latency
+ * - `fixed:D`
+ * - `uniform:MIN:MAX`
+ * - `normal:MEAN:STDDEV` (clamped at 0)
+ * - `lognormal:MEDIAN:SIGMA` (heavy tail, the typical guest agent profile; SIGMA is unitless)
+ **/
+class Latency {
+  public:
+    enum class Kind { none, fixed, uniform, normal, lognormal };
+
+    Latency() noexcept = default;
+    explicit Latency(std::string_view spec) {
+        if (spec.empty() || spec == "0")
+            return;
+        const auto kind_end = spec.find(':');
+        const auto kind = spec.substr(0, kind_end);
+        auto rest = kind_end == std::string_view::npos ? std::string_view{} : spec.substr(kind_end + 1);
+        const auto next = [&] {
+            const auto end = rest.find(':');
+            const auto tok = rest.substr(0, end);
+            rest = end == std::string_view::npos ? std::string_view{} : rest.substr(end + 1);
+            if (tok.empty())
+                throw std::invalid_argument{"missing parameter in latency spec '" + std::string{spec} + '\''};
+            return tok;
+        };
+
+        if (kind == "fixed")
+            kind_ = Kind::fixed, a_ = parse_us(next());
+        else if (kind == "uniform")
+            kind_ = Kind::uniform, a_ = parse_us(next()), b_ = parse_us(next());
+        else if (kind == "normal")
+            kind_ = Kind::normal, a_ = parse_us(next()), b_ = parse_us(next());
+        else if (kind == "lognormal")
+            kind_ = Kind::lognormal, a_ = std::log(std::max(parse_us(next()), 1.)), b_ = std::stod(std::string{next()});
+        else
+            throw std::invalid_argument{"unknown latency distribution '" + std::string{kind} + '\''};
+    }
+
+    [[nodiscard]] explicit operator bool() const noexcept { return kind_ != Kind::none; }
+
+    template <class URBG> [[nodiscard]] std::chrono::microseconds draw(URBG& rng) const {
+        double us = 0;
+        switch (kind_) {
+        case Kind::none:
+            break;
+        case Kind::fixed:
+            us = a_;
+            break;
+        case Kind::uniform:
+            us = std::uniform_real_distribution<>{a_, b_}(rng);
+            break;
+        case Kind::normal:
+            us = std::normal_distribution<>{a_, b_}(rng);
+            break;
+        case Kind::lognormal:
+            us = std::lognormal_distribution<>{a_, b_}(rng);
+            break;
+        }
+        return std::chrono::microseconds{static_cast<std::int64_t>(std::max(us, 0.))};
+    }
+
+  private:
+    static double parse_us(std::string_view tok) {
+        double scale = 1000.;
+        if (tok.size() > 2 && tok.substr(tok.size() - 2) == "us")
+            scale = 1., tok.remove_suffix(2);
+        else if (tok.size() > 2 && tok.substr(tok.size() - 2) == "ms")
+            tok.remove_suffix(2);
+        else if (tok.size() > 1 && tok.back() == 's')
+            scale = 1'000'000., tok.remove_suffix(1);
+        return std::stod(std::string{tok}) * scale;
+    }
+
+    Kind kind_ = Kind::none;
+    double a_ = 0, b_ = 0;
+};
+
+/**
+ * \internal
+ * What to do to a given simulated RPC
+ **/
+struct Rule {
+    Latency latency;
+    double failure_rate = 0.; ///< probability in [0, 1] of the call failing instead of reaching libvirt
+    bool fail_after = false;  ///< whether a failing call still pays the latency (as a timed-out RPC would)
+};
+
+/**
+ * \internal
+ * Per-call statistics, dumped at exit when enabled
+ **/
+struct Counters {
+    std::atomic<std::uint64_t> calls{0};
+    std::atomic<std::uint64_t> failures{0};
+    std::atomic<std::uint64_t> delay_us{0};
+};
+
+/**
+ * \internal
+ * SplitMix64, cheap enough to be seeded anew for every simulated call
+ **/
+class SplitMix64 {
+  public:
+    using result_type = std::uint64_t;
+
+    explicit SplitMix64(std::uint64_t seed) noexcept : state_{seed} {}
+
+    [[nodiscard]] static constexpr result_type min() noexcept { return 0; }
+    [[nodiscard]] static constexpr result_type max() noexcept { return ~result_type{0}; }
+
+    result_type operator()() noexcept {
+        auto z = state_ += 0x9E3779B97F4A7C15ull;
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+        return z ^ (z >> 31);
+    }
+
+  private:
+    std::uint64_t state_;
+};
+
+/**
+ * \internal
+ * FNV-1a hash of a function name, to give each entry point its own stream of draws
+ **/
+[[nodiscard]] constexpr std::uint64_t fnv1a(std::string_view str) noexcept {
+    std::uint64_t hash = 0xCBF29CE484222325ull;
+    for (const char c : str)
+        hash = (hash ^ static_cast<unsigned char>(c)) * 0x100000001B3ull;
+    return hash;
+}
+
+} // namespace virtsim
@@ -0,0 +1,300 @@
+#include <cstdarg>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <dlfcn.h>
+#include <INIReader.h>
+#include <libvirt/libvirt.h>
+#include <libvirt/virterror.h>
+#include "rules.hpp"
+
+/**
+ * \internal
+ * \file
+ * Simulated libvirt backend
+ *
+ * Interposes on the libvirt entry points used by virthttp (either through `LD_PRELOAD` or by linking it ahead of libvirt)
+ * and delays or fails them according to the rules of the INI file named by `VIRTSIM_CONFIG`.
+ * Calls that go through are forwarded to the real libvirt, which is expected to be pointed at its in-process `test://` driver,
+ * so that the whole stack runs offline and every RPC costs exactly what the rules say.
+ *
+ * \code{.ini}
+ * [virtsim]
+ * seed=42             ; the n-th call to a function draws its latency and failure from (seed, function, n)
+ * uri=test:///default ; overrides the URI of every connection opened (optional)
+ * stats=true          ; prints per-call counters to stderr at exit
+ *
+ * [default]           ; applies to every call without a more specific rule
+ * latency=uniform:200us:1ms
+ *
+ * [agent]             ; group rule, applies to calls answered by the guest agent
+ * latency=lognormal:20ms:1.2
+ * failure=0.02
+ * fail-after-latency=true
+ *
+ * [virDomainGetHostname] ; per-function rule, takes precedence over its group
+ * latency=fixed:2s
+ * \endcode
+ **/
+
+namespace virtsim {
+namespace {
+
+class Config {
+  public:
+    Config() {
+        const char* path = std::getenv("VIRTSIM_CONFIG");
+        if (!path)
+            return;
+        INIReader reader{path};
+        if (reader.ParseError() != 0) {
+            std::fprintf(stderr, "virtsim: unable to parse %s, running as a passthrough\n", path);
+            return;
+        }
+        seed_ = static_cast<std::uint64_t>(reader.GetInteger("virtsim", "seed", 0));
+        uri_ = reader.Get("virtsim", "uri", "");
+        stats_ = reader.GetBoolean("virtsim", "stats", false);
+        for (const auto& section : reader.Sections()) {
+            if (section == "virtsim")
+                continue;
+            Rule rule;
+            try {
+                rule.latency = Latency{reader.Get(section, "latency", "")};
+            } catch (const std::exception& e) {
+                std::fprintf(stderr, "virtsim: [%s] %s\n", section.c_str(), e.what());
+            }
+            rule.failure_rate = reader.GetReal(section, "failure", 0.);
+            rule.fail_after = reader.GetBoolean(section, "fail-after-latency", false);
+            rules_.emplace(section, rule);
+        }
+    }
+
+    ~Config() {
+        if (!stats_)
+            return;
+        std::lock_guard lock{counters_mtx_};
+        std::fprintf(stderr, "virtsim: %-40s %12s %10s %14s\n", "call", "calls", "failures", "delay (ms)");
+        for (const auto& [name, c] : counters_)
+            std::fprintf(stderr, "virtsim: %-40s %12llu %10llu %14.1f\n", name.c_str(), static_cast<unsigned long long>(c->calls.load()),
+                         static_cast<unsigned long long>(c->failures.load()), static_cast<double>(c->delay_us.load()) / 1000.);
+    }
+
+    /**
+     * \internal
+     * Rule for a call: its own section, else its group's, else `[default]`; looked up once per call site
+     **/
+    [[nodiscard]] Rule lookup(std::string_view fcn, std::string_view group) const {
+        for (auto key : {fcn, group, std::string_view{"default"}})
+            if (const auto it = rules_.find(std::string{key}); it != rules_.end())
+                return it->second;
+        return {};
+    }
+
+    [[nodiscard]] Counters& counters(std::string_view fcn) {
+        std::lock_guard lock{counters_mtx_};
+        auto& slot = counters_[std::string{fcn}];
+        if (!slot)
+            slot = std::make_unique<Counters>();
+        return *slot;
+    }
+
+    [[nodiscard]] std::uint64_t seed() const noexcept { return seed_; }
+    [[nodiscard]] const char* uri(const char* requested) const noexcept { return uri_.empty() ? requested : uri_.c_str(); }
+
+  private:
+    std::uint64_t seed_ = 0;
+    std::string uri_;
+    bool stats_ = false;
+    std::map<std::string, Rule, std::less<>> rules_;
+    std::mutex counters_mtx_;
+    std::map<std::string, std::unique_ptr<Counters>> counters_;
+};
+
+Config& config() {
+    static Config cfg;
+    return cfg;
+}
+
+/**
+ * \internal
+ * Generator of the `n`-th call to `fcn`; keyed on the call rather than on the thread making it,
+ * so that a given call draws the same latency and failure in every run whatever thread and scheduling it gets
+ **/
+SplitMix64 rng(const char* fcn, std::uint64_t n) noexcept {
+    SplitMix64 key{config().seed() ^ fnv1a(fcn)};
+    return SplitMix64{key() + n * 0xD1B54A32D192ED03ull};
+}
+
+/**
+ * \internal
+ * Raises a libvirt error describing the injected failure, through libvirt's (exported but private) error reporting helper if available
+ **/
+void report_failure(const char* fcn) {
+    using Helper = void (*)(int, int, const char*, const char*, std::size_t, const char*, ...);
+    static const auto helper = reinterpret_cast<Helper>(::dlsym(RTLD_NEXT, "virReportErrorHelper"));
+    if (helper)
+        helper(VIR_FROM_NONE, VIR_ERR_OPERATION_FAILED, __FILE__, fcn, __LINE__, "virtsim: injected failure in %s", fcn);
+    else
+        virResetLastError();
+}
+
+/**
+ * \internal
+ * Applies a call's rule
+ *
+ * \return `true` if the call has to fail
+ **/
+bool simulate(const char* fcn, const Rule& rule, Counters& counters) {
+    auto gen = rng(fcn, counters.calls.fetch_add(1, std::memory_order_relaxed));
+    const bool fail = rule.failure_rate > 0 && std::bernoulli_distribution{rule.failure_rate}(gen);
+    if (rule.latency && (!fail || rule.fail_after)) {
+        const auto delay = rule.latency.draw(gen);
+        counters.delay_us.fetch_add(static_cast<std::uint64_t>(delay.count()), std::memory_order_relaxed);
+        std::this_thread::sleep_for(delay);
+    }
+    if (fail) {
+        counters.failures.fetch_add(1, std::memory_order_relaxed);
+        report_failure(fcn);
+    }
+    return fail;
+}
+
+template <class F> F next_symbol(const char* name) {
+    const auto sym = reinterpret_cast<F>(::dlsym(RTLD_NEXT, name));
+    if (!sym) {
+        std::fprintf(stderr, "virtsim: unable to resolve %s: %s\n", name, ::dlerror());
+        std::abort();
+    }
+    return sym;
+}
+
+} // namespace
+} // namespace virtsim
+
+/**
+ * \internal
+ * Defines the interposer for a libvirt entry point
+ *
+ * \param group rule group the call falls back to (`connection`, `domain`, `agent`, `network`, `storage`, `stream`, `event`)
+ * \param fail_value value returned when the call is made to fail
+ * \param first_arg statement run on the arguments before forwarding (used to override connection URIs)
+ **/
+#define VIRTSIM_WRAP_IMPL(ret, name, group, fail_value, params, args, first_arg)                                                                 \
+    extern "C" ret name params {                                                                                                             \
+        static const auto real = virtsim::next_symbol<ret(*) params>(#name);                                                                 \
+        static const auto rule = virtsim::config().lookup(#name, group);                                                                     \
+        static auto& counters = virtsim::config().counters(#name);                                                                           \
+        if (virtsim::simulate(#name, rule, counters))                                                                                        \
+            return fail_value;                                                                                                               \
+        first_arg;                                                                                                                           \
+        return real args;                                                                                                                    \
+    }
+#define VIRTSIM_WRAP(ret, name, group, fail_value, params, args) VIRTSIM_WRAP_IMPL(ret, name, group, fail_value, params, args, (void)0)
+#define VIRTSIM_WRAP_OPEN(ret, name, params, args) VIRTSIM_WRAP_IMPL(ret, name, "connection", nullptr, params, args, a = virtsim::config().uri(a))
+
+// Connections
+VIRTSIM_WRAP_OPEN(virConnectPtr, virConnectOpen, (const char* a), (a))
+VIRTSIM_WRAP_OPEN(virConnectPtr, virConnectOpenReadOnly, (const char* a), (a))
+VIRTSIM_WRAP_OPEN(virConnectPtr, virConnectOpenAuth, (const char* a, virConnectAuthPtr b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virConnectListAllDomains, "connection", -1, (virConnectPtr a, virDomainPtr** b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virConnectListAllNetworks, "connection", -1, (virConnectPtr a, virNetworkPtr** b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virConnectListAllStoragePools, "connection", -1, (virConnectPtr a, virStoragePoolPtr** b, unsigned int c), (a, b, c))
+
+// Domains
+VIRTSIM_WRAP(virDomainPtr, virDomainLookupByName, "domain", nullptr, (virConnectPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(virDomainPtr, virDomainLookupByUUIDString, "domain", nullptr, (virConnectPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(int, virDomainGetInfo, "domain", -1, (virDomainPtr a, virDomainInfoPtr b), (a, b))
+VIRTSIM_WRAP(int, virDomainGetState, "domain", -1, (virDomainPtr a, int* b, int* c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(char*, virDomainGetOSType, "domain", nullptr, (virDomainPtr a), (a))
+VIRTSIM_WRAP(char*, virDomainGetXMLDesc, "domain", nullptr, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainCreate, "domain", -1, (virDomainPtr a), (a))
+VIRTSIM_WRAP(int, virDomainCreateWithFlags, "domain", -1, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainShutdown, "domain", -1, (virDomainPtr a), (a))
+VIRTSIM_WRAP(int, virDomainShutdownFlags, "domain", -1, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainDestroy, "domain", -1, (virDomainPtr a), (a))
+VIRTSIM_WRAP(int, virDomainDestroyFlags, "domain", -1, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainReboot, "domain", -1, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainReset, "domain", -1, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainSuspend, "domain", -1, (virDomainPtr a), (a))
+VIRTSIM_WRAP(int, virDomainResume, "domain", -1, (virDomainPtr a), (a))
+VIRTSIM_WRAP(int, virDomainUndefineFlags, "domain", -1, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainSetAutostart, "domain", -1, (virDomainPtr a, int b), (a, b))
+VIRTSIM_WRAP(int, virDomainSetMemoryFlags, "domain", -1, (virDomainPtr a, unsigned long b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virDomainSetVcpusFlags, "domain", -1, (virDomainPtr a, unsigned int b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virDomainOpenConsole, "domain", -1, (virDomainPtr a, const char* b, virStreamPtr c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainOpenGraphicsFD, "domain", -1, (virDomainPtr a, unsigned int b, unsigned int c), (a, b, c))
+
+// Guest agent
+VIRTSIM_WRAP(char*, virDomainGetHostname, "agent", nullptr, (virDomainPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virDomainGetTime, "agent", -1, (virDomainPtr a, long long* b, unsigned int* c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainSetTime, "agent", -1, (virDomainPtr a, long long b, unsigned int c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainGetFSInfo, "agent", -1, (virDomainPtr a, virDomainFSInfoPtr** b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virDomainFSFreeze, "agent", -1, (virDomainPtr a, const char** b, unsigned int c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainFSThaw, "agent", -1, (virDomainPtr a, const char** b, unsigned int c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainFSTrim, "agent", -1, (virDomainPtr a, const char* b, unsigned long long c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainInterfaceAddresses, "agent", -1, (virDomainPtr a, virDomainInterfacePtr** b, unsigned int c, unsigned int d),
+             (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainGetGuestVcpus, "agent", -1, (virDomainPtr a, virTypedParameterPtr* b, unsigned int* c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virDomainSetUserPassword, "agent", -1, (virDomainPtr a, const char* b, const char* c, unsigned int d), (a, b, c, d))
+
+// Networks
+VIRTSIM_WRAP(virNetworkPtr, virNetworkLookupByName, "network", nullptr, (virConnectPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(virNetworkPtr, virNetworkLookupByUUIDString, "network", nullptr, (virConnectPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(char*, virNetworkGetXMLDesc, "network", nullptr, (virNetworkPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virNetworkIsActive, "network", -1, (virNetworkPtr a), (a))
+VIRTSIM_WRAP(int, virNetworkCreate, "network", -1, (virNetworkPtr a), (a))
+VIRTSIM_WRAP(int, virNetworkDestroy, "network", -1, (virNetworkPtr a), (a))
+VIRTSIM_WRAP(int, virNetworkUndefine, "network", -1, (virNetworkPtr a), (a))
+VIRTSIM_WRAP(int, virNetworkGetDHCPLeases, "network", -1, (virNetworkPtr a, const char* b, virNetworkDHCPLeasePtr** c, unsigned int d),
+             (a, b, c, d))
+
+// Storage pools and volumes
+VIRTSIM_WRAP(virStoragePoolPtr, virStoragePoolLookupByName, "storage", nullptr, (virConnectPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(virStoragePoolPtr, virStoragePoolLookupByUUIDString, "storage", nullptr, (virConnectPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(virStoragePoolPtr, virStoragePoolDefineXML, "storage", nullptr, (virConnectPtr a, const char* b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virStoragePoolGetInfo, "storage", -1, (virStoragePoolPtr a, virStoragePoolInfoPtr b), (a, b))
+VIRTSIM_WRAP(char*, virStoragePoolGetXMLDesc, "storage", nullptr, (virStoragePoolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolIsActive, "storage", -1, (virStoragePoolPtr a), (a))
+VIRTSIM_WRAP(int, virStoragePoolIsPersistent, "storage", -1, (virStoragePoolPtr a), (a))
+VIRTSIM_WRAP(int, virStoragePoolGetAutostart, "storage", -1, (virStoragePoolPtr a, int* b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolSetAutostart, "storage", -1, (virStoragePoolPtr a, int b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolBuild, "storage", -1, (virStoragePoolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolCreate, "storage", -1, (virStoragePoolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolDestroy, "storage", -1, (virStoragePoolPtr a), (a))
+VIRTSIM_WRAP(int, virStoragePoolDelete, "storage", -1, (virStoragePoolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolUndefine, "storage", -1, (virStoragePoolPtr a), (a))
+VIRTSIM_WRAP(int, virStoragePoolRefresh, "storage", -1, (virStoragePoolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStoragePoolListAllVolumes, "storage", -1, (virStoragePoolPtr a, virStorageVolPtr** b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(virStorageVolPtr, virStorageVolLookupByName, "storage", nullptr, (virStoragePoolPtr a, const char* b), (a, b))
+VIRTSIM_WRAP(virStorageVolPtr, virStorageVolCreateXML, "storage", nullptr, (virStoragePoolPtr a, const char* b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virStorageVolGetInfo, "storage", -1, (virStorageVolPtr a, virStorageVolInfoPtr b), (a, b))
+VIRTSIM_WRAP(int, virStorageVolGetInfoFlags, "storage", -1, (virStorageVolPtr a, virStorageVolInfoPtr b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(char*, virStorageVolGetPath, "storage", nullptr, (virStorageVolPtr a), (a))
+VIRTSIM_WRAP(char*, virStorageVolGetXMLDesc, "storage", nullptr, (virStorageVolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStorageVolResize, "storage", -1, (virStorageVolPtr a, unsigned long long b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virStorageVolWipe, "storage", -1, (virStorageVolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStorageVolDelete, "storage", -1, (virStorageVolPtr a, unsigned int b), (a, b))
+VIRTSIM_WRAP(int, virStorageVolDownload, "storage", -1,
+             (virStorageVolPtr a, virStreamPtr b, unsigned long long c, unsigned long long d, unsigned int e), (a, b, c, d, e))
+VIRTSIM_WRAP(int, virStorageVolUpload, "storage", -1,
+             (virStorageVolPtr a, virStreamPtr b, unsigned long long c, unsigned long long d, unsigned int e), (a, b, c, d, e))
+
+// Streams (volume transfers, consoles); their event callbacks are local to the client and go through untouched
+VIRTSIM_WRAP(int, virStreamSend, "stream", -1, (virStreamPtr a, const char* b, size_t c), (a, b, c))
+VIRTSIM_WRAP(int, virStreamSendHole, "stream", -1, (virStreamPtr a, long long b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virStreamRecv, "stream", -1, (virStreamPtr a, char* b, size_t c), (a, b, c))
+VIRTSIM_WRAP(int, virStreamRecvFlags, "stream", -1, (virStreamPtr a, char* b, size_t c, unsigned int d), (a, b, c, d))
+VIRTSIM_WRAP(int, virStreamRecvHole, "stream", -1, (virStreamPtr a, long long* b, unsigned int c), (a, b, c))
+VIRTSIM_WRAP(int, virStreamFinish, "stream", -1, (virStreamPtr a), (a))
+VIRTSIM_WRAP(int, virStreamAbort, "stream", -1, (virStreamPtr a), (a))
+
+// Event subscriptions; the events themselves are delivered by the real event loop
+VIRTSIM_WRAP(int, virConnectDomainEventRegisterAny, "event", -1,
+             (virConnectPtr a, virDomainPtr b, int c, virConnectDomainEventGenericCallback d, void* e, virFreeCallback f), (a, b, c, d, e, f))
+VIRTSIM_WRAP(int, virConnectDomainEventDeregisterAny, "event", -1, (virConnectPtr a, int b), (a, b))
+VIRTSIM_WRAP(int, virConnectNetworkEventRegisterAny, "event", -1,
+             (virConnectPtr a, virNetworkPtr b, int c, virConnectNetworkEventGenericCallback d, void* e, virFreeCallback f), (a, b, c, d, e, f))
+VIRTSIM_WRAP(int, virConnectNetworkEventDeregisterAny, "event", -1, (virConnectPtr a, int b), (a, b))